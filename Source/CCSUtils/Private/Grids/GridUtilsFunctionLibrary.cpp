@@ -118,3 +118,81 @@ void UGridUtilsFunctionLibrary::ForEachGridCellOnPerimeter(const FGridCellPositi
 		}
 	}
 }
+
+void UGridUtilsFunctionLibrary::LabelConnectedComponents(TArray<FGridConnectedComponent>& OutComponents, TArray<int32>& OutLabels,
+	const FGridBounds& Bounds, const TBitArray<>& Cells, TConstArrayView<int32> Weights)
+{
+	const int32 Cols     = Bounds.GetCols();
+	const int32 CellsNum = Bounds.GetCols() * Bounds.GetRows();
+	checkf(Cells.Num() == CellsNum, TEXT("Cells bitset doesn't match the bounds"));
+	checkf(Weights.IsEmpty() || Weights.Num() == CellsNum, TEXT("Weights don't match the bounds"));
+
+	OutComponents.Reset();
+	OutLabels.Init(INDEX_NONE, CellsNum);
+
+	// Provisional labels are indices in Parents, a label is its own parent when it's a root
+	TArray<int32> Parents;
+	const auto FindRoot = [&Parents](int32 Label)
+	{
+		while (Parents[Label] != Label)
+		{
+			Parents[Label] = Parents[Parents[Label]];	// Path halving
+			Label = Parents[Label];
+		}
+		return Label;
+	};
+
+	// FIRST PASS ------
+	// Each set cell takes the label of its left or bottom neighbour, labels of both neighbours are united
+	
+	for (TConstSetBitIterator<> It(Cells); It; ++It)
+	{
+		const int32 CellIndex   = It.GetIndex();
+		const int32 LeftLabel   = (CellIndex % Cols > 0) ? OutLabels[CellIndex - 1] : INDEX_NONE;
+		const int32 BottomLabel = (CellIndex >= Cols) ? OutLabels[CellIndex - Cols] : INDEX_NONE;
+
+		if (LeftLabel == INDEX_NONE && BottomLabel == INDEX_NONE)
+		{
+			OutLabels[CellIndex] = Parents.Add(Parents.Num());
+			continue;
+		}
+		if (LeftLabel == INDEX_NONE || BottomLabel == INDEX_NONE)
+		{
+			OutLabels[CellIndex] = (LeftLabel != INDEX_NONE) ? LeftLabel : BottomLabel;
+			continue;
+		}
+
+		const int32 LeftRoot   = FindRoot(LeftLabel);
+		const int32 BottomRoot = FindRoot(BottomLabel);
+		Parents[FMath::Max(LeftRoot, BottomRoot)] = FMath::Min(LeftRoot, BottomRoot);
+		OutLabels[CellIndex] = LeftLabel;
+	}
+
+	// SECOND PASS ------
+	// Provisional labels are replaced with compact component indices, components data is accumulated
+
+	TArray<int32> ComponentOfRoot;
+	ComponentOfRoot.Init(INDEX_NONE, Parents.Num());
+	for (TConstSetBitIterator<> It(Cells); It; ++It)
+	{
+		const int32 CellIndex = It.GetIndex();
+		const FGridCellPosition CellPosition = Bounds.GetCellPositionAtIndex(CellIndex);
+
+		int32& ComponentIndex = ComponentOfRoot[FindRoot(OutLabels[CellIndex])];
+		if (ComponentIndex == INDEX_NONE)
+		{
+			ComponentIndex = OutComponents.AddDefaulted();
+			OutComponents[ComponentIndex].Bounds = FGridBounds{CellPosition, CellPosition};
+		}
+
+		FGridConnectedComponent& Component = OutComponents[ComponentIndex];
+		Component.Bounds.BottomLeftCell.X = FMath::Min(Component.Bounds.BottomLeftCell.X, CellPosition.X);
+		Component.Bounds.BottomLeftCell.Y = FMath::Min(Component.Bounds.BottomLeftCell.Y, CellPosition.Y);
+		Component.Bounds.TopRightCell.X   = FMath::Max(Component.Bounds.TopRightCell.X, CellPosition.X);
+		Component.Bounds.TopRightCell.Y   = FMath::Max(Component.Bounds.TopRightCell.Y, CellPosition.Y);
+		Component.CellsNum++;
+		Component.Weight += Weights.IsEmpty() ? 0 : Weights[CellIndex];
+
+		OutLabels[CellIndex] = ComponentIndex;
+	}
+}
@@ -8,7 +8,7 @@
 
 struct FMassEntityHandle;
 
-DECLARE_DELEGATE_OneParam(FEntityActionSignature, const FMassEntityHandle& Entity)
+DECLARE_MULTICAST_DELEGATE_OneParam(FEntityActionSignature, const FMassEntityHandle& Entity)
 
 /**
  * Subsystem that notifies different modules about various actions over entities.
@@ -36,4 +36,10 @@ public:
 	static void ForEachGridCell(const FGridSizes& GridSizes, const TFunction<void(const FGridCellPosition&)>& Callback);
 	static void ForEachGridCell(const FGridBounds& GridBounds, const TFunction<void(const FGridCellPosition&)>& Callback);
 	static void ForEachGridCellOnPerimeter(const FGridCellPosition& CenterCell, int32 Offset, const TFunction<void(const FGridCellPosition&)>& Callback);
+
+	// Finds 4-connected groups of set cells with union-find in two linear passes (no hashing). Cells and Weights are indexed row
+	// by row inside Bounds (see FGridBounds::GetCellIndex()). OutLabels gets the component index of every cell, INDEX_NONE for
+	// the cells that are not set. Weights are optional and are summed per component.
+	static void LabelConnectedComponents(TArray<FGridConnectedComponent>& OutComponents, TArray<int32>& OutLabels, const FGridBounds& Bounds,
+		const TBitArray<>& Cells, TConstArrayView<int32> Weights = TConstArrayView<int32>());
 };
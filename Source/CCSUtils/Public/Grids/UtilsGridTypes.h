@@ -175,6 +175,27 @@ struct CCSUTILS_API FGridBounds
 		return abs((TopRightCell.X - BottomLeftCell.X + 1) * (TopRightCell.Y - BottomLeftCell.Y + 1));
 	}
 
+	int32 GetCols() const
+	{
+		return TopRightCell.X - BottomLeftCell.X + 1;
+	}
+
+	int32 GetRows() const
+	{
+		return TopRightCell.Y - BottomLeftCell.Y + 1;
+	}
+
+	// Index of the cell when the cells of the bounds are enumerated row by row. The cell has to be in bounds.
+	int32 GetCellIndex(const FGridCellPosition& CellPosition) const
+	{
+		return (CellPosition.Y - BottomLeftCell.Y) * GetCols() + (CellPosition.X - BottomLeftCell.X);
+	}
+
+	FGridCellPosition GetCellPositionAtIndex(const int32 CellIndex) const
+	{
+		return FGridCellPosition{BottomLeftCell.X + CellIndex % GetCols(), BottomLeftCell.Y + CellIndex / GetCols()};
+	}
+
 	int32 GetIntersectionArea(const FGridBounds& Other) const
 	{
 		int32 InterLeft = std::max(BottomLeftCell.X, Other.BottomLeftCell.X);
@@ -207,4 +228,13 @@ struct CCSUTILS_API FGridBounds
 		BottomLeftCell = BottomLeftCell - FGridCellPosition{2, 2};
 		TopRightCell   = TopRightCell + FGridCellPosition{2, 2};
 	}
+};
+
+
+// Group of 4-connected cells found by UGridUtilsFunctionLibrary::LabelConnectedComponents()
+struct CCSUTILS_API FGridConnectedComponent
+{
+	FGridBounds Bounds;
+	int32 CellsNum = 0;
+	int64 Weight   = 0;	// Sum of the weights of the component cells
 };
\ No newline at end of file
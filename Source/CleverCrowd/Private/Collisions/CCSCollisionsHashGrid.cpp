@@ -15,6 +15,20 @@ void FCCSCollisionsHashGrid::SearchForDenseAreas(TArray<FGridBounds>& OutDenseAr
 
 	PreSearchForDenseAreas();
 
+	// Dense cells of the counters are grouped in one labelling pass
+	if (!DenseCellsBits.IsEmpty())
+	{
+		TArray<FGridConnectedComponent> Components;
+		TArray<int32> Labels;
+		UGridUtilsFunctionLibrary::LabelConnectedComponents(Components, Labels, CountersBounds, DenseCellsBits, CellCounters);
+
+		for (int32 ComponentIndex = 0; ComponentIndex < Components.Num(); ComponentIndex++)
+		{
+			AddDenseAreasOfComponent(OutDenseAreas, Components[ComponentIndex], ComponentIndex, Labels);
+		}
+	}
+
+	// Dense cells outside of the counters are rare, they are still grouped with BFS
 	for (const FGridCellPosition& DenseCell : DenseCells)
 	{
 		if (VisitedDenseCells.Contains(DenseCell))
@@ -79,8 +93,28 @@ int32 FCCSCollisionsHashGrid::GetCollisionsCountAtLocation(const FVector& Locati
 	return GetCollisionsCountAtCell(UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(Location, CellSize));
 }
 
+void FCCSCollisionsHashGrid::ForEachCellWithCollisions(const TFunctionRef<void(const FGridCellPosition&, const int32)>& Callback) const
+{
+	for (int32 CounterIndex = 0; CounterIndex < CellCounters.Num(); CounterIndex++)
+	{
+		if (CellCounters[CounterIndex] > 0)
+		{
+			Callback(GetCounterCellPosition(CounterIndex), CellCounters[CounterIndex]);
+		}
+	}
+	for (const auto& [CellPosition, Count] : CollisionsInCells)
+	{
+		Callback(CellPosition, Count);
+	}
+}
+
 int32 FCCSCollisionsHashGrid::GetCollisionsCountAtCell(const FGridCellPosition& CellPosition)
 {
+	if (IsCellInCounters(CellPosition))
+	{
+		return CellCounters[GetCounterIndex(CellPosition)];
+	}
+	
 	const int32* CollisionsCount = CollisionsInCells.Find(CellPosition);
 	if(CollisionsCount)
 	{
@@ -97,18 +131,85 @@ void FCCSCollisionsHashGrid::AddCollisionsCountAtLocation(const FVector& Locatio
 
 void FCCSCollisionsHashGrid::AddCollisionsCountAtCell(const FGridCellPosition& CellPosition, const int32 AdditiveCollisions)
 {
-	if (!DataLock.TryLock())	// This makes this method non-reliable, but more performant
+	if (IsCellInCounters(CellPosition))
 	{
+		FPlatformAtomics::InterlockedAdd(&PendingCellCounters[GetCounterIndex(CellPosition)], AdditiveCollisions);
 		return;
 	}
 
+	// Cells outside of the counters bounds are rare, so the lock is not contended much
+	DataLock.Lock();
 	AddCollisionsCountAtCellNonSync(CellPosition, AdditiveCollisions);
+	DataLock.Unlock();
+}
+
+void FCCSCollisionsHashGrid::InitializeCellCounters(const FGridBounds& Bounds)
+{
+	const int32 Cols = Bounds.TopRightCell.X - Bounds.BottomLeftCell.X + 1;
+	const int32 Rows = Bounds.TopRightCell.Y - Bounds.BottomLeftCell.Y + 1;
+	if (Cols <= 0 || Rows <= 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Invalid bounds, collisions are counted under the lock."), __FUNCTION__);
+		return;
+	}
+
+	DataLock.Lock();
+	CountersBounds = Bounds;
+	CountersCols   = Cols;
+	CellCounters.SetNumZeroed(Cols * Rows);
+	PendingCellCounters.SetNumZeroed(Cols * Rows);
+	DenseCellsBits.Init(false, Cols * Rows);
 	
+	// Move cells that were counted before into the counters
+	for (auto It = CollisionsInCells.CreateIterator(); It; ++It)
+	{
+		if (Bounds.IsCellInBounds(It.Key()))
+		{
+			CellCounters[(It.Key().Y - Bounds.BottomLeftCell.Y) * Cols + (It.Key().X - Bounds.BottomLeftCell.X)] = It.Value();
+			DenseCells.Remove(It.Key());
+			It.RemoveCurrent();
+		}
+	}
+	bCellCountersUsed = true;
+	DataLock.Unlock();
+}
+
+void FCCSCollisionsHashGrid::MergePendingCollisions()
+{
+	if (!bCellCountersUsed)
+	{
+		return;
+	}
+	
+	DataLock.Lock();
+	const VectorRegister4Int MaxCount = VectorIntSet1(MaxCollisionsCount);
+	int32* Counters                   = CellCounters.GetData();
+	const int32* PendingCounters      = PendingCellCounters.GetData();
+	const int32 CountersNum           = CellCounters.Num();
+	
+	int32 CounterIndex = 0;
+	for (; CounterIndex + 4 <= CountersNum; CounterIndex += 4)
+	{
+		const VectorRegister4Int Sum = VectorIntAdd(VectorIntLoad(Counters + CounterIndex), VectorIntLoad(PendingCounters + CounterIndex));
+		VectorIntStore(VectorIntMin(VectorIntMax(Sum, GlobalVectorConstants::IntZero), MaxCount), Counters + CounterIndex);
+	}
+	for (; CounterIndex < CountersNum; CounterIndex++)
+	{
+		Counters[CounterIndex] = FMath::Clamp(Counters[CounterIndex] + PendingCounters[CounterIndex], 0, MaxCollisionsCount);
+	}
+	FMemory::Memzero(PendingCellCounters.GetData(), PendingCellCounters.Num() * sizeof(int32));
 	DataLock.Unlock();
 }
 
 void FCCSCollisionsHashGrid::AddCollisionsCountAtCellNonSync(const FGridCellPosition& CellPosition, const int32 AdditiveCollisions)
 {
+	if (IsCellInCounters(CellPosition))
+	{
+		int32& CollisionsCount = CellCounters[GetCounterIndex(CellPosition)];
+		CollisionsCount = FMath::Clamp(CollisionsCount + AdditiveCollisions, 0, MaxCollisionsCount);
+		return;
+	}
+	
 	int32& CollisionsCount = CollisionsInCells.FindOrAdd(CellPosition);
 	CollisionsCount = FMath::Clamp(CollisionsCount + AdditiveCollisions, 0, MaxCollisionsCount);
 
@@ -125,10 +226,36 @@ void FCCSCollisionsHashGrid::AddCollisionsCountAtCellNonSync(const FGridCellPosi
 void FCCSCollisionsHashGrid::DecrementCollisionsCountAtAllCells()
 {
 	DataLock.Lock();
-	for (auto& [CellPosition, Count] : CollisionsInCells)
+	
+	const VectorRegister4Int Decrement = VectorIntSet1(DecrementCollisionsCountMag);
+	int32* Counters                    = CellCounters.GetData();
+	const int32 CountersNum            = CellCounters.Num();
+	
+	int32 CounterIndex = 0;
+	for (; CounterIndex + 4 <= CountersNum; CounterIndex += 4)
 	{
-		AddCollisionsCountAtCellNonSync(CellPosition, -DecrementCollisionsCountMag);
+		const VectorRegister4Int Decremented = VectorIntSubtract(VectorIntLoad(Counters + CounterIndex), Decrement);
+		VectorIntStore(VectorIntMax(Decremented, GlobalVectorConstants::IntZero), Counters + CounterIndex);
 	}
+	for (; CounterIndex < CountersNum; CounterIndex++)
+	{
+		Counters[CounterIndex] = FMath::Max(Counters[CounterIndex] - DecrementCollisionsCountMag, 0);
+	}
+
+	// Cells outside of the counters bounds are compacted away when they have no collisions left
+	for (auto It = CollisionsInCells.CreateIterator(); It; ++It)
+	{
+		It.Value() = FMath::Clamp(It.Value() - DecrementCollisionsCountMag, 0, MaxCollisionsCount);
+		if (It.Value() < DenseCellCollisionsCountThreshold)
+		{
+			DenseCells.Remove(It.Key());
+		}
+		if (It.Value() == 0)
+		{
+			It.RemoveCurrent();
+		}
+	}
+	
 	DataLock.Unlock();
 }
 
@@ -148,4 +275,62 @@ void FCCSCollisionsHashGrid::DrawDebugDenseAreas(const UWorld* World, const floa
 void FCCSCollisionsHashGrid::PreSearchForDenseAreas()
 {
 	VisitedDenseCells.Reset();
+
+	// Dense cells of the counters are derived only here, so counting and decrementing don't maintain them
+	DenseCellsBits.Init(false, CellCounters.Num());
+	for (int32 CounterIndex = 0; CounterIndex < CellCounters.Num(); CounterIndex++)
+	{
+		DenseCellsBits[CounterIndex] = (CellCounters[CounterIndex] >= DenseCellCollisionsCountThreshold);
+	}
+}
+
+void FCCSCollisionsHashGrid::AddDenseAreasOfComponent(TArray<FGridBounds>& OutDenseAreas, const FGridConnectedComponent& Component,
+	const int32 ComponentIndex, const TArray<int32>& Labels) const
+{
+	if (Component.Bounds.GetArea() < MinDenseAreaSize)
+	{
+		return;
+	}
+	if (Component.Bounds.GetArea() <= MaxDenseAreaSize)
+	{
+		OutDenseAreas.Add(Component.Bounds);
+		return;
+	}
+
+	// Too big component is split into square tiles, each tile is shrunk to the cells of the component inside it
+	const int32 TileSize = FMath::Max(1, FMath::FloorToInt32(FMath::Sqrt(static_cast<float>(MaxDenseAreaSize))));
+	for (int32 TileY = Component.Bounds.BottomLeftCell.Y; TileY <= Component.Bounds.TopRightCell.Y; TileY += TileSize)
+	{
+		for (int32 TileX = Component.Bounds.BottomLeftCell.X; TileX <= Component.Bounds.TopRightCell.X; TileX += TileSize)
+		{
+			const int32 TileTopX = FMath::Min(TileX + TileSize - 1, Component.Bounds.TopRightCell.X);
+			const int32 TileTopY = FMath::Min(TileY + TileSize - 1, Component.Bounds.TopRightCell.Y);
+			
+			TOptional<FGridBounds> TileAreaBounds;
+			for (int32 Y = TileY; Y <= TileTopY; Y++)
+			{
+				for (int32 X = TileX; X <= TileTopX; X++)
+				{
+					const FGridCellPosition CellPosition{X, Y};
+					if (Labels[GetCounterIndex(CellPosition)] != ComponentIndex)
+					{
+						continue;
+					}
+					if (!TileAreaBounds.IsSet())
+					{
+						TileAreaBounds = FGridBounds{CellPosition, CellPosition};
+					}
+					TileAreaBounds->BottomLeftCell.X = FMath::Min(TileAreaBounds->BottomLeftCell.X, X);
+					TileAreaBounds->BottomLeftCell.Y = FMath::Min(TileAreaBounds->BottomLeftCell.Y, Y);
+					TileAreaBounds->TopRightCell.X   = FMath::Max(TileAreaBounds->TopRightCell.X, X);
+					TileAreaBounds->TopRightCell.Y   = FMath::Max(TileAreaBounds->TopRightCell.Y, Y);
+				}
+			}
+			
+			if (TileAreaBounds.IsSet() && TileAreaBounds->GetArea() >= MinDenseAreaSize)
+			{
+				OutDenseAreas.Add(TileAreaBounds.GetValue());
+			}
+		}
+	}
 }
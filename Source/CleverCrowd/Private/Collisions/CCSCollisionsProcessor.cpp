@@ -6,13 +6,18 @@
 #include "MassExecutionContext.h"
 #include "MassCommonFragments.h"
 #include "MassCommonTypes.h"
+#include "Async/ParallelFor.h"
 #include "Collisions/CollisionsFragments.h"
 #include "Collisions/Obstacles/CCSObstaclesHashGrid.h"
+#include "Collisions/Obstacles/CCSObstaclesDistanceField.h"
 #include "Common/Clusters/CrowdClusterTypes.h"
+#include "Grids/GridUtilsFunctionLibrary.h"
 #include "HashGrid/CCSEntitiesHashGrid.h"
+#include "HashGrid/CCSEntitiesHashGridProcessor.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Management/CCSCollisionsSubsystem.h"
 #include "Management/CCSEntitiesManagerSubsystem.h"
+#include "Global/CleverCrowdGlobals.h"
 #include "Global/CrowdStatisticsSubsystem.h"
 
 UCCSCollisionsProcessor::UCCSCollisionsProcessor()
@@ -20,6 +25,7 @@ UCCSCollisionsProcessor::UCCSCollisionsProcessor()
 	bAutoRegisterWithProcessingPhases = true;
 	ExecutionFlags = (int32)EProcessorExecutionFlags::All;
 	ExecutionOrder.ExecuteBefore.Add(UE::Mass::ProcessorGroupNames::Avoidance);
+	ExecutionOrder.ExecuteAfter.Add(UCCSEntitiesHashGridProcessor::StaticClass()->GetFName());	// To work with the fresh hash grid snapshot
 	bRequiresGameThreadExecution = true;
 }
 
@@ -40,14 +46,17 @@ void UCCSCollisionsProcessor::Initialize(UObject& Owner)
 	EntitiesHashGrid         = GetWorld()->GetSubsystem<UCCSEntitiesManagerSubsystem>()->GetEntitiesHashGrid();
 	CollisionsSubsystem      = GetWorld()->GetSubsystem<UCCSCollisionsSubsystem>();
 	CrowdStatisticsSubsystem = GetWorld()->GetSubsystem<UCrowdStatisticsSubsystem>();
+	EntitiesManagerSubsystem = GetWorld()->GetSubsystem<UCCSEntitiesManagerSubsystem>();
 }
 
 void UCCSCollisionsProcessor::Execute(FMassEntityManager& EntityManager, FMassExecutionContext& Context)
 {
-	constexpr int ClusterSize = 2;
-	constexpr float MinCollisionCountRateForEntity = 2.f;
 	float CurrentTime = GetWorld()->GetTimeSeconds();
 
+	bSkipObstaclesForOrcaAgents = UE::CleverCrowd::Globals::bSkipObstacleCollisionsForOrcaAgents && (EntitiesManagerSubsystem->AvoidanceType == 2);
+
+	// Collisions counted during the previous tick (here and in avoidance)
+	CollisionsSubsystem->GetCollisionsHashGrid().MergePendingCollisions();
 	
 	EntityQuery.ForEachEntityChunk(EntityManager, Context, [&, this](FMassExecutionContext& Context)
 	{
@@ -64,6 +73,20 @@ void UCCSCollisionsProcessor::Execute(FMassEntityManager& EntityManager, FMassEx
 		}
 	});
 
+	if (EntitiesHashGrid->HasSnapshot())
+	{
+		ResolveCollisionsWithSnapshot(EntityManager, CurrentTime);
+		ResolveCollisionsOutsideSnapshot(EntityManager, CurrentTime);
+	}
+	else
+	{
+		ResolveCollisionsWithHandles(EntityManager, CurrentTime);
+	}
+}
+
+void UCCSCollisionsProcessor::ResolveCollisionsWithHandles(FMassEntityManager& EntityManager, const float CurrentTime)
+{
+	constexpr int ClusterSize = 2;
 	
 	EntitiesHashGrid->ParallelForEachNonEmptyCell([this, &EntityManager, CurrentTime](const FGridCellPosition& Cell)
 	{
@@ -71,70 +94,246 @@ void UCCSCollisionsProcessor::Execute(FMassEntityManager& EntityManager, FMassEx
 		FGridBounds Bounds{Cell, Cell + FGridCellPosition{ClusterSize - 1, ClusterSize - 1}};
 		EntitiesHashGrid->GetEntitiesInBounds(Entities, Bounds);	// Getting entities from 4 adjacent grid cells
 		
-		const int32 EntitiesNum = Entities.Num();
-		for (int32 EntityIndex = 0; EntityIndex < EntitiesNum; ++EntityIndex)
+		for (const FMassEntityHandle& Entity : Entities)
 		{
-			if (!EntityManager.IsEntityValid(Entities[EntityIndex]))
-			{
-				continue;
-			}
-			
-			FTransform& Transform                 = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entities[EntityIndex]).GetMutableTransform();
-			const float Radius                    = EntityManager.GetFragmentDataChecked<FAgentRadiusFragment>(Entities[EntityIndex]).Radius;
-			FCollisionFragment& CollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entities[EntityIndex]);
-			FClusterFragment& ClusterFragment     = EntityManager.GetFragmentDataChecked<FClusterFragment>(Entities[EntityIndex]);
-			const FVector& Location               = Transform.GetLocation();
-			bool bCollided                        = false;
-
-			FEntityProxyData EntityData {
-				Transform, Location, Radius, CollisionFragment
-			};
-
-			for (int32 OtherEntityIndex = 0; OtherEntityIndex < EntitiesNum; ++OtherEntityIndex)
-			{
-				if (!EntityManager.IsEntityValid(Entities[OtherEntityIndex]) || Entities[EntityIndex] == Entities[OtherEntityIndex])
-				{
-					continue;
-				}
-				
-				FTransform& OtherTransform   = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entities[OtherEntityIndex]).GetMutableTransform();
-				const float OtherRadius      = EntityManager.GetFragmentDataChecked<FAgentRadiusFragment>(Entities[OtherEntityIndex]).Radius;
-				FCollisionFragment& OtherCollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entities[OtherEntityIndex]);
-				const FVector& OtherLocation = OtherTransform.GetLocation();
-				FVector OtherLocation2D      = FVector{OtherLocation.X, OtherLocation.Y, 0.f};
-
-				FEntityProxyData OtherEntityData {
-					OtherTransform, OtherLocation, OtherRadius, OtherCollisionFragment
-				};
-
-				bool bLocalCollisionOccured = false;
-				ResolveTwoAgentsCollisions(bLocalCollisionOccured, EntityData, OtherEntityData);
-				bCollided = bCollided || bLocalCollisionOccured;
-
-				if (bLocalCollisionOccured)
-				{
-					CollisionFragment.bCollidedAtPreviousTick      = true;
-					OtherCollisionFragment.bCollidedAtPreviousTick = true;
-				}
-			}
+			ResolveEntityCollisionsWithHandles(EntityManager, Entity, Entities, CurrentTime);
+		}
+	});
+}
+
+void UCCSCollisionsProcessor::ResolveCollisionsOutsideSnapshot(FMassEntityManager& EntityManager, const float CurrentTime)
+{
+	EntitiesHashGrid->DataLock.Lock();
+	
+	const TConstArrayView<FMassEntityHandle> EntitiesOutsideSnapshot = EntitiesHashGrid->GetEntitiesOutsideSnapshot();
+	ParallelFor(EntitiesOutsideSnapshot.Num(), [this, &EntityManager, &EntitiesOutsideSnapshot, CurrentTime](const int32 Index)
+	{
+		const FMassEntityHandle Entity = EntitiesOutsideSnapshot[Index];
+		if (!EntityManager.IsEntityValid(Entity))
+		{
+			return;
+		}
+		
+		// Entities from the cell of the entity and its 8 neighbours, both sparse and dense
+		const FVector& Location      = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entity).GetTransform().GetLocation();
+		const FGridCellPosition Cell = UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(Location, EntitiesHashGrid->GetCellSize());
+		TArray<FMassEntityHandle> Neighbours;
+		EntitiesHashGrid->GetEntitiesInBounds(Neighbours, FGridBounds{Cell - FGridCellPosition{1, 1}, Cell + FGridCellPosition{1, 1}});
+		ResolveEntityCollisionsWithHandles(EntityManager, Entity, Neighbours, CurrentTime);
+	});
+
+	EntitiesHashGrid->DataLock.Unlock();
+}
+
+void UCCSCollisionsProcessor::ResolveEntityCollisionsWithHandles(FMassEntityManager& EntityManager, const FMassEntityHandle& Entity, TConstArrayView<FMassEntityHandle> Neighbours,
+                                                                 const float CurrentTime)
+{
+	if (!EntityManager.IsEntityValid(Entity))
+	{
+		return;
+	}
+	
+	FTransform& Transform                 = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entity).GetMutableTransform();
+	const float Radius                    = EntityManager.GetFragmentDataChecked<FAgentRadiusFragment>(Entity).Radius;
+	FCollisionFragment& CollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entity);
+	FClusterFragment& ClusterFragment     = EntityManager.GetFragmentDataChecked<FClusterFragment>(Entity);
+	const FVector& Location               = Transform.GetLocation();
+	bool bCollided                        = false;
+
+	FEntityProxyData EntityData {
+		Transform, Location, Radius, CollisionFragment
+	};
+
+	for (const FMassEntityHandle& OtherEntity : Neighbours)
+	{
+		if (!EntityManager.IsEntityValid(OtherEntity) || Entity == OtherEntity)
+		{
+			continue;
+		}
+		
+		FTransform& OtherTransform   = EntityManager.GetFragmentDataChecked<FTransformFragment>(OtherEntity).GetMutableTransform();
+		const float OtherRadius      = EntityManager.GetFragmentDataChecked<FAgentRadiusFragment>(OtherEntity).Radius;
+		FCollisionFragment& OtherCollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(OtherEntity);
+		const FVector& OtherLocation = OtherTransform.GetLocation();
 
-			if (bCollided)
+		FEntityProxyData OtherEntityData {
+			OtherTransform, OtherLocation, OtherRadius, OtherCollisionFragment
+		};
+
+		bool bLocalCollisionOccured = false;
+		ResolveTwoAgentsCollisions(bLocalCollisionOccured, EntityData, OtherEntityData);
+		bCollided = bCollided || bLocalCollisionOccured;
+
+		if (bLocalCollisionOccured)
+		{
+			CollisionFragment.bCollidedAtPreviousTick      = true;
+			OtherCollisionFragment.bCollidedAtPreviousTick = true;
+		}
+	}
+
+	if (bCollided)
+	{
+		CountCollision(CollisionFragment, ClusterFragment, Location, CurrentTime);
+	}
+	
+	ResolveAgentCollisionsWithObstacles(EntityData);
+}
+
+void UCCSCollisionsProcessor::ResolveCollisionsWithSnapshot(FMassEntityManager& EntityManager, const float CurrentTime)
+{
+	EntitiesHashGrid->DataLock.Lock();
+	
+	const FCCSEntitiesSnapshot& Snapshot                      = EntitiesHashGrid->GetSnapshot();
+	const TConstArrayView<FMassEntityHandle> SnapshotEntities = EntitiesHashGrid->GetSnapshotEntities();
+	CollisionResults.Reset();
+	CollisionResults.SetNumZeroed(Snapshot.Num());
+
+	// Every pair of entities is resolved once and pushes both entities apart. Only contiguous snapshot data is read.
+	EntitiesHashGrid->ParallelForEachSnapshotPairRange([this, &Snapshot](const int32 Slot, const FCCSDenseSlotsRange& OtherSlots)
+	{
+		ResolveAgentCollisionsInSnapshotBatch(CollisionResults, Snapshot, Slot, OtherSlots);
+	});
+
+	// Scatter results back into fragments. Every entity has one home slot, so there are no concurrent writes into the same entity.
+	ParallelFor(Snapshot.Num(), [this, &EntityManager, &Snapshot, &SnapshotEntities, CurrentTime](const int32 Slot)
+	{
+		const FMassEntityHandle Entity = SnapshotEntities[Slot];
+		if (!Snapshot.bHomeCell[Slot] || !EntityManager.IsEntityValid(Entity))
+		{
+			return;
+		}
+		
+		FTransform& Transform                 = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entity).GetMutableTransform();
+		FCollisionFragment& CollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entity);
+		const FCollisionResult& Result        = CollisionResults[Slot];
+		
+		if (Result.bCollided)
+		{
+			Transform.SetLocation(Transform.GetLocation() + FVector{Result.Displacement.X, Result.Displacement.Y, 0.f});
+			CollisionFragment.bCollidedAtPreviousTick      = true;
+			CollisionFragment.StrongCollisionsCounterMeta += Result.StrongCollisions;
+			CollisionFragment.WeakCollisionsCounterMeta   += Result.WeakCollisions;
+			CountCollision(CollisionFragment, EntityManager.GetFragmentDataChecked<FClusterFragment>(Entity), Transform.GetLocation(), CurrentTime);
+		}
+
+		const FVector& Location = Transform.GetLocation();
+		FEntityProxyData EntityData {
+			Transform, Location, Snapshot.Radius[Slot], CollisionFragment
+		};
+		ResolveAgentCollisionsWithObstacles(EntityData);
+	});
+
+	EntitiesHashGrid->DataLock.Unlock();
+}
+
+void UCCSCollisionsProcessor::ResolveAgentCollisionsInSnapshotBatch(TArrayView<FCollisionResult> Results, const FCCSEntitiesSnapshot& Snapshot, const int32 Slot, const FCCSDenseSlotsRange& OtherSlots)
+{
+	constexpr int32 BatchSize = 4;	// Entities in one VectorRegister4Float
+	
+	const VectorRegister4Float X      = VectorSetFloat1(Snapshot.X[Slot]);
+	const VectorRegister4Float Y      = VectorSetFloat1(Snapshot.Y[Slot]);
+	const VectorRegister4Float Radius = VectorSetFloat1(Snapshot.Radius[Slot]);
+	const VectorRegister4Float Half   = VectorSetFloat1(0.5f);
+
+	int32 OtherSlot = OtherSlots.Start;
+	for (; OtherSlot + BatchSize <= OtherSlots.End; OtherSlot += BatchSize)
+	{
+		// Same operations as in ResolveTwoAgentsCollisionsInSnapshot() (no FMA), so results are equal to the scalar path
+		const VectorRegister4Float ToOtherX = VectorSubtract(VectorLoad(&Snapshot.X[OtherSlot]), X);
+		const VectorRegister4Float ToOtherY = VectorSubtract(VectorLoad(&Snapshot.Y[OtherSlot]), Y);
+		const VectorRegister4Float Distance = VectorSqrt(VectorAdd(VectorMultiply(ToOtherX, ToOtherX), VectorMultiply(ToOtherY, ToOtherY)));
+		const VectorRegister4Float CollisionResolveDistance = VectorMultiply(VectorSubtract(VectorAdd(Radius, VectorLoad(&Snapshot.Radius[OtherSlot])), Distance), Half);
+
+		const int32 CollidedMask = VectorMaskBits(VectorCompareGT(CollisionResolveDistance, VectorZeroFloat()));
+		if (CollidedMask == 0)
+		{
+			continue;
+		}
+
+		// Collisions are rare compared to checked pairs, so collided entities are applied one by one
+		alignas(16) float ToOtherXLanes[BatchSize];
+		alignas(16) float ToOtherYLanes[BatchSize];
+		alignas(16) float DistanceLanes[BatchSize];
+		alignas(16) float CollisionResolveDistanceLanes[BatchSize];
+		VectorStoreAligned(ToOtherX, ToOtherXLanes);
+		VectorStoreAligned(ToOtherY, ToOtherYLanes);
+		VectorStoreAligned(Distance, DistanceLanes);
+		VectorStoreAligned(CollisionResolveDistance, CollisionResolveDistanceLanes);
+		for (int32 Lane = 0; Lane < BatchSize; Lane++)
+		{
+			if (CollidedMask & (1 << Lane))
 			{
-				if (CurrentTime - CollisionFragment.LastCollisionCountTime > MinCollisionCountRateForEntity)
-				{
-					CrowdStatisticsSubsystem->Stats.CollisionsInClusters[ClusterFragment.ClusterType] += 1;
-					if (ClusterFragment.AreaId > INDEX_NONE)
-					{
-						CrowdStatisticsSubsystem->Stats.CollisionsInAreas[ClusterFragment.AreaId] += 1;
-					}
-					CollisionFragment.LastCollisionCountTime = CurrentTime;
-					TryIncreaseCollisionsCount(bCollided, Location);
-				}
+				ApplyTwoAgentsCollision(Results[Slot], Results[OtherSlot + Lane], FVector2f{ToOtherXLanes[Lane], ToOtherYLanes[Lane]}, DistanceLanes[Lane], CollisionResolveDistanceLanes[Lane],
+				                        Slot, OtherSlot + Lane);
 			}
-			
-			ResolveAgentCollisionsWithObstacles(EntityData);
 		}
-	});
+	}
+
+	// Remainder of the range
+	for (; OtherSlot < OtherSlots.End; OtherSlot++)
+	{
+		ResolveTwoAgentsCollisionsInSnapshot(Results[Slot], Results[OtherSlot], Snapshot, Slot, OtherSlot);
+	}
+}
+
+void UCCSCollisionsProcessor::ResolveTwoAgentsCollisionsInSnapshot(FCollisionResult& Result, FCollisionResult& OtherResult, const FCCSEntitiesSnapshot& Snapshot, const int32 Slot, const int32 OtherSlot)
+{
+	const FVector2f ToOther{Snapshot.X[OtherSlot] - Snapshot.X[Slot], Snapshot.Y[OtherSlot] - Snapshot.Y[Slot]};
+	const float Distance = FMath::Sqrt(ToOther.X * ToOther.X + ToOther.Y * ToOther.Y);
+	
+	const float CollisionResolveDistance = ((Snapshot.Radius[Slot] + Snapshot.Radius[OtherSlot]) - Distance) * 0.5f;
+	if (CollisionResolveDistance > 0.f)
+	{
+		ApplyTwoAgentsCollision(Result, OtherResult, ToOther, Distance, CollisionResolveDistance, Slot, OtherSlot);
+	}
+}
+
+void UCCSCollisionsProcessor::ApplyTwoAgentsCollision(FCollisionResult& Result, FCollisionResult& OtherResult, const FVector2f& ToOther, const float Distance, const float CollisionResolveDistance,
+                                                      const int32 Slot, const int32 OtherSlot)
+{
+	Result.bCollided      = true;
+	OtherResult.bCollided = true;
+	if (Distance == 0.f)
+	{
+		// Coincident agents are split in a direction seeded by the pair, so results don't depend on the threads that processed it
+		FRandomStream RandomStream{static_cast<int32>(HashCombine(GetTypeHash(Slot), GetTypeHash(OtherSlot)))};
+		FVector2f Offset;
+		FMath::SinCos(&Offset.Y, &Offset.X, RandomStream.FRand() * UE_TWO_PI);
+		Result.Displacement      += Offset;
+		OtherResult.Displacement -= Offset;
+		return;
+	}
+
+	const FVector2f Displacement = ToOther / Distance * CollisionResolveDistance;
+	Result.Displacement      -= Displacement;
+	OtherResult.Displacement += Displacement;
+	if (CollisionResolveDistance > 5.f)	// Count the collision if penetration was big enough
+	{
+		Result.StrongCollisions      += 1;
+		OtherResult.StrongCollisions += 1;
+	}
+	else if (CollisionResolveDistance > 3.3f)
+	{
+		Result.WeakCollisions      += 1;
+		OtherResult.WeakCollisions += 1;
+	}
+}
+
+void UCCSCollisionsProcessor::CountCollision(FCollisionFragment& CollisionFragment, const FClusterFragment& ClusterFragment, const FVector& Location, const float CurrentTime)
+{
+	constexpr float MinCollisionCountRateForEntity = 2.f;
+	if (CurrentTime - CollisionFragment.LastCollisionCountTime <= MinCollisionCountRateForEntity)
+	{
+		return;
+	}
+	
+	CrowdStatisticsSubsystem->Stats.CollisionsInClusters[ClusterFragment.ClusterType] += 1;
+	if (ClusterFragment.AreaId > INDEX_NONE)
+	{
+		CrowdStatisticsSubsystem->Stats.CollisionsInAreas[ClusterFragment.AreaId] += 1;
+	}
+	CollisionFragment.LastCollisionCountTime = CurrentTime;
+	TryIncreaseCollisionsCount(true, Location);
 }
 
 void UCCSCollisionsProcessor::ResolveTwoAgentsCollisions(bool& bOutCollisionOccured, FEntityProxyData& EntityData, FEntityProxyData& OtherEntityData)
@@ -174,27 +373,44 @@ void UCCSCollisionsProcessor::ResolveTwoAgentsCollisions(bool& bOutCollisionOccu
 
 void UCCSCollisionsProcessor::ResolveAgentCollisionsWithObstacles(FEntityProxyData& EntityData)
 {
-	TArray<FCCSObstacleEdge> ObstacleEdges;	// All nearby obstacle edges
-	CollisionsSubsystem->GetObstaclesHashGrid()->GetObstacleEdgesAtLocation(ObstacleEdges, EntityData.Location, EntityData.Radius);
+	if (bSkipObstaclesForOrcaAgents && EntityData.CollisionFragment.OrcaIndex != INDEX_NONE)
+	{
+		return;
+	}
+	
+	const FCCSObstaclesDistanceField& DistanceField = CollisionsSubsystem->GetObstaclesDistanceField();
+	const bool bUseDistanceField                    = UE::CleverCrowd::Globals::bUseObstaclesDistanceField && DistanceField.IsBuilt();
+	
+	const FVector2f PushOut = bUseDistanceField
+		? DistanceField.GetPushOut(FVector2f{static_cast<float>(EntityData.Location.X), static_cast<float>(EntityData.Location.Y)}, EntityData.Radius)
+		: GetObstaclesPushOutWithEdges(*CollisionsSubsystem->GetObstaclesHashGrid(), EntityData.Location, EntityData.Radius);
+	if (!PushOut.IsZero())
+	{
+		EntityData.Transform.SetLocation(EntityData.Location + FVector{PushOut.X, PushOut.Y, 0.f});
+	}
+}
+
+FVector2f UCCSCollisionsProcessor::GetObstaclesPushOutWithEdges(const UCCSObstaclesHashGrid& ObstaclesHashGrid, const FVector& Location, const float Radius)
+{
+	UCCSObstaclesHashGrid::FEdgeIdsBuffer EdgeIdsBuffer;
+	const TConstArrayView<int32> EdgeIds = ObstaclesHashGrid.GetBakedEdgeIdsAtLocation(EdgeIdsBuffer, Location, Radius);	// All nearby obstacle edges
 
-	for (const FCCSObstacleEdge& Edge : ObstacleEdges)
+	FVector2f PushOut = FVector2f::ZeroVector;
+	for (const int32 EdgeId : EdgeIds)
 	{
-		FVector EdgeStart = FVector{Edge.Start.X, Edge.Start.Y, EntityData.Location.Z};
-		FVector EdgeEnd   = FVector{Edge.End.X, Edge.End.Y, EntityData.Location.Z};
+		const FCCSBakedObstacleEdge& Edge = ObstaclesHashGrid.GetBakedEdge(EdgeId);
+		FVector EdgeStart = FVector{Edge.Start.X, Edge.Start.Y, Location.Z};
+		FVector EdgeEnd   = FVector{Edge.End.X, Edge.End.Y, Location.Z};
 
-		const FVector ClosestPointOnEdge = FMath::ClosestPointOnSegment(EntityData.Location, EdgeStart, EdgeEnd);
-		const float DistanceToEdge       = FVector::Distance(EntityData.Location, ClosestPointOnEdge);
+		const FVector ClosestPointOnEdge = FMath::ClosestPointOnSegment(Location, EdgeStart, EdgeEnd);
+		const float DistanceToEdge       = FVector::Distance(Location, ClosestPointOnEdge);
 
-		if (DistanceToEdge < EntityData.Radius)
+		if (DistanceToEdge < Radius)
 		{
-			const float ResolveDistance      = EntityData.Radius - DistanceToEdge;
-			const FVector ResolveDirection   = Edge.LeftDir;
-			const FVector ResolveTranslation = ResolveDistance * ResolveDirection;
-
-			const FVector NewLocation = EntityData.Location + FVector{ResolveTranslation.X, ResolveTranslation.Y, 0.f};
-			EntityData.Transform.SetLocation(NewLocation);
+			PushOut = (Radius - DistanceToEdge) * Edge.LeftDir;	// The last touched edge wins, all of them push from the same location
 		}
 	}
+	return PushOut;
 }
 
 
@@ -208,6 +424,125 @@ void UCCSCollisionsProcessor::TryIncreaseCollisionsCount(bool bCollisionOccured,
 }
 
 
+// BENCHMARK ------
+
+void UCCSCollisionsProcessor::BenchmarkSnapshotKernels(const TArray<int32>& AgentsNums, const int32 Iterations)
+{
+	constexpr float AgentRadius  = 35.f;
+	constexpr float AreaPerAgent = 70.f * 70.f;	// Dense crowd, so many agents overlap
+	constexpr int32 RandomSeed   = 1337;
+
+	for (const int32 AgentsNum : AgentsNums)
+	{
+		// Synthetic crowd in a standalone hash grid
+		UCCSEntitiesHashGrid* HashGrid = NewObject<UCCSEntitiesHashGrid>();
+		const float Side               = FMath::Sqrt(AgentsNum * AreaPerAgent);
+		const int32 CellsPerSide       = FMath::CeilToInt32(Side / HashGrid->GetCellSize()) + 1;
+		HashGrid->InitializeDenseStorage(FGridBounds{FGridCellPosition{-1, -1}, FGridCellPosition{CellsPerSide, CellsPerSide}});
+
+		FRandomStream RandomStream(RandomSeed);
+		HashGrid->BeginParallelStaging(AgentsNum);
+		HashGrid->ClaimStagedEntities(AgentsNum);
+		for (int32 AgentIndex = 0; AgentIndex < AgentsNum; AgentIndex++)
+		{
+			const FVector Location{RandomStream.FRandRange(0.f, Side), RandomStream.FRandRange(0.f, Side), 0.f};
+			FCCSEntitySnapshotData SnapshotData;
+			SnapshotData.Location = FVector2f{static_cast<float>(Location.X), static_cast<float>(Location.Y)};
+			SnapshotData.Radius   = AgentRadius;
+			HashGrid->SetStagedEntity(AgentIndex, FMassEntityHandle{AgentIndex, 1}, HashGrid->GetCellsInRadius(Location, AgentRadius), SnapshotData);
+		}
+		HashGrid->EndParallelStaging();
+		HashGrid->CommitDenseStorage();
+
+		const FCCSEntitiesSnapshot& Snapshot = HashGrid->GetSnapshot();
+		TArray<FCollisionResult> ScalarResults;
+		TArray<FCollisionResult> BatchResults;
+		
+		double ScalarTime = 0.0;
+		double BatchTime  = 0.0;
+		for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+		{
+			ScalarResults.Reset();
+			ScalarResults.SetNumZeroed(Snapshot.Num());
+			double StartTime = FPlatformTime::Seconds();
+			HashGrid->ParallelForEachSnapshotPair([&ScalarResults, &Snapshot](const int32 Slot, const int32 OtherSlot)
+			{
+				ResolveTwoAgentsCollisionsInSnapshot(ScalarResults[Slot], ScalarResults[OtherSlot], Snapshot, Slot, OtherSlot);
+			});
+			ScalarTime += FPlatformTime::Seconds() - StartTime;
+
+			BatchResults.Reset();
+			BatchResults.SetNumZeroed(Snapshot.Num());
+			StartTime = FPlatformTime::Seconds();
+			HashGrid->ParallelForEachSnapshotPairRange([&BatchResults, &Snapshot](const int32 Slot, const FCCSDenseSlotsRange& OtherSlots)
+			{
+				ResolveAgentCollisionsInSnapshotBatch(BatchResults, Snapshot, Slot, OtherSlots);
+			});
+			BatchTime += FPlatformTime::Seconds() - StartTime;
+		}
+
+		// Both kernels have to give the same results
+		int32 MismatchesNum = 0;
+		for (int32 Slot = 0; Slot < Snapshot.Num(); Slot++)
+		{
+			const FCollisionResult& ScalarResult = ScalarResults[Slot];
+			const FCollisionResult& BatchResult  = BatchResults[Slot];
+			if (ScalarResult.Displacement != BatchResult.Displacement || ScalarResult.bCollided != BatchResult.bCollided
+				|| ScalarResult.StrongCollisions != BatchResult.StrongCollisions || ScalarResult.WeakCollisions != BatchResult.WeakCollisions)
+			{
+				MismatchesNum++;
+			}
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("[%hs] Agents: %d, scalar: %.3f ms, batch: %.3f ms, speedup: %.2fx, mismatches: %d"), __FUNCTION__,
+			AgentsNum, ScalarTime * 1000.0 / Iterations, BatchTime * 1000.0 / Iterations, ScalarTime / FMath::Max(BatchTime, UE_DOUBLE_SMALL_NUMBER), MismatchesNum);
+		HashGrid->MarkAsGarbage();
+	}
+}
+
+
+void UCCSCollisionsProcessor::CompareObstacleCollisionBackends(const UCCSCollisionsSubsystem& InCollisionsSubsystem, const int32 SamplesNum)
+{
+	constexpr float AgentRadius = 35.f;
+	constexpr float MaxOffset   = AgentRadius * 1.5f;	// Samples are taken on both sides of edges, some of them don't touch obstacles
+	constexpr float Tolerance   = 1.f;
+	constexpr int32 RandomSeed  = 1337;
+
+	const UCCSObstaclesHashGrid* ObstaclesHashGrid  = InCollisionsSubsystem.GetObstaclesHashGrid();
+	const FCCSObstaclesDistanceField& DistanceField = InCollisionsSubsystem.GetObstaclesDistanceField();
+	if (!ObstaclesHashGrid || !ObstaclesHashGrid->IsEdgesIndexBaked() || !DistanceField.IsBuilt())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Obstacles edges index or distance field is not built."), __FUNCTION__);
+		return;
+	}
+
+	const TConstArrayView<FCCSBakedObstacleEdge> Edges = ObstaclesHashGrid->GetBakedEdges();
+	FRandomStream RandomStream(RandomSeed);
+	int32 ContactMismatchesNum = 0;
+	int32 PushOutMismatchesNum = 0;
+	float MaxDifference        = 0.f;
+	double DifferencesSum      = 0.0;
+	
+	for (int32 SampleIndex = 0; SampleIndex < SamplesNum; SampleIndex++)
+	{
+		const FCCSBakedObstacleEdge& Edge = Edges[RandomStream.RandHelper(Edges.Num())];
+		const FVector2f Location          = FMath::Lerp(Edge.Start, Edge.End, RandomStream.FRand()) + Edge.LeftDir * RandomStream.FRandRange(-MaxOffset, MaxOffset);
+
+		const FVector2f EdgesPushOut = GetObstaclesPushOutWithEdges(*ObstaclesHashGrid, FVector{Location.X, Location.Y, 0.f}, AgentRadius);
+		const FVector2f FieldPushOut = DistanceField.GetPushOut(Location, AgentRadius);
+		const float Difference       = FVector2f::Distance(EdgesPushOut, FieldPushOut);
+		
+		ContactMismatchesNum += (EdgesPushOut.IsZero() != FieldPushOut.IsZero()) ? 1 : 0;
+		PushOutMismatchesNum += (Difference > Tolerance) ? 1 : 0;
+		MaxDifference         = FMath::Max(MaxDifference, Difference);
+		DifferencesSum       += Difference;
+	}
+
+	// Differences are expected near obstacle corners, where the field pushes radially and edges push along their normals
+	UE_LOG(LogTemp, Display, TEXT("[%hs] Samples: %d, contact mismatches: %d, push-out mismatches (> %.1f cm): %d, mean difference: %.3f cm, max difference: %.3f cm"),
+		__FUNCTION__, SamplesNum, ContactMismatchesNum, Tolerance, PushOutMismatchesNum, DifferencesSum / FMath::Max(SamplesNum, 1), MaxDifference);
+}
+
 // DEBUG ------
 
 void UCCSCollisionsProcessor::DrawDebugVerticalLineInGameThread(UWorld* World, const FVector& Location, const float LifeTime)
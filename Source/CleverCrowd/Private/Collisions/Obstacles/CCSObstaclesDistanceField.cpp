@@ -0,0 +1,175 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Collisions/Obstacles/CCSObstaclesDistanceField.h"
+
+#include "Async/ParallelFor.h"
+#include "Collisions/Obstacles/CCSObstaclesHashGrid.h"
+#include "Misc/Crc.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+void FCCSObstaclesDistanceField::Build(const UCCSObstaclesHashGrid& ObstaclesHashGrid, const FGridBounds& InBounds, const int32 CellSize)
+{
+	InitializeLayout(InBounds, CellSize);
+	EdgesHash = MakeEdgesHash(ObstaclesHashGrid);
+
+	Distances.SetNumUninitialized(SamplesX * SamplesY);
+	Gradients.SetNumUninitialized(SamplesX * SamplesY);
+	ParallelFor(SamplesY, [this, &ObstaclesHashGrid](const int32 Row)
+	{
+		for (int32 Col = 0; Col < SamplesX; Col++)
+		{
+			const int32 SampleIndex        = Row * SamplesX + Col;
+			const FVector2f SampleLocation = Origin + FVector2f{static_cast<float>(Col), static_cast<float>(Row)} * SampleSpacing;
+			Distances[SampleIndex]         = ComputeSignedDistance(Gradients[SampleIndex], ObstaclesHashGrid, SampleLocation);
+		}
+	});
+}
+
+void FCCSObstaclesDistanceField::BuildOrLoadCached(const UCCSObstaclesHashGrid& ObstaclesHashGrid, const FGridBounds& InBounds, const int32 CellSize,
+	const FString& CacheFilePath)
+{
+	TArray<uint8> BinData;
+	if (FPaths::FileExists(CacheFilePath) && FFileHelper::LoadFileToArray(BinData, *CacheFilePath))
+	{
+		FMemoryReader Ar = FMemoryReader(BinData, true);
+		FCCSObstaclesDistanceField CachedField;
+		Ar << CachedField;
+
+		FCCSObstaclesDistanceField ExpectedLayout;
+		ExpectedLayout.InitializeLayout(InBounds, CellSize);
+		const bool bCacheValid = !Ar.IsError() && CachedField.IsBuilt() && CachedField.EdgesHash == MakeEdgesHash(ObstaclesHashGrid) &&
+			CachedField.Bounds == InBounds && CachedField.SampleSpacing == ExpectedLayout.SampleSpacing;
+		if (bCacheValid)
+		{
+			*this = MoveTemp(CachedField);
+			UE_LOG(LogTemp, Log, TEXT("[%hs] Loaded obstacles distance field from %s."), __FUNCTION__, *CacheFilePath);
+			return;
+		}
+	}
+
+	Build(ObstaclesHashGrid, InBounds, CellSize);
+
+	BinData.Reset();
+	FMemoryWriter Ar = FMemoryWriter(BinData, true);
+	Ar << *this;
+	if (!FFileHelper::SaveArrayToFile(BinData, *CacheFilePath))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Failed to save obstacles distance field to %s."), __FUNCTION__, *CacheFilePath);
+	}
+}
+
+float FCCSObstaclesDistanceField::Sample(FVector2f& OutGradient, const FVector2f& Location) const
+{
+	const float SampleX = (Location.X - Origin.X) / SampleSpacing;
+	const float SampleY = (Location.Y - Origin.Y) / SampleSpacing;
+	if (!IsBuilt() || SampleX < 0.f || SampleY < 0.f || SampleX >= SamplesX - 1 || SampleY >= SamplesY - 1)
+	{
+		OutGradient = FVector2f::ZeroVector;
+		return MaxDistance;
+	}
+
+	const int32 Col   = FMath::FloorToInt32(SampleX);
+	const int32 Row   = FMath::FloorToInt32(SampleY);
+	const float FracX = SampleX - Col;
+	const float FracY = SampleY - Row;
+	
+	const int32 Index00 = Row * SamplesX + Col;
+	const int32 Index10 = Index00 + 1;
+	const int32 Index01 = Index00 + SamplesX;
+	const int32 Index11 = Index01 + 1;
+
+	OutGradient = FMath::BiLerp(Gradients[Index00], Gradients[Index10], Gradients[Index01], Gradients[Index11], FracX, FracY);
+	return FMath::BiLerp(Distances[Index00], Distances[Index10], Distances[Index01], Distances[Index11], FracX, FracY);
+}
+
+FVector2f FCCSObstaclesDistanceField::GetPushOut(const FVector2f& Location, const float Radius) const
+{
+	FVector2f Gradient;
+	const float Distance = Sample(Gradient, Location);
+	if (Distance >= Radius)
+	{
+		return FVector2f::ZeroVector;
+	}
+	return Gradient.GetSafeNormal() * (Radius - Distance);
+}
+
+FArchive& operator<<(FArchive& Ar, FCCSObstaclesDistanceField& Field)
+{
+	int32 Version = FCCSObstaclesDistanceField::CacheVersion;
+	Ar << Version;
+	if (Ar.IsLoading() && Version != FCCSObstaclesDistanceField::CacheVersion)
+	{
+		Ar.SetError();
+		return Ar;
+	}
+	
+	Ar << Field.Bounds.BottomLeftCell;
+	Ar << Field.Bounds.TopRightCell;
+	Ar << Field.Origin;
+	Ar << Field.SampleSpacing;
+	Ar << Field.MaxDistance;
+	Ar << Field.SamplesX;
+	Ar << Field.SamplesY;
+	Ar << Field.EdgesHash;
+	Ar << Field.Distances;
+	Ar << Field.Gradients;
+	return Ar;
+}
+
+void FCCSObstaclesDistanceField::InitializeLayout(const FGridBounds& InBounds, const int32 CellSize)
+{
+	Bounds        = InBounds;
+	Origin        = FVector2f{static_cast<float>(Bounds.BottomLeftCell.X * CellSize), static_cast<float>(Bounds.BottomLeftCell.Y * CellSize)};
+	SampleSpacing = static_cast<float>(CellSize) / SamplesPerCell;
+	MaxDistance   = static_cast<float>(CellSize);
+	SamplesX      = Bounds.GetCols() * SamplesPerCell + 1;
+	SamplesY      = Bounds.GetRows() * SamplesPerCell + 1;
+}
+
+float FCCSObstaclesDistanceField::ComputeSignedDistance(FVector2f& OutGradient, const UCCSObstaclesHashGrid& ObstaclesHashGrid, const FVector2f& Location) const
+{
+	float MinDistance = MaxDistance;
+	OutGradient       = FVector2f::ZeroVector;
+
+	UCCSObstaclesHashGrid::FEdgeIdsBuffer EdgeIdsBuffer;
+	const TConstArrayView<int32> EdgeIds = ObstaclesHashGrid.GetBakedEdgeIdsAtLocation(EdgeIdsBuffer, FVector{Location.X, Location.Y, 0.f}, MaxDistance);
+	for (const int32 EdgeId : EdgeIds)
+	{
+		const FCCSBakedObstacleEdge& Edge = ObstaclesHashGrid.GetBakedEdge(EdgeId);
+		const FVector2f Segment           = Edge.End - Edge.Start;
+		const float SegmentLengthSquared  = Segment.SizeSquared();
+		const float SegmentAlpha          = (SegmentLengthSquared > UE_SMALL_NUMBER) ?
+			FMath::Clamp(FVector2f::DotProduct(Location - Edge.Start, Segment) / SegmentLengthSquared, 0.f, 1.f) : 0.f;
+		
+		const FVector2f FromEdge = Location - (Edge.Start + Segment * SegmentAlpha);
+		const float Distance     = FromEdge.Size();
+		if (Distance >= FMath::Abs(MinDistance))
+		{
+			continue;
+		}
+
+		// LeftDir of the box edges looks outside of the obstacle
+		const bool bInside = FVector2f::DotProduct(FromEdge, Edge.LeftDir) < 0.f;
+		MinDistance        = bInside ? -Distance : Distance;
+		if (Distance > UE_KINDA_SMALL_NUMBER)
+		{
+			OutGradient = (bInside ? -FromEdge : FromEdge) / Distance;	// Towards growing distance
+		}
+		else
+		{
+			OutGradient = Edge.LeftDir;
+		}
+	}
+	
+	return MinDistance;
+}
+
+uint32 FCCSObstaclesDistanceField::MakeEdgesHash(const UCCSObstaclesHashGrid& ObstaclesHashGrid)
+{
+	const TConstArrayView<FCCSBakedObstacleEdge> Edges = ObstaclesHashGrid.GetBakedEdges();
+	return FCrc::MemCrc32(Edges.GetData(), Edges.Num() * sizeof(FCCSBakedObstacleEdge));
+}
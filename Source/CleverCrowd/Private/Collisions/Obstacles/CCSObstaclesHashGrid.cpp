@@ -10,18 +10,14 @@ UCCSObstaclesHashGrid::UCCSObstaclesHashGrid()
 	CellSize = 100;
 }
 
-void UCCSObstaclesHashGrid::GetObstacleEdgesAtLocation(TArray<FCCSObstacleEdge>& OutEdges, const FVector& Location, const float& Radius)
+void UCCSObstaclesHashGrid::AddObstacleEdge(const FCCSObstacleEdge& Edge)
 {
-	TArray<FGridCellPosition> AffectedCells;
-	UGridUtilsFunctionLibrary::GetCellsInRadius(AffectedCells, CellSize, Location, Radius);
-	for (const FGridCellPosition& CellPos : AffectedCells)
+	if (bEdgesIndexBaked)
 	{
-		FetchObstacleEdgesFromCell(OutEdges, CellPos);
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Edges index is already baked, the edge is ignored"), __FUNCTION__);
+		return;
 	}
-}
-
-void UCCSObstaclesHashGrid::AddObstacleEdge(const FCCSObstacleEdge& Edge)
-{
+	
 	FVector MinLoc = FVector::ZeroVector;
 	FVector MaxLoc = FVector::ZeroVector;
 	MinLoc.X = FMath::Min(Edge.Start.X, Edge.End.X);
@@ -32,9 +28,10 @@ void UCCSObstaclesHashGrid::AddObstacleEdge(const FCCSObstacleEdge& Edge)
 	TArray<FGridCellPosition> AffectedCells;
 	UGridUtilsFunctionLibrary::GetGridCellsInVectorBounds(AffectedCells, CellSize, MinLoc, MaxLoc);
 
+	const int32 EdgeId = ObstacleEdges.Add(Edge);
 	for (const FGridCellPosition& CellPos : AffectedCells)
 	{
-		AddObstacleEdgeInCell(CellPos, Edge);
+		AddObstacleEdgeIdInCell(CellPos, EdgeId);
 	}
 }
 
@@ -48,31 +45,95 @@ void UCCSObstaclesHashGrid::AddObstacleEdges(const TArray<FCCSObstacleEdge>& Edg
 
 void UCCSObstaclesHashGrid::GetCellsWithObstacles(TArray<FGridCellPosition>& OutCells)
 {
-	for (auto& [CellPosition, ObstacleEdges] : ObstacleEdgesInCells)
+	for (auto& [CellPosition, EdgeIds] : ObstacleEdgeIdsInCells)
 	{
-		if (ObstacleEdges.IsEmpty()) continue;
+		if (EdgeIds.IsEmpty()) continue;
 		OutCells.Add(CellPosition);
 	}
 }
 
 void UCCSObstaclesHashGrid::GetCellsWithObstaclesInBounds(TArray<FGridCellPosition>& OutCells, const FGridBounds& Bounds)
 {
-	for (auto& [CellPosition, ObstacleEdges] : ObstacleEdgesInCells)
+	for (auto& [CellPosition, EdgeIds] : ObstacleEdgeIdsInCells)
 	{
-		if (ObstacleEdges.IsEmpty() || !Bounds.IsCellInBounds(CellPosition)) continue;
+		if (EdgeIds.IsEmpty() || !Bounds.IsCellInBounds(CellPosition)) continue;
 		OutCells.Add(CellPosition);
 	}
 }
 
-void UCCSObstaclesHashGrid::FetchObstacleEdgesFromCell(TArray<FCCSObstacleEdge>& OutEdges, const FGridCellPosition& CellPosition)
+void UCCSObstaclesHashGrid::BakeEdgesIndex()
+{
+	BakedEdges.Reset(ObstacleEdges.Num());
+	for (const FCCSObstacleEdge& Edge : ObstacleEdges)
+	{
+		BakedEdges.Emplace(Edge);
+	}
+
+	BakedBounds = FGridBounds();
+	bool bBoundsInitialized = false;
+	for (const auto& [CellPosition, EdgeIds] : ObstacleEdgeIdsInCells)
+	{
+		if (!bBoundsInitialized)
+		{
+			BakedBounds        = FGridBounds{CellPosition, CellPosition};
+			bBoundsInitialized = true;
+		}
+		BakedBounds.UpdateToFitCell(CellPosition);
+	}
+
+	// Counting pass, then ids are placed into ranges of their cells
+	const int32 BakedCellsNum = bBoundsInitialized ? BakedBounds.GetCols() * BakedBounds.GetRows() : 0;
+	BakedCellStarts.Init(0, BakedCellsNum + 1);
+	for (const auto& [CellPosition, EdgeIds] : ObstacleEdgeIdsInCells)
+	{
+		BakedCellStarts[BakedBounds.GetCellIndex(CellPosition) + 1] = EdgeIds.Num();
+	}
+	for (int32 CellIndex = 0; CellIndex < BakedCellsNum; CellIndex++)
+	{
+		BakedCellStarts[CellIndex + 1] += BakedCellStarts[CellIndex];
+	}
+	
+	BakedEdgeIds.SetNumUninitialized(BakedCellStarts.Last());
+	for (const auto& [CellPosition, EdgeIds] : ObstacleEdgeIdsInCells)
+	{
+		const int32 CellStart = BakedCellStarts[BakedBounds.GetCellIndex(CellPosition)];
+		FMemory::Memcpy(&BakedEdgeIds[CellStart], EdgeIds.GetData(), EdgeIds.Num() * sizeof(int32));
+	}
+
+	bEdgesIndexBaked = bBoundsInitialized;
+}
+
+TConstArrayView<int32> UCCSObstaclesHashGrid::GetBakedEdgeIdsAtLocation(FEdgeIdsBuffer& OutBuffer, const FVector& Location, const float Radius) const
 {
-	if (const TArray<FCCSObstacleEdge>* Edges = ObstacleEdgesInCells.Find(CellPosition))
+	OutBuffer.Reset();
+	if (!bEdgesIndexBaked)
+	{
+		return OutBuffer;
+	}
+	
+	const FGridCellPosition BottomLeftCell = UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(Location - FVector{Radius, Radius, 0.f}, CellSize);
+	const FGridCellPosition TopRightCell   = UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(Location + FVector{Radius, Radius, 0.f}, CellSize);
+	const int32 MinX = FMath::Max(BottomLeftCell.X, BakedBounds.BottomLeftCell.X);
+	const int32 MinY = FMath::Max(BottomLeftCell.Y, BakedBounds.BottomLeftCell.Y);
+	const int32 MaxX = FMath::Min(TopRightCell.X, BakedBounds.TopRightCell.X);
+	const int32 MaxY = FMath::Min(TopRightCell.Y, BakedBounds.TopRightCell.Y);
+
+	for (int32 Y = MinY; Y <= MaxY; Y++)
 	{
-		OutEdges.Append(*Edges);
+		for (int32 X = MinX; X <= MaxX; X++)
+		{
+			const int32 CellIndex = BakedBounds.GetCellIndex(FGridCellPosition{X, Y});
+			for (int32 IdIndex = BakedCellStarts[CellIndex]; IdIndex < BakedCellStarts[CellIndex + 1]; IdIndex++)
+			{
+				OutBuffer.AddUnique(BakedEdgeIds[IdIndex]);	// Only a few edges are near an agent, so a linear search is enough
+			}
+		}
 	}
+	
+	return OutBuffer;
 }
 
-void UCCSObstaclesHashGrid::AddObstacleEdgeInCell(const FGridCellPosition& CellPosition, const FCCSObstacleEdge& Edge)
+void UCCSObstaclesHashGrid::AddObstacleEdgeIdInCell(const FGridCellPosition& CellPosition, const int32 EdgeId)
 {
-	ObstacleEdgesInCells.FindOrAdd(CellPosition).Add(Edge);
+	ObstacleEdgeIdsInCells.FindOrAdd(CellPosition).Add(EdgeId);
 }
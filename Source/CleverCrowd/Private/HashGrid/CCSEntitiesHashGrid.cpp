@@ -4,6 +4,9 @@
 #include "HashGrid/CCSEntitiesHashGrid.h"
 
 #include "MassEntityManager.h"
+#include "Algo/Sort.h"
+#include "Async/ParallelFor.h"
+#include "Collisions/CollisionsFragments.h"
 #include "Grids/GridUtilsFunctionLibrary.h"
 
 UCCSEntitiesHashGrid::UCCSEntitiesHashGrid()
@@ -13,23 +16,41 @@ UCCSEntitiesHashGrid::UCCSEntitiesHashGrid()
 
 void UCCSEntitiesHashGrid::ClearData()
 {
-	EntitiesInCells.Empty();
+	ClearCells();
+	StagedEntities.Reset();
+	bStagedWithoutSnapshotData = false;
 }
 
-void UCCSEntitiesHashGrid::FetchEntitiesFromCell(TArray<FMassEntityHandle>& OutEntities, const FGridCellPosition& CellPosition)
+void UCCSEntitiesHashGrid::ClearCells()
 {
-	if (const TArray<FMassEntityHandle>* Entities = EntitiesInCells.Find(CellPosition))
+	EntitiesInCells.Empty();
+
+	if (bDenseStorageEnabled)
 	{
-		OutEntities.Append(*Entities);
+		// Keep allocations, the dense storage is refilled every rebuild
+		DenseCellEntities.Reset();
+		DenseNonEmptyCells.Reset();
+		for (TArray<int32>& ColourCells : DenseNonEmptyCellsByColour)
+		{
+			ColourCells.Reset();
+		}
+		FMemory::Memzero(DenseCellOffsets.GetData(), DenseCellOffsets.Num() * sizeof(int32));
+		FMemory::Memzero(DenseCellHomeEnds.GetData(), DenseCellHomeEnds.Num() * sizeof(int32));
+		Snapshot.SetNumUninitialized(0);
 	}
+	EntitiesOutsideSnapshot.Reset();
+	bSnapshotValid = false;
+}
+
+void UCCSEntitiesHashGrid::FetchEntitiesFromCell(TArray<FMassEntityHandle>& OutEntities, const FGridCellPosition& CellPosition)
+{
+	OutEntities.Append(GetEntitiesViewInCell(CellPosition));
 }
 
 void UCCSEntitiesHashGrid::GetEntitiesInCell(TArray<FMassEntityHandle>& OutEntities, const FGridCellPosition& CellPosition)
 {
-	if (const TArray<FMassEntityHandle>* Entities = EntitiesInCells.Find(CellPosition))
-	{
-		OutEntities = *Entities;
-	}
+	OutEntities.Reset();
+	FetchEntitiesFromCell(OutEntities, CellPosition);
 }
 
 void UCCSEntitiesHashGrid::GetEntitiesAtLocation(TArray<FMassEntityHandle>& OutEntities, const FVector& Location)
@@ -38,43 +59,174 @@ void UCCSEntitiesHashGrid::GetEntitiesAtLocation(TArray<FMassEntityHandle>& OutE
 	GetEntitiesInCell(OutEntities, CellPosition);
 }
 
+TConstArrayView<FMassEntityHandle> UCCSEntitiesHashGrid::GetEntitiesViewInCell(const FGridCellPosition& CellPosition) const
+{
+	if (IsCellInDenseStorage(CellPosition))
+	{
+		const int32 CellIndex = GetDenseCellIndex(CellPosition);
+		const int32 Start     = DenseCellOffsets[CellIndex];
+		return TConstArrayView<FMassEntityHandle>(DenseCellEntities.GetData() + Start, DenseCellOffsets[CellIndex + 1] - Start);
+	}
+	
+	if (const TArray<FMassEntityHandle>* Entities = EntitiesInCells.Find(CellPosition))
+	{
+		return *Entities;
+	}
+	return TConstArrayView<FMassEntityHandle>();
+}
+
 void UCCSEntitiesHashGrid::AddEntityInCell(const FGridCellPosition& CellPosition, const FMassEntityHandle& Entity)
 {
+	if (IsCellInDenseStorage(CellPosition))
+	{
+		StagedEntities.Add(FStagedEntity{Entity, FGridBounds{CellPosition, CellPosition}});
+		bStagedWithoutSnapshotData = true;
+		return;
+	}
+	
 	EntitiesInCells.FindOrAdd(CellPosition).Add(Entity);
 }
 
 void UCCSEntitiesHashGrid::AddEntityAtLocation(const FVector& Location, const FMassEntityHandle& Entity, const float& EntityRadius)
 {
-	TArray<FGridCellPosition> AffectedCells;
-	UGridUtilsFunctionLibrary::GetCellsInRadius(AffectedCells, CellSize, Location, EntityRadius);
-	for (const FGridCellPosition& Cell : AffectedCells)
+	AddEntityInCells(GetCellsInRadius(Location, EntityRadius), Entity);
+}
+
+void UCCSEntitiesHashGrid::AddEntityInCells(const FGridBounds& Cells, const FMassEntityHandle& Entity)
+{
+	if (IsDenseStorageUsed())
 	{
-		AddEntityInCell(Cell, Entity);
+		StagedEntities.Add(FStagedEntity{Entity, Cells});	// Cells outside of the dense bounds are handled in CommitDenseStorage()
+		bStagedWithoutSnapshotData = true;
+		return;
+	}
+	
+	for (int32 Row = Cells.BottomLeftCell.Y; Row <= Cells.TopRightCell.Y; Row++)
+	{
+		for (int32 Col = Cells.BottomLeftCell.X; Col <= Cells.TopRightCell.X; Col++)
+		{
+			AddEntityInCell(FGridCellPosition{Col, Row}, Entity);
+		}
 	}
 }
 
+void UCCSEntitiesHashGrid::RemoveEntityFromCell(const FGridCellPosition& CellPosition, const FMassEntityHandle& Entity)
+{
+	if (IsCellInDenseStorage(CellPosition))
+	{
+		// Dense storage is refilled from live entities on every rebuild, so the slot is only made inert until then instead of
+		// shifting the whole storage. Users skip invalid handles, and the snapshot position is moved out of reach of any query.
+		constexpr float RemovedEntityCoordinate = 1e30f;
+		const int32 CellIndex                   = GetDenseCellIndex(CellPosition);
+		for (int32 Slot = DenseCellOffsets[CellIndex]; Slot < DenseCellOffsets[CellIndex + 1]; Slot++)
+		{
+			if (DenseCellEntities[Slot] != Entity)
+			{
+				continue;
+			}
+			DenseCellEntities[Slot] = FMassEntityHandle();
+			if (bSnapshotValid)
+			{
+				Snapshot.X[Slot] = RemovedEntityCoordinate;
+				Snapshot.Y[Slot] = RemovedEntityCoordinate;
+			}
+		}
+		return;
+	}
+
+	TArray<FMassEntityHandle>* Entities = EntitiesInCells.Find(CellPosition);
+	if (!Entities)
+	{
+		return;
+	}
+	Entities->RemoveSingleSwap(Entity, EAllowShrinking::No);
+	if (Entities->IsEmpty())
+	{
+		EntitiesInCells.Remove(CellPosition);	// Only non-empty cells are kept in the map
+	}
+}
+
+void UCCSEntitiesHashGrid::RemoveEntityFromCells(const FGridBounds& Cells, const FMassEntityHandle& Entity)
+{
+	for (int32 Row = Cells.BottomLeftCell.Y; Row <= Cells.TopRightCell.Y; Row++)
+	{
+		for (int32 Col = Cells.BottomLeftCell.X; Col <= Cells.TopRightCell.X; Col++)
+		{
+			RemoveEntityFromCell(FGridCellPosition{Col, Row}, Entity);
+		}
+	}
+}
+
+void UCCSEntitiesHashGrid::RemoveEntity(const FMassEntityHandle& Entity)
+{
+	if (!EntityManager || !EntityManager->IsEntityValid(Entity))
+	{
+		return;
+	}
+	FCollisionFragment* CollisionFragment = EntityManager->GetFragmentDataPtr<FCollisionFragment>(Entity);
+	if (!CollisionFragment || !CollisionFragment->bInHashGrid)
+	{
+		return;
+	}
+
+	DataLock.Lock();
+	RemoveEntityFromCells(CollisionFragment->HashGridCells, Entity);
+	CollisionFragment->bInHashGrid = false;
+	DataLock.Unlock();
+}
+
+FGridBounds UCCSEntitiesHashGrid::GetCellsInRadius(const FVector& Location, const float EntityRadius) const
+{
+	// Same cells as UGridUtilsFunctionLibrary::GetCellsInRadius, without the temporary array
+	return FGridBounds{
+		UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(Location + FVector{-EntityRadius, -EntityRadius, 0.f}, CellSize),
+		UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(Location + FVector{EntityRadius, EntityRadius, 0.f}, CellSize)};
+}
+
 void UCCSEntitiesHashGrid::GetEntitiesInBounds(TArray<FMassEntityHandle>& OutEntities, const FGridBounds& Bounds)
 {
-	OutEntities.Empty();
+	OutEntities.Reset();
+
+	const bool bRowsInDenseStorage = IsDenseStorageUsed()
+		&& Bounds.BottomLeftCell.X >= DenseBounds.BottomLeftCell.X && Bounds.TopRightCell.X <= DenseBounds.TopRightCell.X;
 	
-	TArray<FGridCellPosition> Cells;
-	UGridUtilsFunctionLibrary::GetGridCellsInBounds(Cells, Bounds);
-	for (const FGridCellPosition& Cell : Cells)
+	for (int32 Row = Bounds.BottomLeftCell.Y; Row <= Bounds.TopRightCell.Y; Row++)
 	{
-		FetchEntitiesFromCell(OutEntities, Cell);
+		// Cells of one row are stored next to each other in the dense storage, so the whole row is copied at once
+		if (bRowsInDenseStorage && Row >= DenseBounds.BottomLeftCell.Y && Row <= DenseBounds.TopRightCell.Y)
+		{
+			const int32 Start = DenseCellOffsets[GetDenseCellIndex(FGridCellPosition{Bounds.BottomLeftCell.X, Row})];
+			const int32 End   = DenseCellOffsets[GetDenseCellIndex(FGridCellPosition{Bounds.TopRightCell.X, Row}) + 1];
+			OutEntities.Append(DenseCellEntities.GetData() + Start, End - Start);
+			continue;
+		}
+		
+		for (int32 Col = Bounds.BottomLeftCell.X; Col <= Bounds.TopRightCell.X; Col++)
+		{
+			FetchEntitiesFromCell(OutEntities, FGridCellPosition{Col, Row});
+		}
 	}
 }
 
 void UCCSEntitiesHashGrid::ForEachNonEmptyCell(const TFunction<void(const FGridCellPosition&, FMassEntityManager&)>& Callback)
 {
+	for (const int32 CellIndex : DenseNonEmptyCells)
+	{
+		Callback(GetDenseCellPosition(CellIndex), *EntityManager);
+	}
 	for (auto& [CellPosition, Entities] : EntitiesInCells)
 	{
 		Callback(CellPosition, *EntityManager);
 	}
 }
 
-void UCCSEntitiesHashGrid::ForEachNonEmptyCell(const TFunction<void(const FGridCellPosition&, const TArray<FMassEntityHandle>&, FMassEntityManager&)>& Callback)
+void UCCSEntitiesHashGrid::ForEachNonEmptyCell(const TFunction<void(const FGridCellPosition&, TConstArrayView<FMassEntityHandle>, FMassEntityManager&)>& Callback)
 {
+	for (const int32 CellIndex : DenseNonEmptyCells)
+	{
+		const FGridCellPosition CellPosition = GetDenseCellPosition(CellIndex);
+		Callback(CellPosition, GetEntitiesViewInCell(CellPosition), *EntityManager);
+	}
 	for (auto& [CellPosition, Entities] : EntitiesInCells)
 	{
 		Callback(CellPosition, Entities, *EntityManager);
@@ -85,7 +237,15 @@ void UCCSEntitiesHashGrid::ParallelForEachNonEmptyCell(const TFunction<void(cons
 {
 	DataLock.Lock();
 	TArray<FGridCellPosition> CellsWithEntities;
-	EntitiesInCells.GetKeys(CellsWithEntities);
+	CellsWithEntities.Reserve(DenseNonEmptyCells.Num() + EntitiesInCells.Num());
+	for (const int32 CellIndex : DenseNonEmptyCells)
+	{
+		CellsWithEntities.Add(GetDenseCellPosition(CellIndex));
+	}
+	for (auto& [CellPosition, Entities] : EntitiesInCells)
+	{
+		CellsWithEntities.Add(CellPosition);
+	}
 	
 	ParallelFor(CellsWithEntities.Num(), [this, &Callback, &CellsWithEntities](const int32 Index)
 	{
@@ -93,3 +253,289 @@ void UCCSEntitiesHashGrid::ParallelForEachNonEmptyCell(const TFunction<void(cons
 	});
 	DataLock.Unlock();
 }
+
+
+// DENSE STORAGE ------
+
+void UCCSEntitiesHashGrid::InitializeDenseStorage(const FGridBounds& Bounds)
+{
+	DenseCols = Bounds.TopRightCell.X - Bounds.BottomLeftCell.X + 1;
+	DenseRows = Bounds.TopRightCell.Y - Bounds.BottomLeftCell.Y + 1;
+	if (DenseCols <= 0 || DenseRows <= 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Invalid bounds, the dense storage stays disabled."), __FUNCTION__);
+		bDenseStorageEnabled = false;
+		return;
+	}
+
+	DataLock.Lock();
+	DenseBounds = Bounds;
+	DenseCellOffsets.SetNumZeroed(DenseCols * DenseRows + 1);
+	DenseCellCursors.SetNumUninitialized(DenseCols * DenseRows);
+	DenseCellHomeEnds.SetNumZeroed(DenseCols * DenseRows);
+	DenseCellEntities.Reset();
+	DenseNonEmptyCells.Reset();
+	StagedEntities.Reset();
+	bDenseStorageEnabled = true;
+	ClearData();
+	DataLock.Unlock();
+}
+
+void UCCSEntitiesHashGrid::CommitDenseStorage()
+{
+	if (!IsDenseStorageUsed())
+	{
+		return;
+	}
+
+	constexpr int32 StagedBlockSize = 256;	// Staged entities processed by one ParallelFor job
+	const int32 CellsNum            = DenseCols * DenseRows;
+	const int32 StagedBlocksNum     = FMath::DivideAndRoundUp(StagedEntities.Num(), StagedBlockSize);
+
+	// Cells outside of the dense bounds go to the sparse storage, the rest is clipped to the bounds
+	for (FStagedEntity& Staged : StagedEntities)
+	{
+		if (DenseBounds.IsCellInBounds(Staged.Cells.BottomLeftCell) && DenseBounds.IsCellInBounds(Staged.Cells.TopRightCell))
+		{
+			continue;
+		}
+		const FVector2f& Location = Staged.SnapshotData.Location;
+		if (!bStagedWithoutSnapshotData && !DenseBounds.IsCellInBounds(UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(FVector{Location.X, Location.Y, 0.f}, CellSize)))
+		{
+			EntitiesOutsideSnapshot.Add(Staged.Entity);
+		}
+		for (int32 Row = Staged.Cells.BottomLeftCell.Y; Row <= Staged.Cells.TopRightCell.Y; Row++)
+		{
+			for (int32 Col = Staged.Cells.BottomLeftCell.X; Col <= Staged.Cells.TopRightCell.X; Col++)
+			{
+				if (!DenseBounds.IsCellInBounds(FGridCellPosition{Col, Row}))
+				{
+					EntitiesInCells.FindOrAdd(FGridCellPosition{Col, Row}).Add(Staged.Entity);
+				}
+			}
+		}
+		// May leave BottomLeftCell > TopRightCell, which means no dense cells at all
+		Staged.Cells.BottomLeftCell.X = FMath::Max(Staged.Cells.BottomLeftCell.X, DenseBounds.BottomLeftCell.X);
+		Staged.Cells.BottomLeftCell.Y = FMath::Max(Staged.Cells.BottomLeftCell.Y, DenseBounds.BottomLeftCell.Y);
+		Staged.Cells.TopRightCell.X   = FMath::Min(Staged.Cells.TopRightCell.X, DenseBounds.TopRightCell.X);
+		Staged.Cells.TopRightCell.Y   = FMath::Min(Staged.Cells.TopRightCell.Y, DenseBounds.TopRightCell.Y);
+	}
+	
+	// First pass: count entities in each cell. Counts are shifted by one so the prefix sum below gives start offsets.
+	// Home cells of entities are found here as well, if the snapshot is built.
+	bSnapshotValid = bBuildSnapshot && !bStagedWithoutSnapshotData;
+	FMemory::Memzero(DenseCellOffsets.GetData(), DenseCellOffsets.Num() * sizeof(int32));
+	ParallelFor(StagedBlocksNum, [this](const int32 BlockIndex)
+	{
+		const int32 End = FMath::Min((BlockIndex + 1) * StagedBlockSize, StagedEntities.Num());
+		for (int32 StagedIndex = BlockIndex * StagedBlockSize; StagedIndex < End; StagedIndex++)
+		{
+			FStagedEntity& Staged = StagedEntities[StagedIndex];
+			Staged.HomeCellIndex  = INDEX_NONE;
+			if (bSnapshotValid)
+			{
+				const FVector2f& Location        = Staged.SnapshotData.Location;
+				const FGridCellPosition HomeCell = UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(FVector{Location.X, Location.Y, 0.f}, CellSize);
+				if (DenseBounds.IsCellInBounds(HomeCell))
+				{
+					Staged.HomeCellIndex = GetDenseCellIndex(HomeCell);
+				}
+			}
+			
+			const FGridBounds& Cells = Staged.Cells;
+			for (int32 Row = Cells.BottomLeftCell.Y; Row <= Cells.TopRightCell.Y; Row++)
+			{
+				for (int32 Col = Cells.BottomLeftCell.X; Col <= Cells.TopRightCell.X; Col++)
+				{
+					FPlatformAtomics::InterlockedIncrement(&DenseCellOffsets[GetDenseCellIndex(FGridCellPosition{Col, Row}) + 1]);
+				}
+			}
+		}
+	});
+
+	// Prefix sum: every row is summed up in parallel, then row sums are accumulated and added back to the rows
+	DenseRowOffsets.SetNumUninitialized(DenseRows + 1);
+	DenseRowOffsets[0] = 0;
+	ParallelFor(DenseRows, [this](const int32 Row)
+	{
+		int32* RowCounts = DenseCellOffsets.GetData() + Row * DenseCols + 1;
+		for (int32 Col = 1; Col < DenseCols; Col++)
+		{
+			RowCounts[Col] += RowCounts[Col - 1];
+		}
+		DenseRowOffsets[Row + 1] = RowCounts[DenseCols - 1];
+	});
+	for (int32 Row = 0; Row < DenseRows; Row++)
+	{
+		DenseRowOffsets[Row + 1] += DenseRowOffsets[Row];
+	}
+	ParallelFor(DenseRows, [this](const int32 Row)
+	{
+		int32* RowCounts = DenseCellOffsets.GetData() + Row * DenseCols + 1;
+		for (int32 Col = 0; Col < DenseCols; Col++)
+		{
+			RowCounts[Col] += DenseRowOffsets[Row];
+		}
+	});
+
+	DenseNonEmptyCells.Reset();
+	for (TArray<int32>& ColourCells : DenseNonEmptyCellsByColour)
+	{
+		ColourCells.Reset();
+	}
+	for (int32 CellIndex = 0; CellIndex < CellsNum; CellIndex++)
+	{
+		if (DenseCellOffsets[CellIndex + 1] > DenseCellOffsets[CellIndex])
+		{
+			const int32 Colour = (CellIndex % DenseCols) % HalfShellColumnColours + (CellIndex / DenseCols) % HalfShellRowColours * HalfShellColumnColours;
+			DenseNonEmptyCells.Add(CellIndex);
+			DenseNonEmptyCellsByColour[Colour].Add(CellIndex);
+		}
+	}
+
+	// Second pass: scatter staged entities indices into their cells ranges
+	FMemory::Memcpy(DenseCellCursors.GetData(), DenseCellOffsets.GetData(), CellsNum * sizeof(int32));
+	DenseSlotStagedIndices.SetNumUninitialized(DenseCellOffsets[CellsNum], EAllowShrinking::No);
+	ParallelFor(StagedBlocksNum, [this](const int32 BlockIndex)
+	{
+		const int32 End = FMath::Min((BlockIndex + 1) * StagedBlockSize, StagedEntities.Num());
+		for (int32 StagedIndex = BlockIndex * StagedBlockSize; StagedIndex < End; StagedIndex++)
+		{
+			const FGridBounds& Cells = StagedEntities[StagedIndex].Cells;
+			for (int32 Row = Cells.BottomLeftCell.Y; Row <= Cells.TopRightCell.Y; Row++)
+			{
+				for (int32 Col = Cells.BottomLeftCell.X; Col <= Cells.TopRightCell.X; Col++)
+				{
+					const int32 CellIndex = GetDenseCellIndex(FGridCellPosition{Col, Row});
+					DenseSlotStagedIndices[FPlatformAtomics::InterlockedIncrement(&DenseCellCursors[CellIndex]) - 1] = StagedIndex;
+				}
+			}
+		}
+	});
+
+	// Scatter order depends on threads timing, so slots of each cell are sorted by entity to keep the grid deterministic.
+	// Entities at their home cell go first, so home slots of every cell are contiguous. Then entities (and their snapshot data) are gathered into the slots.
+	DenseCellEntities.SetNumUninitialized(DenseSlotStagedIndices.Num(), EAllowShrinking::No);
+	Snapshot.SetNumUninitialized(bSnapshotValid ? DenseSlotStagedIndices.Num() : 0);
+	ParallelFor(DenseNonEmptyCells.Num(), [this](const int32 Index)
+	{
+		const int32 CellIndex = DenseNonEmptyCells[Index];
+		const int32 Start     = DenseCellOffsets[CellIndex];
+		const int32 End       = DenseCellOffsets[CellIndex + 1];
+		Algo::Sort(MakeArrayView(DenseSlotStagedIndices.GetData() + Start, End - Start), [this, CellIndex](const int32 A, const int32 B)
+		{
+			const bool bHomeA = (StagedEntities[A].HomeCellIndex == CellIndex);
+			const bool bHomeB = (StagedEntities[B].HomeCellIndex == CellIndex);
+			if (bHomeA != bHomeB)
+			{
+				return bHomeA;
+			}
+			return StagedEntities[A].Entity.Index < StagedEntities[B].Entity.Index;
+		});
+
+		DenseCellHomeEnds[CellIndex] = Start;
+		for (int32 Slot = Start; Slot < End; Slot++)
+		{
+			const FStagedEntity& Staged = StagedEntities[DenseSlotStagedIndices[Slot]];
+			DenseCellEntities[Slot]     = Staged.Entity;
+			if (!bSnapshotValid)
+			{
+				continue;
+			}
+			
+			const FCCSEntitySnapshotData& Data = Staged.SnapshotData;
+			Snapshot.X[Slot]           = Data.Location.X;
+			Snapshot.Y[Slot]           = Data.Location.Y;
+			Snapshot.Radius[Slot]      = Data.Radius;
+			Snapshot.ClusterType[Slot] = Data.ClusterType;
+			Snapshot.AreaId[Slot]      = Data.AreaId;
+			Snapshot.bHomeCell[Slot]   = (Staged.HomeCellIndex == CellIndex);
+			if (Snapshot.bHomeCell[Slot])
+			{
+				DenseCellHomeEnds[CellIndex] = Slot + 1;
+			}
+		}
+	});
+}
+
+FCCSDenseSlotsRange UCCSEntitiesHashGrid::GetDenseSlotsInCell(const FGridCellPosition& CellPosition) const
+{
+	if (!IsCellInDenseStorage(CellPosition))
+	{
+		return FCCSDenseSlotsRange{};
+	}
+	const int32 CellIndex = GetDenseCellIndex(CellPosition);
+	return FCCSDenseSlotsRange{DenseCellOffsets[CellIndex], DenseCellOffsets[CellIndex + 1]};
+}
+
+FCCSDenseSlotsRange UCCSEntitiesHashGrid::GetDenseHomeSlotsInCell(const FGridCellPosition& CellPosition) const
+{
+	if (!IsCellInDenseStorage(CellPosition))
+	{
+		return FCCSDenseSlotsRange{};
+	}
+	const int32 CellIndex = GetDenseCellIndex(CellPosition);
+	return FCCSDenseSlotsRange{DenseCellOffsets[CellIndex], DenseCellHomeEnds[CellIndex]};
+}
+
+void UCCSEntitiesHashGrid::BeginParallelStaging(const int32 MaxEntitiesNum)
+{
+	StagedEntities.SetNumUninitialized(MaxEntitiesNum, EAllowShrinking::No);
+	StagedEntitiesNum          = 0;
+	bStagedWithoutSnapshotData = false;
+}
+
+int32 UCCSEntitiesHashGrid::ClaimStagedEntities(const int32 EntitiesNum)
+{
+	const int32 FirstIndex = StagedEntitiesNum.fetch_add(EntitiesNum);
+	checkf(FirstIndex + EntitiesNum <= StagedEntities.Num(), TEXT("More entities are staged than were expected in BeginParallelStaging()"));
+	return FirstIndex;
+}
+
+void UCCSEntitiesHashGrid::EndParallelStaging()
+{
+	StagedEntities.SetNum(StagedEntitiesNum, EAllowShrinking::No);
+}
+
+
+// UPDATE MODES ------
+
+void UCCSEntitiesHashGrid::SetUpdateMode(const EEntitiesHashGridUpdateMode NewUpdateMode)
+{
+	RequestedUpdateMode = static_cast<int32>(NewUpdateMode);
+}
+
+void UCCSEntitiesHashGrid::ApplyRequestedUpdateMode()
+{
+	const int32 NewUpdateModeValue = RequestedUpdateMode.exchange(INDEX_NONE);
+	if (NewUpdateModeValue == INDEX_NONE || static_cast<EEntitiesHashGridUpdateMode>(NewUpdateModeValue) == UpdateMode)
+	{
+		return;
+	}
+
+	if (UpdateTime.ValuesAmount > 0)
+	{
+		UE_LOG(LogTemp, Display, TEXT("[%hs] Mode: %s, mean update time: %.3f ms over %d updates"), __FUNCTION__,
+			*UEnum::GetValueAsString(UpdateMode), UpdateTime.GetMean() * 1000.f, UpdateTime.ValuesAmount);
+	}
+
+	// Storages differ between modes, so the grid has to be refilled from scratch
+	DataLock.Lock();
+	ClearData();
+	UpdateMode            = static_cast<EEntitiesHashGridUpdateMode>(NewUpdateModeValue);
+	bFullRebuildRequested = true;
+	UpdateTime            = FAggregatedValueFloat{};	// So the evaluator reports the time of the new mode only
+	DataLock.Unlock();
+}
+
+bool UCCSEntitiesHashGrid::ShouldDoFullRebuild(const double CurrentTime) const
+{
+	return UpdateMode == EEntitiesHashGridUpdateMode::FullRebuild || bFullRebuildRequested
+		|| CurrentTime - LastFullRebuildTime >= FullRebuildInterval;
+}
+
+void UCCSEntitiesHashGrid::OnFullRebuildFinished(const double CurrentTime)
+{
+	LastFullRebuildTime   = CurrentTime;
+	bFullRebuildRequested = false;
+}
@@ -6,6 +6,8 @@
 #include "MassCommonFragments.h"
 #include "MassCommonTypes.h"
 #include "MassExecutionContext.h"
+#include "Collisions/CollisionsFragments.h"
+#include "Common/Clusters/CrowdClusterTypes.h"
 #include "Grids/GridUtilsFunctionLibrary.h"
 #include "HashGrid/CCSEntitiesHashGrid.h"
 #include "Management/CCSEntitiesManagerSubsystem.h"
@@ -16,13 +18,15 @@ UCCSEntitiesHashGridProcessor::UCCSEntitiesHashGridProcessor()
 	bAutoRegisterWithProcessingPhases = true;
 	ExecutionFlags = (int32)EProcessorExecutionFlags::All;
 	ExecutionOrder.ExecuteBefore.Add(UE::Mass::ProcessorGroupNames::Avoidance);
-	bRequiresGameThreadExecution = true;
+	bRequiresGameThreadExecution = false;
 }
 
 void UCCSEntitiesHashGridProcessor::ConfigureQueries()
 {
 	EntityQuery.AddRequirement<FTransformFragment>(EMassFragmentAccess::ReadWrite);
 	EntityQuery.AddRequirement<FAgentRadiusFragment>(EMassFragmentAccess::ReadWrite);
+	EntityQuery.AddRequirement<FCollisionFragment>(EMassFragmentAccess::ReadWrite);
+	EntityQuery.AddRequirement<FClusterFragment>(EMassFragmentAccess::ReadOnly);
 
 	EntityQuery.RegisterWithProcessor(*this);
 }
@@ -36,31 +40,136 @@ void UCCSEntitiesHashGridProcessor::Initialize(UObject& Owner)
 
 void UCCSEntitiesHashGridProcessor::Execute(FMassEntityManager& EntityManager, FMassExecutionContext& Context)
 {
-	TArray<FMassEntityHandle> Entities;
+	const double StartTime = FPlatformTime::Seconds();
+	
 	UCCSEntitiesHashGrid* HashGrid = EntitiesManager->GetEntitiesHashGrid();
 	check(HashGrid);
-	HashGrid->DataLock.Lock();
-	HashGrid->ClearData();
+	HashGrid->ApplyRequestedUpdateMode();
+
+	CurrentTime += Context.GetDeltaTimeSeconds();
+	if (HashGrid->ShouldDoFullRebuild(CurrentTime))
+	{
+		if (HashGrid->IsDenseStorageUsed())
+		{
+			RebuildHashGridParallel(EntityManager, Context, *HashGrid);	// Takes DataLock only for the merge
+		}
+		else
+		{
+			HashGrid->DataLock.Lock();
+			RebuildHashGrid(EntityManager, Context, *HashGrid);
+			HashGrid->DataLock.Unlock();
+		}
+		HashGrid->OnFullRebuildFinished(CurrentTime);
+	}
+	else
+	{
+		HashGrid->DataLock.Lock();
+		UpdateHashGridIncrementally(EntityManager, Context, *HashGrid);
+		HashGrid->DataLock.Unlock();
+	}
+
+	// HashGrid->ForEachNonEmptyCell([this, &EntityManager](const FGridCellPosition& Cell)
+	// {
+	// 	const FVector CellLoc = UGridUtilsFunctionLibrary::GetGridCellLocationAtPosition(Cell, 100);
+	// 	DrawDebugLine(GetWorld(), CellLoc, CellLoc + FVector::UpVector * 500.f, FColor::Red, false, 0.f, 0, 2.f);
+	// });
+
+	HashGrid->UpdateTime.AddValue(FPlatformTime::Seconds() - StartTime);
+}
+
+void UCCSEntitiesHashGridProcessor::RebuildHashGrid(FMassEntityManager& EntityManager, FMassExecutionContext& Context, UCCSEntitiesHashGrid& HashGrid)
+{
+	HashGrid.ClearData();
 	
-	EntityQuery.ForEachEntityChunk(EntityManager, Context, [this, HashGrid](FMassExecutionContext& Context)
+	EntityQuery.ForEachEntityChunk(EntityManager, Context, [&HashGrid](FMassExecutionContext& Context)
 	{
 		const int32 NumEntities                            = Context.GetNumEntities();
 		const TArrayView<FTransformFragment> TransformList = Context.GetMutableFragmentView<FTransformFragment>();
 		const TArrayView<FAgentRadiusFragment> RadiusList  = Context.GetMutableFragmentView<FAgentRadiusFragment>();
+		const TArrayView<FCollisionFragment> CollisionList = Context.GetMutableFragmentView<FCollisionFragment>();
 		
 		for (int32 EntityIndex = 0; EntityIndex < NumEntities; ++EntityIndex)
 		{
-			const FVector& EntityLocation = TransformList[EntityIndex].GetTransform().GetLocation();
-			HashGrid->AddEntityAtLocation(EntityLocation, Context.GetEntity(EntityIndex), RadiusList[EntityIndex].Radius);
+			const FVector& EntityLocation         = TransformList[EntityIndex].GetTransform().GetLocation();
+			FCollisionFragment& CollisionFragment = CollisionList[EntityIndex];
+			
+			CollisionFragment.HashGridCells = HashGrid.GetCellsInRadius(EntityLocation, RadiusList[EntityIndex].Radius);
+			CollisionFragment.bInHashGrid   = true;
+			HashGrid.AddEntityInCells(CollisionFragment.HashGridCells, Context.GetEntity(EntityIndex));
 		}
 	});
+	HashGrid.CommitDenseStorage();
+}
 
-	// HashGrid->ForEachNonEmptyCell([this, &EntityManager](const FGridCellPosition& Cell)
-	// {
-	// 	const FVector CellLoc = UGridUtilsFunctionLibrary::GetGridCellLocationAtPosition(Cell, 100);
-	// 	DrawDebugLine(GetWorld(), CellLoc, CellLoc + FVector::UpVector * 500.f, FColor::Red, false, 0.f, 0, 2.f);
-	// });
+void UCCSEntitiesHashGridProcessor::RebuildHashGridParallel(FMassEntityManager& EntityManager, FMassExecutionContext& Context, UCCSEntitiesHashGrid& HashGrid)
+{
+	// Workers only write into their own staging slots, the grid itself is untouched until the merge
+	HashGrid.BeginParallelStaging(EntityQuery.GetNumMatchingEntities(EntityManager));
+	
+	EntityQuery.ParallelForEachEntityChunk(EntityManager, Context, [&HashGrid](FMassExecutionContext& Context)
+	{
+		const int32 NumEntities                            = Context.GetNumEntities();
+		const TArrayView<FTransformFragment> TransformList  = Context.GetMutableFragmentView<FTransformFragment>();
+		const TArrayView<FAgentRadiusFragment> RadiusList   = Context.GetMutableFragmentView<FAgentRadiusFragment>();
+		const TArrayView<FCollisionFragment> CollisionList  = Context.GetMutableFragmentView<FCollisionFragment>();
+		const TConstArrayView<FClusterFragment> ClusterList = Context.GetFragmentView<FClusterFragment>();
+		const int32 FirstStagedIndex                        = HashGrid.ClaimStagedEntities(NumEntities);
+		
+		for (int32 EntityIndex = 0; EntityIndex < NumEntities; ++EntityIndex)
+		{
+			const FVector& EntityLocation           = TransformList[EntityIndex].GetTransform().GetLocation();
+			const float Radius                      = RadiusList[EntityIndex].Radius;
+			FCollisionFragment& CollisionFragment   = CollisionList[EntityIndex];
+			const FClusterFragment& ClusterFragment = ClusterList[EntityIndex];
+			
+			CollisionFragment.HashGridCells = HashGrid.GetCellsInRadius(EntityLocation, Radius);
+			CollisionFragment.bInHashGrid   = true;
+
+			FCCSEntitySnapshotData SnapshotData;
+			SnapshotData.Location    = FVector2f{static_cast<float>(EntityLocation.X), static_cast<float>(EntityLocation.Y)};
+			SnapshotData.Radius      = Radius;
+			SnapshotData.ClusterType = ClusterFragment.ClusterType;
+			SnapshotData.AreaId      = ClusterFragment.AreaId;
+			HashGrid.SetStagedEntity(FirstStagedIndex + EntityIndex, Context.GetEntity(EntityIndex), CollisionFragment.HashGridCells, SnapshotData);
+		}
+	});
 	
-	HashGrid->DataLock.Unlock();
+	HashGrid.EndParallelStaging();
+
+	HashGrid.DataLock.Lock();
+	HashGrid.ClearCells();
+	HashGrid.CommitDenseStorage();
+	HashGrid.DataLock.Unlock();
 }
 
+void UCCSEntitiesHashGridProcessor::UpdateHashGridIncrementally(FMassEntityManager& EntityManager, FMassExecutionContext& Context, UCCSEntitiesHashGrid& HashGrid)
+{
+	EntityQuery.ForEachEntityChunk(EntityManager, Context, [&HashGrid](FMassExecutionContext& Context)
+	{
+		const int32 NumEntities                            = Context.GetNumEntities();
+		const TArrayView<FTransformFragment> TransformList = Context.GetMutableFragmentView<FTransformFragment>();
+		const TArrayView<FAgentRadiusFragment> RadiusList  = Context.GetMutableFragmentView<FAgentRadiusFragment>();
+		const TArrayView<FCollisionFragment> CollisionList = Context.GetMutableFragmentView<FCollisionFragment>();
+		
+		for (int32 EntityIndex = 0; EntityIndex < NumEntities; ++EntityIndex)
+		{
+			const FVector& EntityLocation         = TransformList[EntityIndex].GetTransform().GetLocation();
+			FCollisionFragment& CollisionFragment = CollisionList[EntityIndex];
+			const FGridBounds NewCells            = HashGrid.GetCellsInRadius(EntityLocation, RadiusList[EntityIndex].Radius);
+			
+			if (CollisionFragment.bInHashGrid && CollisionFragment.HashGridCells == NewCells)
+			{
+				continue;	// Most of the time entities stay in the same cells
+			}
+
+			const FMassEntityHandle Entity = Context.GetEntity(EntityIndex);
+			if (CollisionFragment.bInHashGrid)
+			{
+				HashGrid.RemoveEntityFromCells(CollisionFragment.HashGridCells, Entity);
+			}
+			HashGrid.AddEntityInCells(NewCells, Entity);
+			CollisionFragment.HashGridCells = NewCells;
+			CollisionFragment.bInHashGrid   = true;
+		}
+	});
+}
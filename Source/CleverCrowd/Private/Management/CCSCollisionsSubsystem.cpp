@@ -48,6 +48,7 @@ void UCCSCollisionsSubsystem::InitializeObstaclesOnMap()
 		FCCSObstacleEdge::ExtractEdgesFromBox(Edges, Obstacle->GetBoxComp());
 		ObstaclesHashGrid->AddObstacleEdges(Edges);
 	}
+	ObstaclesHashGrid->BakeEdgesIndex();
 
 	if (UE::CleverCrowd::Globals::bDrawDebugCollisionsCountsPeriodically)
 	{
@@ -55,6 +56,33 @@ void UCCSCollisionsSubsystem::InitializeObstaclesOnMap()
 	}
 }
 
+void UCCSCollisionsSubsystem::InitializeObstaclesDistanceField(const FGridBounds& Bounds)
+{
+	ObstaclesDistanceFieldBounds     = Bounds;
+	bObstaclesDistanceFieldBoundsSet = true;
+	if (!UE::CleverCrowd::Globals::bUseObstaclesDistanceField)
+	{
+		return;
+	}
+	
+	const FString MapName       = UWorld::RemovePIEPrefix(GetWorld()->GetMapName());
+	const FString CacheFilePath = FPaths::ProjectSavedDir() + "/SaveGame/ObstaclesDistanceField/" + MapName + ".bin";
+	ObstaclesDistanceField.BuildOrLoadCached(*ObstaclesHashGrid, Bounds, ObstaclesHashGrid->GetCellSize(), CacheFilePath);
+}
+
+bool UCCSCollisionsSubsystem::BuildObstaclesDistanceFieldIfNeeded()
+{
+	if (!bObstaclesDistanceFieldBoundsSet)
+	{
+		return false;
+	}
+	if (!ObstaclesDistanceField.IsBuilt())
+	{
+		ObstaclesDistanceField.Build(*ObstaclesHashGrid, ObstaclesDistanceFieldBounds, ObstaclesHashGrid->GetCellSize());
+	}
+	return true;
+}
+
 void UCCSCollisionsSubsystem::DrawDebugCollisionsCountsPeriodically()
 {
 	GetWorld()->GetTimerManager().SetTimer(DebugCollisionsCountTh, [this]()
@@ -62,7 +90,7 @@ void UCCSCollisionsSubsystem::DrawDebugCollisionsCountsPeriodically()
 		if (!IsValid(this) || !GetWorld()) return;
 		CollisionsHashGrid.DrawDebugDenseAreas(GetWorld(), CollisionsHashGrid.DecrementCollisionsCountRate - 0.1f, 8);
 		
-		for (const auto& [CellPos, Count] : CollisionsHashGrid.GetCollisionsInCells())
+		CollisionsHashGrid.ForEachCellWithCollisions([this](const FGridCellPosition& CellPos, const int32 Count)
 		{
 			const FVector Loc         = UGridUtilsFunctionLibrary::GetGridCellLocationAtPosition(CellPos, 100);
 			float DebugLineLengthMult = FMath::GetMappedRangeValueClamped(
@@ -74,6 +102,6 @@ void UCCSCollisionsSubsystem::DrawDebugCollisionsCountsPeriodically()
 
 			DrawDebugLine(GetWorld(), Loc, Loc + FVector::UpVector * DebugLineLengthMult * 500.f, HeatmappedColor, false,
 			              CollisionsHashGrid.DecrementCollisionsCountRate, 0, 10.f);
-		}
+		});
 	}, CollisionsHashGrid.DecrementCollisionsCountRate, true);
 }
@@ -7,6 +7,7 @@
 #include "MassSpawner.h"
 #include "Common/Clusters/CrowdClusterTypes.h"
 #include "Entity/EntityNotifierSubsystem.h"
+#include "Global/CleverCrowdGlobals.h"
 #include "Global/CrowdStatisticsSubsystem.h"
 #include "Grids/GridUtilsFunctionLibrary.h"
 #include "HashGrid/CCSEntitiesHashGrid.h"
@@ -31,14 +32,19 @@ void UCCSEntitiesManagerSubsystem::PostInitialize()
 
 	EntitiesHashGrid = NewObject<UCCSEntitiesHashGrid>(this);
 	EntitiesHashGrid->EntityManager = GetEntityManager();
+	if (UE::CleverCrowd::Globals::bUseIncrementalHashGridUpdates)
+	{
+		EntitiesHashGrid->SetUpdateMode(EEntitiesHashGridUpdateMode::Incremental);
+	}
 
 	CrowdStatistics = GetWorld()->GetSubsystem<UCrowdStatisticsSubsystem>();
 	EntityNotifier  = GetWorld()->GetSubsystem<UEntityNotifierSubsystem>();
-	EntityNotifier->PreDestroyEntityDelegate.BindLambda([this](const FMassEntityHandle& Entity)
+	EntityNotifier->PreDestroyEntityDelegate.AddLambda([this](const FMassEntityHandle& Entity)
 	{
 		FClusterFragment& ClusterFragment = EntityManager->GetFragmentDataChecked<FClusterFragment>(Entity);
 		CrowdStatistics->Stats.ReachedFinishTimestamps.Add(GetWorld()->GetTimeSeconds());
 		CrowdStatistics->Stats.RemoveAgentsCountInCluster(ClusterFragment.ClusterType, 1);
+		EntitiesHashGrid->RemoveEntity(Entity);
 	});
 }
 
@@ -87,7 +93,7 @@ void UCCSEntitiesManagerSubsystem::SetDetourEnabledForEntitiesInBounds(const FGr
 
 void UCCSEntitiesManagerSubsystem::SetDetourEnabledForAllEntities(bool bEnabled)
 {
-	EntitiesHashGrid->ForEachNonEmptyCell([this, bEnabled](const FGridCellPosition& CellPosition, const TArray<FMassEntityHandle>& Entities,
+	EntitiesHashGrid->ForEachNonEmptyCell([this, bEnabled](const FGridCellPosition& CellPosition, TConstArrayView<FMassEntityHandle> Entities,
 		FMassEntityManager& EntityManager)
 	{
 		for (const FMassEntityHandle& Entity : Entities)
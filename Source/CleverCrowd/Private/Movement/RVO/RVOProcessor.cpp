@@ -9,19 +9,37 @@
 #include "MassMovementFragments.h"
 #include "MassNavigationUtils.h"
 #include "OrcaSolver.h"
+#include "Algo/Reverse.h"
+#include "Algo/Unique.h"
+#include "Async/ParallelFor.h"
 #include "Collisions/CollisionsFragments.h"
+#include "Collisions/Obstacles/CCSObstaclesHashGrid.h"
 #include "Common/Clusters/CrowdClusterTypes.h"
+#include "Entity/EntityNotifierSubsystem.h"
+#include "Global/CleverCrowdGlobals.h"
 #include "Global/CrowdStatisticsSubsystem.h"
+#include "Grids/GridUtilsFunctionLibrary.h"
 #include "HashGrid/CCSEntitiesHashGrid.h"
 #include "Management/CCSCollisionsSubsystem.h"
 #include "Management/CCSEntitiesManagerSubsystem.h"
 
+namespace
+{
+	FVector2f ClosestPointOnEdge(const FVector2f& Point, const FCCSBakedObstacleEdge& Edge)
+	{
+		const FVector2f Segment   = Edge.End - Edge.Start;
+		const float SegmentSizeSq = Segment.SizeSquared();
+		const float T             = SegmentSizeSq > 0.f ? FVector2f::DotProduct(Point - Edge.Start, Segment) / SegmentSizeSq : 0.f;
+		return Edge.Start + Segment * FMath::Clamp(T, 0.f, 1.f);
+	}
+}
+
 URVOProcessor::URVOProcessor()
 {
 	bAutoRegisterWithProcessingPhases = true;
 	ExecutionFlags = (int32)EProcessorExecutionFlags::All;
 	ExecutionOrder.ExecuteInGroup = UE::Mass::ProcessorGroupNames::Avoidance;
-	bRequiresGameThreadExecution = true;
+	bRequiresGameThreadExecution = false;
 }
 
 void URVOProcessor::ConfigureQueries()
@@ -33,6 +51,10 @@ void URVOProcessor::ConfigureQueries()
 	EntityQuery.AddRequirement<FClusterFragment>(EMassFragmentAccess::ReadOnly);
 
 	EntityQuery.RegisterWithProcessor(*this);
+
+	ProcessorRequirements.AddSubsystemRequirement<UCCSEntitiesManagerSubsystem>(EMassFragmentAccess::ReadOnly);
+	ProcessorRequirements.AddSubsystemRequirement<UCCSCollisionsSubsystem>(EMassFragmentAccess::ReadWrite);
+	ProcessorRequirements.AddSubsystemRequirement<UCrowdStatisticsSubsystem>(EMassFragmentAccess::ReadWrite);
 }
 
 void URVOProcessor::Initialize(UObject& Owner)
@@ -43,25 +65,36 @@ void URVOProcessor::Initialize(UObject& Owner)
 	CrowdStatisticsSubsystem = GetWorld()->GetSubsystem<UCrowdStatisticsSubsystem>();
 	EntitiesManagerSubsystem = GetWorld()->GetSubsystem<UCCSEntitiesManagerSubsystem>();
 	CollisionsSubsystem      = GetWorld()->GetSubsystem<UCCSCollisionsSubsystem>();
+	OrcaSolver               = NewObject<UOrcaSolver>(this);
+
+	GetWorld()->GetSubsystem<UEntityNotifierSubsystem>()->PreDestroyEntityDelegate.AddUObject(this, &URVOProcessor::OnPreDestroyEntity);
 }
 
 void URVOProcessor::Execute(FMassEntityManager& EntityManager, FMassExecutionContext& Context)
 {
-	constexpr int ClusterSize = 2;
-	float CurrentTime = GetWorld()->GetTimeSeconds();
-	float DeltaTime = GetWorld()->DeltaTimeSeconds;
+	const float CurrentTime = GetWorld()->GetTimeSeconds();	// Read once, the world time doesn't change during the processing phase
+	const float DeltaTime   = Context.GetDeltaTimeSeconds();
 
 	const bool bUseToTheSideAvoidance = (EntitiesManagerSubsystem->AvoidanceType == 0);
 	const bool bUseSimpleAvoidance    = (EntitiesManagerSubsystem->AvoidanceType == 1);
 	const bool bUseORCA               = (EntitiesManagerSubsystem->AvoidanceType == 2);
+	const bool bUsePredictive         = (EntitiesManagerSubsystem->AvoidanceType == 3);
 	
-	if (bUseORCA && !IsValid(OrcaSolver))
+	if (bUseORCA && !bOrcaSolverInitialized)
 	{
 		InitializeOrcaSolver();
 	}
+	if (bUseORCA)
+	{
+		// Agents that are not updated this tick keep their solver positions
+		OrcaPositions.SetNumUninitialized(OrcaSolver->GetAgentsNum());
+		OrcaSolver->GetAgentPositions(OrcaPositions);
+		OrcaPrefVelocities.Reset();
+		OrcaPrefVelocities.SetNumZeroed(OrcaPositions.Num());
+	}
 
-	// Update ORCA data and do To-The-Side-Avoidance
-	EntityQuery.ForEachEntityChunk(EntityManager, Context, [&, this](FMassExecutionContext& Context)
+	// Update ORCA data and do To-The-Side-Avoidance. Existing agents have their own indices, so their data is written from any thread.
+	EntityQuery.ParallelForEachEntityChunk(EntityManager, Context, [&, this](FMassExecutionContext& Context)
 	{
 		const int32 NumEntities                            = Context.GetNumEntities();
 		const TArrayView<FTransformFragment> TransformList = Context.GetMutableFragmentView<FTransformFragment>();
@@ -76,17 +109,20 @@ void URVOProcessor::Execute(FMassEntityManager& EntityManager, FMassExecutionCon
 			FMassForceFragment& ForceFragment     = ForceList[EntityIndex];
 			FClusterFragment& ClusterFragment     = ClusterList[EntityIndex];
 
-			if (bUseORCA)
+			if (bUseORCA && !DestroyedOrcaEntities.Contains(Context.GetEntity(EntityIndex)))
 			{
-				if (!bInitializedOrcaAgents)
+				if (CollisionFragment.OrcaIndex == INDEX_NONE)
 				{
-					CollisionFragment.OrcaIndex = OrcaSolver->AddAgent(TransformFragment.GetTransform().GetLocation());
-				}
-				else
-				{
-					OrcaSolver->SetAgentLocation(CollisionFragment.OrcaIndex, TransformFragment.GetTransform().GetLocation());
+					NewOrcaEntitiesLock.Lock();
+					NewOrcaEntities.Add(Context.GetEntity(EntityIndex));
+					NewOrcaEntitiesLock.Unlock();
+					continue;
 				}
-				OrcaSolver->SetPreferredVelocity(CollisionFragment.OrcaIndex, ForceFragment.Value.GetSafeNormal());
+
+				const FVector& Location                        = TransformFragment.GetTransform().GetLocation();
+				const FVector PrefVelocity                     = ForceFragment.Value.GetSafeNormal();
+				OrcaPositions[CollisionFragment.OrcaIndex]     = FVector2f{static_cast<float>(Location.X), static_cast<float>(Location.Y)};
+				OrcaPrefVelocities[CollisionFragment.OrcaIndex] = FVector2f{static_cast<float>(PrefVelocity.X), static_cast<float>(PrefVelocity.Y)};
 			}
 
 			if (bUseToTheSideAvoidance)
@@ -99,7 +135,7 @@ void URVOProcessor::Execute(FMassEntityManager& EntityManager, FMassExecutionCon
 
 				if (ToTheSideAvoidanceDuration >= 0.05f)
 				{
-					DoToTheSideAvoidance(CollisionFragment, ForceFragment.Value, TransformFragment.GetMutableTransform(), Context, ToTheSideAvoidanceDuration, DeltaTime);
+					DoToTheSideAvoidance(CollisionFragment, ForceFragment.Value, Context.GetEntity(EntityIndex), ToTheSideAvoidanceDuration, DeltaTime);
 				}
 			}
 		}
@@ -108,8 +144,26 @@ void URVOProcessor::Execute(FMassEntityManager& EntityManager, FMassExecutionCon
 	// Update agents locations with Orca solver
 	if (bUseORCA)
 	{
+		AddNewOrcaAgents(EntityManager);
+		RemoveDeletedOrcaAgents(EntityManager);
+		OrcaSolver->SetAgentStates(OrcaPositions, OrcaPrefVelocities);
 		OrcaSolver->SetTimeStep(DeltaTime);
-		OrcaSolver->DoStep();
+		
+		const bool bUseHashGridNeighbours = UE::CleverCrowd::Globals::bUseHashGridForOrcaNeighbours && EntitiesHashGrid->HasSnapshot();
+		if (bUseHashGridNeighbours)
+		{
+			EntitiesHashGrid->DataLock.Lock();
+			SetOrcaNeighboursFromSnapshot(EntityManager);
+			OrcaSolver->DoStep();
+			EntitiesHashGrid->DataLock.Unlock();
+		}
+		else
+		{
+			OrcaSolver->ResetNeighbourCandidatesProvider();
+			OrcaSolver->DoStep();
+		}
+		OrcaSolver->GetAgentPositions(OrcaPositions);
+		CrowdStatisticsSubsystem->Stats.OrcaAgentTreeTime.AddValue(OrcaSolver->GetLastAgentTreeTime());
 		
 		EntityQuery.ForEachEntityChunk(EntityManager, Context, [&, this](FMassExecutionContext& Context)
 		{
@@ -121,80 +175,248 @@ void URVOProcessor::Execute(FMassEntityManager& EntityManager, FMassExecutionCon
 			{
 				FTransformFragment& TransformFragment = TransformList[EntityIndex];
 				FCollisionFragment& CollisionFragment = CollisionList[EntityIndex];
+				if (CollisionFragment.OrcaIndex == INDEX_NONE)
+				{
+					continue;
+				}
 
-				const FVector& OldLocation = TransformFragment.GetMutableTransform().GetLocation();
-				FVector NewLocation        = OrcaSolver->GetAgentLocation(CollisionFragment.OrcaIndex);
+				const FVector& OldLocation   = TransformFragment.GetMutableTransform().GetLocation();
+				const FVector2f& NewLocation = OrcaPositions[CollisionFragment.OrcaIndex];
 				TransformFragment.GetMutableTransform().SetLocation(FVector{NewLocation.X, NewLocation.Y, OldLocation.Z});
 			}
 		});
 	}
-
-	bInitializedOrcaAgents = true;
+	DestroyedOrcaEntities.Reset();
 
 	// Simple custom avoidance
 	if (bUseSimpleAvoidance)
 	{
-		EntitiesHashGrid->ParallelForEachNonEmptyCell([&, this](const FGridCellPosition& Cell)
+		if (EntitiesHashGrid->HasSnapshot())
+		{
+			DoSimpleAvoidanceWithSnapshot(EntityManager, CurrentTime);
+			DoSimpleAvoidanceOutsideSnapshot(EntityManager, CurrentTime);
+		}
+		else
 		{
-			TArray<FMassEntityHandle> Entities;
-			FGridBounds Bounds{Cell, Cell + FGridCellPosition{ClusterSize - 1, ClusterSize - 1}};
-			EntitiesHashGrid->GetEntitiesInBounds(Entities, Bounds); // Getting entities from 4 adjacent grid cells
+			DoSimpleAvoidanceWithHandles(EntityManager, CurrentTime);
+		}
+	}
 
-			const int32 EntitiesNum = Entities.Num();
-			for (int32 EntityIndex = 0; EntityIndex < EntitiesNum; ++EntityIndex)
-			{
-				FTransform& Transform                 = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entities[EntityIndex]).GetMutableTransform();
-				const float Radius                    = EntityManager.GetFragmentDataChecked<FAgentRadiusFragment>(Entities[EntityIndex]).Radius;
-				FVector& Force                        = EntityManager.GetFragmentDataChecked<FMassForceFragment>(Entities[EntityIndex]).Value;
-				FCollisionFragment& CollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entities[EntityIndex]);
-				FClusterFragment& ClusterFragment     = EntityManager.GetFragmentDataChecked<FClusterFragment>(Entities[EntityIndex]);
-				const FVector& Location               = Transform.GetLocation();
-				FVector Location2D                    = FVector{Location.X, Location.Y, 0.f};
-
-				float AvoidanceRadius   = EntitiesManagerSubsystem->AvoidanceRadiusInClusters[ClusterFragment.ClusterType];
-				float AvoidanceStrength = EntitiesManagerSubsystem->AvoidanceStrengthInClusters[ClusterFragment.ClusterType];
-				if (ClusterFragment.AreaId > INDEX_NONE)
-				{
-					AvoidanceRadius   = EntitiesManagerSubsystem->AvoidanceRadiusInAreas[ClusterFragment.AreaId];
-					AvoidanceStrength = EntitiesManagerSubsystem->AvoidanceStrengthInAreas[ClusterFragment.AreaId];
-				}
+	// Predictive avoidance needs neighbours velocities, which only the snapshot pass gathers. Falls back to the simple avoidance without it.
+	if (bUsePredictive)
+	{
+		if (EntitiesHashGrid->HasSnapshot())
+		{
+			DoPredictiveAvoidance(EntityManager, Context);
+			DoSimpleAvoidanceOutsideSnapshot(EntityManager, CurrentTime);
+		}
+		else
+		{
+			DoSimpleAvoidanceWithHandles(EntityManager, CurrentTime);
+		}
+	}
+}
 
-				if (AvoidanceRadius <= 1.f || AvoidanceStrength <= 0.01f)
-				{
-					continue;
-				}
+void URVOProcessor::DoSimpleAvoidanceWithHandles(FMassEntityManager& EntityManager, float CurrentTime)
+{
+	constexpr int ClusterSize = 2;
+	
+	EntitiesHashGrid->ParallelForEachNonEmptyCell([&, this](const FGridCellPosition& Cell)
+	{
+		TArray<FMassEntityHandle> Entities;
+		FGridBounds Bounds{Cell, Cell + FGridCellPosition{ClusterSize - 1, ClusterSize - 1}};
+		EntitiesHashGrid->GetEntitiesInBounds(Entities, Bounds); // Getting entities from 4 adjacent grid cells
+
+		for (const FMassEntityHandle& Entity : Entities)
+		{
+			DoEntitySimpleAvoidanceWithHandles(EntityManager, Entity, Entities, CurrentTime);
+		}
+	});
+}
+
+void URVOProcessor::DoSimpleAvoidanceOutsideSnapshot(FMassEntityManager& EntityManager, float CurrentTime)
+{
+	EntitiesHashGrid->DataLock.Lock();
 
-				FEntityProxyData EntityData{
-					Transform, Location2D, Radius, Force, CollisionFragment, ClusterFragment
-				};
+	const TConstArrayView<FMassEntityHandle> EntitiesOutsideSnapshot = EntitiesHashGrid->GetEntitiesOutsideSnapshot();
+	ParallelFor(EntitiesOutsideSnapshot.Num(), [this, &EntityManager, &EntitiesOutsideSnapshot, CurrentTime](const int32 Index)
+	{
+		const FMassEntityHandle Entity = EntitiesOutsideSnapshot[Index];
+		if (!EntityManager.IsEntityValid(Entity))
+		{
+			return;
+		}
 
-				for (int32 OtherEntityIndex = 0; OtherEntityIndex < EntitiesNum; ++OtherEntityIndex)
+		const FClusterFragment& ClusterFragment = EntityManager.GetFragmentDataChecked<FClusterFragment>(Entity);
+		float AvoidanceRadius, AvoidanceStrength;
+		GetAvoidanceParameters(ClusterFragment.ClusterType, ClusterFragment.AreaId, AvoidanceRadius, AvoidanceStrength);
+		if (AvoidanceRadius <= 0.f)
+		{
+			return;
+		}
+
+		// Entities of all cells within the avoidance radius, both sparse and dense. An entity is stored in every cell it overlaps, so duplicates are dropped.
+		const FVector& Location = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entity).GetTransform().GetLocation();
+		TArray<FMassEntityHandle> Neighbours;
+		EntitiesHashGrid->GetEntitiesInBounds(Neighbours, EntitiesHashGrid->GetCellsInRadius(Location, AvoidanceRadius));
+		Neighbours.Sort([](const FMassEntityHandle& A, const FMassEntityHandle& B) { return A.Index < B.Index; });
+		Neighbours.SetNum(Algo::Unique(Neighbours), EAllowShrinking::No);
+		DoEntitySimpleAvoidanceWithHandles(EntityManager, Entity, Neighbours, CurrentTime);
+	});
+
+	EntitiesHashGrid->DataLock.Unlock();
+}
+
+void URVOProcessor::DoEntitySimpleAvoidanceWithHandles(FMassEntityManager& EntityManager, const FMassEntityHandle& Entity, TConstArrayView<FMassEntityHandle> Neighbours,
+                                                       float CurrentTime)
+{
+	if (!EntityManager.IsEntityValid(Entity))
+	{
+		return;
+	}
+	
+	FTransform& Transform                 = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entity).GetMutableTransform();
+	const float Radius                    = EntityManager.GetFragmentDataChecked<FAgentRadiusFragment>(Entity).Radius;
+	FVector& Force                        = EntityManager.GetFragmentDataChecked<FMassForceFragment>(Entity).Value;
+	FCollisionFragment& CollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entity);
+	FClusterFragment& ClusterFragment     = EntityManager.GetFragmentDataChecked<FClusterFragment>(Entity);
+	const FVector& Location               = Transform.GetLocation();
+	FVector Location2D                    = FVector{Location.X, Location.Y, 0.f};
+
+	float AvoidanceRadius, AvoidanceStrength;
+	GetAvoidanceParameters(ClusterFragment.ClusterType, ClusterFragment.AreaId, AvoidanceRadius, AvoidanceStrength);
+	if (AvoidanceRadius <= 0.f)
+	{
+		return;
+	}
+
+	FEntityProxyData EntityData{
+		Transform, Location2D, Radius, Force, CollisionFragment, ClusterFragment
+	};
+
+	for (const FMassEntityHandle& OtherEntity : Neighbours)
+	{
+		if (!EntityManager.IsEntityValid(OtherEntity) || Entity == OtherEntity)
+		{
+			continue;
+		}
+
+		FTransform& OtherTransform = EntityManager.GetFragmentDataChecked<FTransformFragment>(OtherEntity).GetMutableTransform();
+		const float OtherRadius = EntityManager.GetFragmentDataChecked<FAgentRadiusFragment>(OtherEntity).Radius;
+		FVector& OtherForce = EntityManager.GetFragmentDataChecked<FMassForceFragment>(OtherEntity).Value;
+		FCollisionFragment& OtherCollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(OtherEntity);
+		FClusterFragment& OtherClusterFragment = EntityManager.GetFragmentDataChecked<FClusterFragment>(OtherEntity);
+		const FVector& OtherLocation = OtherTransform.GetLocation();
+		FVector OtherLocation2D = FVector{OtherLocation.X, OtherLocation.Y, 0.f};
+
+		FEntityProxyData OtherEntityData{
+			OtherTransform, OtherLocation2D, OtherRadius, OtherForce, OtherCollisionFragment, OtherClusterFragment
+		};
+
+		DoSimpleAvoidance(EntityData, OtherEntityData, AvoidanceRadius, AvoidanceStrength, CurrentTime);
+	}
+}
+
+void URVOProcessor::DoSimpleAvoidanceWithSnapshot(FMassEntityManager& EntityManager, float CurrentTime)
+{
+	EntitiesHashGrid->DataLock.Lock();
+
+	const FCCSEntitiesSnapshot& Snapshot                      = EntitiesHashGrid->GetSnapshot();
+	const TConstArrayView<FMassEntityHandle> SnapshotEntities = EntitiesHashGrid->GetSnapshotEntities();
+	AvoidanceResults.Reset();
+	AvoidanceResults.SetNumZeroed(Snapshot.Num());
+
+	// Rotation of the avoidance direction by 20 degrees of yaw, same as in DoSimpleAvoidance()
+	float AvoidanceSin, AvoidanceCos;
+	FMath::SinCos(&AvoidanceSin, &AvoidanceCos, FMath::DegreesToRadians(20.f));
+
+	// Every entity gathers home slots of the cells within its avoidance radius, which is wider than the adjacent cells the half-shell
+	// pairs reach. Results are written only into the entity's own slot.
+	ParallelFor(Snapshot.Num(), [this, &Snapshot, &SnapshotEntities, AvoidanceSin, AvoidanceCos](const int32 Slot)
+	{
+		if (!Snapshot.bHomeCell[Slot] || !SnapshotEntities[Slot].IsSet())
+		{
+			return;	// Other cells of the entity, or the entity was removed
+		}
+
+		float AvoidanceRadius, AvoidanceStrength;
+		GetAvoidanceParameters(Snapshot.ClusterType[Slot], Snapshot.AreaId[Slot], AvoidanceRadius, AvoidanceStrength);
+		if (AvoidanceRadius <= 0.f)
+		{
+			return;
+		}
+
+		FAvoidanceResult& Result = AvoidanceResults[Slot];
+		const float X            = Snapshot.X[Slot];
+		const float Y            = Snapshot.Y[Slot];
+		const FGridBounds Cells  = EntitiesHashGrid->GetCellsInRadius(FVector{X, Y, 0.f}, AvoidanceRadius);
+		for (int32 Row = Cells.BottomLeftCell.Y; Row <= Cells.TopRightCell.Y; Row++)
+		{
+			for (int32 Col = Cells.BottomLeftCell.X; Col <= Cells.TopRightCell.X; Col++)
+			{
+				const FCCSDenseSlotsRange OtherSlots = EntitiesHashGrid->GetDenseHomeSlotsInCell(FGridCellPosition{Col, Row});
+				for (int32 OtherSlot = OtherSlots.Start; OtherSlot < OtherSlots.End; ++OtherSlot)
 				{
-					if (Entities[EntityIndex] == Entities[OtherEntityIndex])
+					const float RelativeX = Snapshot.X[OtherSlot] - X;
+					const float RelativeY = Snapshot.Y[OtherSlot] - Y;
+					const float Distance  = FMath::Sqrt(RelativeX * RelativeX + RelativeY * RelativeY);
+					if (Distance == 0.f || Distance > AvoidanceRadius)
 					{
-						continue;
+						continue;	// Also the entity itself
 					}
 
-					FTransform& OtherTransform = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entities[OtherEntityIndex]).GetMutableTransform();
-					const float OtherRadius = EntityManager.GetFragmentDataChecked<FAgentRadiusFragment>(Entities[OtherEntityIndex]).Radius;
-					FVector& OtherForce = EntityManager.GetFragmentDataChecked<FMassForceFragment>(Entities[OtherEntityIndex]).Value;
-					FCollisionFragment& OtherCollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entities[OtherEntityIndex]);
-					FClusterFragment& OtherClusterFragment = EntityManager.GetFragmentDataChecked<FClusterFragment>(Entities[OtherEntityIndex]);
-					const FVector& OtherLocation = OtherTransform.GetLocation();
-					FVector OtherLocation2D = FVector{OtherLocation.X, OtherLocation.Y, 0.f};
-
-					FEntityProxyData OtherEntityData{
-						OtherTransform, OtherLocation2D, OtherRadius, OtherForce, OtherCollisionFragment, OtherClusterFragment
-					};
-
-					DoSimpleAvoidance(EntityData, OtherEntityData, AvoidanceRadius, AvoidanceStrength, DeltaTime);
+					// Direction is normalized and divided by distance at once
+					const float Scale  = AvoidanceStrength / (Distance * Distance);
+					Result.ForceDelta -= FVector2f{(RelativeX * AvoidanceCos - RelativeY * AvoidanceSin) * Scale, (RelativeX * AvoidanceSin + RelativeY * AvoidanceCos) * Scale};
+					Result.bAvoided    = true;
 				}
 			}
-		});
+		}
+	});
+
+	// Scatter results back into fragments. Every entity has one home slot, so there are no concurrent writes into the same entity.
+	ParallelFor(Snapshot.Num(), [&, this](const int32 Slot)
+	{
+		const FAvoidanceResult& Result = AvoidanceResults[Slot];
+		const FMassEntityHandle Entity = SnapshotEntities[Slot];
+		if (!Result.bAvoided || !EntityManager.IsEntityValid(Entity))
+		{
+			return;
+		}
+
+		FVector& Force = EntityManager.GetFragmentDataChecked<FMassForceFragment>(Entity).Value;
+		Force += FVector{Result.ForceDelta.X, Result.ForceDelta.Y, 0.f};
+
+		// Same as in DoSimpleAvoidance(), collisions counter is increased when avoiding
+		constexpr float MinCollisionCountRateForEntity = 2.f; // @warning: this value is copied from CollisionsProcessor
+		FCollisionFragment& CollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entity);
+		if (CurrentTime - CollisionFragment.LastCollisionCountTime > MinCollisionCountRateForEntity)
+		{
+			CollisionFragment.LastCollisionCountTime = CurrentTime;
+			CollisionsSubsystem->GetCollisionsHashGrid().AddCollisionsCountAtLocation(FVector{Snapshot.X[Slot], Snapshot.Y[Slot], 0.f}, 1);
+		}
+	});
+
+	EntitiesHashGrid->DataLock.Unlock();
+}
+
+void URVOProcessor::GetAvoidanceParameters(const int32 ClusterType, const int32 AreaId, float& OutRadius, float& OutStrength) const
+{
+	OutRadius   = EntitiesManagerSubsystem->AvoidanceRadiusInClusters[ClusterType];
+	OutStrength = EntitiesManagerSubsystem->AvoidanceStrengthInClusters[ClusterType];
+	if (AreaId > INDEX_NONE)
+	{
+		OutRadius   = EntitiesManagerSubsystem->AvoidanceRadiusInAreas[AreaId];
+		OutStrength = EntitiesManagerSubsystem->AvoidanceStrengthInAreas[AreaId];
+	}
+
+	if (OutRadius <= 1.f || OutStrength <= 0.01f)
+	{
+		OutRadius = 0.f;
 	}
 }
 
-void URVOProcessor::DoSimpleAvoidance(FEntityProxyData& EntityData, FEntityProxyData& OtherEntityData, float AvoidanceRadius, float AvoidanceStrength, float DeltaTime)
+void URVOProcessor::DoSimpleAvoidance(FEntityProxyData& EntityData, FEntityProxyData& OtherEntityData, float AvoidanceRadius, float AvoidanceStrength, float CurrentTime)
 {
 	FVector RelativeLocation = OtherEntityData.Location - EntityData.Location;
 	float Distance = RelativeLocation.Length();
@@ -210,7 +432,6 @@ void URVOProcessor::DoSimpleAvoidance(FEntityProxyData& EntityData, FEntityProxy
 
 	// Currently we increase the collisions counter when avoiding - to search for dense crowd areas more effectively.
 	// Note that we don't add collision to statistics here, unlike we do in CollisionsProcessor.
-	float CurrentTime = GetWorld()->GetTimeSeconds();
 	constexpr float MinCollisionCountRateForEntity = 2.f; // @warning: this value is copied from CollisionsProcessor
 	if (CurrentTime - EntityData.CollisionFragment.LastCollisionCountTime > MinCollisionCountRateForEntity)
 	{
@@ -219,8 +440,8 @@ void URVOProcessor::DoSimpleAvoidance(FEntityProxyData& EntityData, FEntityProxy
 	}
 }
 
-void URVOProcessor::DoToTheSideAvoidance(FCollisionFragment& CollisionFragment, FVector& Force, FTransform& Transform, FMassExecutionContext& Context,
-                                         float Duration, float DeltaTime)
+void URVOProcessor::DoToTheSideAvoidance(FCollisionFragment& CollisionFragment, FVector& Force, const FMassEntityHandle& Entity, float Duration,
+                                         float DeltaTime)
 {
 	constexpr float TurnDegree = 40.f;
 
@@ -247,141 +468,399 @@ void URVOProcessor::DoToTheSideAvoidance(FCollisionFragment& CollisionFragment,
 		return;
 	}
 
-	// Start avoiding to random side
-	CollisionFragment.bAvoidToTheRight       = FMath::RandBool();
+	// Start avoiding to random side. The stream is seeded from the entity handle on the first use.
+	if (CollisionFragment.AvoidanceRandomSeed == 0)
+	{
+		CollisionFragment.AvoidanceRandomSeed = static_cast<int32>(GetTypeHash(Entity) | 1u);
+	}
+	FRandomStream RandomStream{CollisionFragment.AvoidanceRandomSeed};
+	CollisionFragment.bAvoidToTheRight       = RandomStream.FRand() < 0.5f;
+	CollisionFragment.AvoidanceRandomSeed    = RandomStream.GetCurrentSeed();
 	CollisionFragment.AvoidingToSideTimeLeft = Duration;
 	AvoidLambda(CollisionFragment, Force);
-	//DrawDebugLine(Context.GetWorld(), Transform.GetLocation(), Transform.GetLocation() + FVector::UpVector * 1000.f, FColor::Yellow, false, 2.f, 0, 10.f);
 }
 
 void URVOProcessor::InitializeOrcaSolver()
 {
 	const FOrcaDefaultAgentParams AgentDefaults;
 	
-	OrcaSolver = NewObject<UOrcaSolver>();
 	OrcaSolver->Initialize(AgentDefaults);
+	bOrcaSolverInitialized = true;
+
+	const UCCSObstaclesHashGrid* ObstaclesHashGrid = CollisionsSubsystem->GetObstaclesHashGrid();
+	if (!ObstaclesHashGrid || !ObstaclesHashGrid->IsEdgesIndexBaked())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Obstacles are not initialized, ORCA agents won't avoid them."), __FUNCTION__);
+		return;
+	}
+	AddObstaclesToOrcaSolver(*OrcaSolver, *ObstaclesHashGrid);
+	OrcaSolver->ProcessObstacles();
 }
 
+void URVOProcessor::AddObstaclesToOrcaSolver(UOrcaSolver& Solver, const UCCSObstaclesHashGrid& ObstaclesHashGrid)
+{
+	constexpr float VertexTolerance = 0.1f;
+	
+	// Edges of one obstacle are added one after another, each edge starts where the previous one ends
+	const TConstArrayView<FCCSBakedObstacleEdge> Edges = ObstaclesHashGrid.GetBakedEdges();
+	TArray<FVector2f> Vertices;
+	int32 FirstEdgeIndex = 0;
+	while (FirstEdgeIndex < Edges.Num())
+	{
+		int32 LastEdgeIndex = FirstEdgeIndex;
+		bool bClosed        = false;
+		while (LastEdgeIndex + 1 < Edges.Num() && Edges[LastEdgeIndex].End.Equals(Edges[LastEdgeIndex + 1].Start, VertexTolerance))
+		{
+			++LastEdgeIndex;
+			bClosed = Edges[LastEdgeIndex].End.Equals(Edges[FirstEdgeIndex].Start, VertexTolerance);
+			if (bClosed)
+			{
+				break;
+			}
+		}
+
+		Vertices.Reset();
+		if (bClosed && LastEdgeIndex > FirstEdgeIndex + 1)
+		{
+			float DoubleSignedArea = 0.f;
+			for (int32 EdgeIndex = FirstEdgeIndex; EdgeIndex <= LastEdgeIndex; ++EdgeIndex)
+			{
+				Vertices.Add(Edges[EdgeIndex].Start);
+				DoubleSignedArea += FVector2f::CrossProduct(Edges[EdgeIndex].Start, Edges[EdgeIndex].End);
+			}
+			if (DoubleSignedArea < 0.f)
+			{
+				Algo::Reverse(Vertices);	// ORCA expects solid obstacles in counterclockwise order
+			}
+			Solver.AddObstacle(Vertices);
+		}
+		else
+		{
+			for (int32 EdgeIndex = FirstEdgeIndex; EdgeIndex <= LastEdgeIndex; ++EdgeIndex)
+			{
+				Vertices = {Edges[EdgeIndex].Start, Edges[EdgeIndex].End};
+				Solver.AddObstacle(Vertices);
+			}
+		}
 
-// ToDo: implement
-void URVOProcessor::DoMassORCA(FEntityProxyData& EntityData, TArray<FEntityProxyData>& OtherEntityDatas, float AvoidanceRadius, float AvoidanceStrength, float DeltaTime)
+		FirstEdgeIndex = LastEdgeIndex + 1;
+	}
+}
+
+void URVOProcessor::AddNewOrcaAgents(FMassEntityManager& EntityManager)
 {
-	// const FVector DesAcc = UE::MassNavigation::ClampVector(SteeringForce, MaxSteerAccel);
-	// const FVector DesVel = UE::MassNavigation::ClampVector(AgentVelocity + DesAcc * DeltaTime, MaximumSpeed);
-	//
-	// for (const FCollider& Collider : Colliders)
-	// {
-	// 	bool bHasForcedNormal = false;
-	// 	FVector ForcedNormal  = FVector::ZeroVector;
-	//
-	// 	if (Collider.bCanAvoid == false)
-	// 	{
-	// 		// If the other obstacle cannot avoid us, try to avoid the local minima they create between the wall and their collider.
-	// 		// If the space between edge and collider is less than MinClearance, make the agent to avoid the gap.
-	// 		const FVector::FReal MinClearance = 2. * AgentRadius * MovingAvoidanceParams.StaticObstacleClearanceScale;
-	//
-	// 		// Find the maximum distance from edges that are too close.
-	// 		FVector::FReal MaxDist = -1.;
-	// 		FVector ClosestPoint   = FVector::ZeroVector;
-	// 		for (const FNavigationAvoidanceEdge& Edge : NavEdges.AvoidanceEdges)
-	// 		{
-	// 			const FVector Point  = FMath::ClosestPointOnSegment(Collider.Location, Edge.Start, Edge.End);
-	// 			const FVector Offset = Collider.Location - Point;
-	// 			if (FVector::DotProduct(Offset, Edge.LeftDir) < 0.)
-	// 			{
-	// 				// Behind the edge, ignore.
-	// 				continue;
-	// 			}
-	//
-	// 			const FVector::FReal OffsetLength = Offset.Length();
-	// 			const bool bTooNarrow             = (OffsetLength - Collider.Radius) < MinClearance;
-	// 			if (bTooNarrow)
-	// 			{
-	// 				if (OffsetLength > MaxDist)
-	// 				{
-	// 					MaxDist      = OffsetLength;
-	// 					ClosestPoint = Point;
-	// 				}
-	// 			}
-	// 		}
-	//
-	// 		if (MaxDist != -1.)
-	// 		{
-	// 			// Set up forced normal to avoid the gap between collider and edge.
-	// 			ForcedNormal     = (Collider.Location - ClosestPoint).GetSafeNormal();
-	// 			bHasForcedNormal = true;
-	// 		}
-	// 	}
-	//
-	// 	FVector RelPos               = AgentLocation - Collider.Location;
-	// 	RelPos.Z                     = 0.; // we assume we work on a flat plane for now
-	// 	const FVector RelVel         = DesVel - Collider.Velocity;
-	// 	const FVector::FReal ConDist = RelPos.Size();
-	// 	const FVector ConNorm        = ConDist > 0. ? RelPos / ConDist : FVector::ForwardVector;
-	//
-	// 	FVector SeparationNormal = ConNorm;
-	// 	if (bHasForcedNormal)
-	// 	{
-	// 		// The more head on the collisions is, the more we should avoid towards the forced direction.
-	// 		const FVector RelVelNorm   = RelVel.GetSafeNormal();
-	// 		const FVector::FReal Blend = FMath::Max(0., -FVector::DotProduct(ConNorm, RelVelNorm));
-	// 		SeparationNormal           = FMath::Lerp(ConNorm, ForcedNormal, Blend).GetSafeNormal();
-	// 	}
-	//
-	// 	const FVector::FReal StandingScaling = Collider.bIsMoving ? 1. : MovingAvoidanceParams.StandingObstacleAvoidanceScale;
-	// 	// Care less about standing agents so that we can push through standing crowd.
-	//
-	// 	// Separation force (stay away from agents if possible)
-	// 	const FVector::FReal PenSep        = (SeparationAgentRadius + Collider.Radius + MovingAvoidanceParams.ObstacleSeparationDistance) - ConDist;
-	// 	const FVector::FReal SeparationMag = FMath::Square(FMath::Clamp(PenSep / MovingAvoidanceParams.ObstacleSeparationDistance, 0., 1.));
-	// 	const FVector SepForce             = SeparationNormal * MovingAvoidanceParams.ObstacleSeparationStiffness;
-	// 	const FVector SeparationForce      = SepForce * SeparationMag * StandingScaling;
-	//
-	// 	SteeringForce += SeparationForce;
-	// 	TotalAgentSeparationForce += SeparationForce;
-	//
-	// 	// Calculate closest point of approach based on relative agent positions and velocities.
-	// 	const FVector::FReal CPA = UE::MassAvoidance::ComputeClosestPointOfApproach(RelPos, RelVel, PredictiveAvoidanceAgentRadius + Collider.Radius,
-	// 	                                                                            MovingAvoidanceParams.PredictiveAvoidanceTime);
-	//
-	// 	// Calculate penetration at CPA
-	// 	const FVector AvoidRelPos      = RelPos + RelVel * CPA;
-	// 	const FVector::FReal AvoidDist = AvoidRelPos.Size();
-	// 	const FVector AvoidConNormal   = AvoidDist > 0. ? (AvoidRelPos / AvoidDist) : FVector::ForwardVector;
-	//
-	// 	FVector AvoidNormal = AvoidConNormal;
-	// 	if (bHasForcedNormal)
-	// 	{
-	// 		// The more head on the predicted collisions is, the more we should avoid towards the forced direction.
-	// 		const FVector RelVelNorm   = RelVel.GetSafeNormal();
-	// 		const FVector::FReal Blend = FMath::Max(0., -FVector::DotProduct(AvoidConNormal, RelVelNorm));
-	// 		AvoidNormal                = FMath::Lerp(AvoidConNormal, ForcedNormal, Blend).GetSafeNormal();
-	// 	}
-	//
-	// 	const FVector::FReal AvoidPenetration = (PredictiveAvoidanceAgentRadius + Collider.Radius + MovingAvoidanceParams.PredictiveAvoidanceDistance) -
-	// 		AvoidDist; // Based on future agents distance
-	// 	const FVector::FReal AvoidMag = FMath::Square(FMath::Clamp(AvoidPenetration / MovingAvoidanceParams.PredictiveAvoidanceDistance, 0., 1.));
-	// 	const FVector::FReal AvoidMagDist = (1. - (CPA * InvPredictiveAvoidanceTime)); // No clamp, CPA is between 0 and PredictiveAvoidanceTime
-	// 	const FVector AvoidForce = AvoidNormal * AvoidMag * AvoidMagDist * MovingAvoidanceParams.ObstaclePredictiveAvoidanceStiffness * StandingScaling;
-	//
-	// 	SteeringForce += AvoidForce;
-	// } // close entities loop
-	//
-	// SteeringForce *= NearStartScaling * NearEndScaling;
-	//
-	// Force.Value = UE::MassNavigation::ClampVector(SteeringForce, MaxSteerAccel); // Assume unit mass
+	if (NewOrcaEntities.IsEmpty())
+	{
+		return;
+	}
+
+	NewOrcaEntities.Sort([](const FMassEntityHandle& A, const FMassEntityHandle& B) { return A.Index < B.Index; });
+	for (const FMassEntityHandle& Entity : NewOrcaEntities)
+	{
+		const FVector& Location               = EntityManager.GetFragmentDataChecked<FTransformFragment>(Entity).GetTransform().GetLocation();
+		const FVector PrefVelocity            = EntityManager.GetFragmentDataChecked<FMassForceFragment>(Entity).Value.GetSafeNormal();
+		FCollisionFragment& CollisionFragment = EntityManager.GetFragmentDataChecked<FCollisionFragment>(Entity);
+
+		// New agents take slots of deleted ones first
+		CollisionFragment.OrcaIndex = OrcaSolver->AddAgent(Location);
+		OrcaPositions.SetNumZeroed(OrcaSolver->GetAgentsNum());
+		OrcaPrefVelocities.SetNumZeroed(OrcaSolver->GetAgentsNum());
+		OrcaEntities.SetNum(OrcaSolver->GetAgentsNum());
+
+		OrcaPositions[CollisionFragment.OrcaIndex]      = FVector2f{static_cast<float>(Location.X), static_cast<float>(Location.Y)};
+		OrcaPrefVelocities[CollisionFragment.OrcaIndex] = FVector2f{static_cast<float>(PrefVelocity.X), static_cast<float>(PrefVelocity.Y)};
+		OrcaEntities[CollisionFragment.OrcaIndex]       = Entity;
+	}
+	NewOrcaEntities.Reset();
+}
+
+void URVOProcessor::OnPreDestroyEntity(const FMassEntityHandle& Entity)
+{
+	FCollisionFragment* CollisionFragment = EntitiesManagerSubsystem->GetEntityManager()->GetFragmentDataPtr<FCollisionFragment>(Entity);
+	if (!CollisionFragment || CollisionFragment->OrcaIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	DestroyedOrcaEntities.Add(Entity);
+	OrcaSolver->DeleteAgent(CollisionFragment->OrcaIndex);
+	OrcaEntities[CollisionFragment->OrcaIndex] = FMassEntityHandle();
+	CollisionFragment->OrcaIndex               = INDEX_NONE;
+}
+
+void URVOProcessor::SetOrcaNeighboursFromSnapshot(FMassEntityManager& EntityManager)
+{
+	const TConstArrayView<FMassEntityHandle> SnapshotEntities = EntitiesHashGrid->GetSnapshotEntities();
+	SnapshotOrcaIndices.SetNumUninitialized(SnapshotEntities.Num(), EAllowShrinking::No);
+	ParallelFor(SnapshotEntities.Num(), [this, &EntityManager, &SnapshotEntities](const int32 Slot)
+	{
+		const FCollisionFragment* CollisionFragment = EntityManager.IsEntityValid(SnapshotEntities[Slot])
+			? EntityManager.GetFragmentDataPtr<FCollisionFragment>(SnapshotEntities[Slot])
+			: nullptr;
+		SnapshotOrcaIndices[Slot] = CollisionFragment ? CollisionFragment->OrcaIndex : INDEX_NONE;
+	});
+
+	// Only home slots are read, so every entity is a candidate at most once
+	OrcaSolver->SetNeighbourCandidatesProvider([this, NeighbourDist = OrcaSolver->GetNeighbourDist()](const int32 AgentIndex, const FVector2f& Position,
+		UOrcaSolver::FNeighbourCandidates& OutCandidates)
+	{
+		const FGridBounds Cells = EntitiesHashGrid->GetCellsInRadius(FVector{Position.X, Position.Y, 0.f}, NeighbourDist);
+		for (int32 Row = Cells.BottomLeftCell.Y; Row <= Cells.TopRightCell.Y; Row++)
+		{
+			for (int32 Col = Cells.BottomLeftCell.X; Col <= Cells.TopRightCell.X; Col++)
+			{
+				const FCCSDenseSlotsRange Slots = EntitiesHashGrid->GetDenseHomeSlotsInCell(FGridCellPosition{Col, Row});
+				for (int32 Slot = Slots.Start; Slot < Slots.End; ++Slot)
+				{
+					const int32 OtherAgentIndex = SnapshotOrcaIndices[Slot];
+					if (OtherAgentIndex != INDEX_NONE && OtherAgentIndex != AgentIndex)
+					{
+						OutCandidates.Add(OtherAgentIndex);
+					}
+				}
+			}
+		}
+	});
+}
+
+void URVOProcessor::RemoveDeletedOrcaAgents(FMassEntityManager& EntityManager)
+{
+	if (OrcaSolver->GetFreeAgentsNum() == 0)
+	{
+		return;
+	}
+
+	OrcaSolver->RemoveFreeAgents([this, &EntityManager](const int32 OldIndex, const int32 NewIndex)
+	{
+		OrcaPositions[NewIndex]      = OrcaPositions[OldIndex];
+		OrcaPrefVelocities[NewIndex] = OrcaPrefVelocities[OldIndex];
+		OrcaEntities[NewIndex]       = OrcaEntities[OldIndex];
+		EntityManager.GetFragmentDataChecked<FCollisionFragment>(OrcaEntities[NewIndex]).OrcaIndex = NewIndex;
+	});
+
+	const int32 AgentsNum = OrcaSolver->GetAgentsNum();
+	OrcaPositions.SetNum(AgentsNum, EAllowShrinking::No);
+	OrcaPrefVelocities.SetNum(AgentsNum, EAllowShrinking::No);
+	OrcaEntities.SetNum(AgentsNum, EAllowShrinking::No);
+}
+
+
+
+void URVOProcessor::DoPredictiveAvoidance(FMassEntityManager& EntityManager, FMassExecutionContext& Context)
+{
+	const FPredictiveAvoidanceParams Params;
+	const float InvPredictiveAvoidanceTime = 1.f / Params.PredictiveAvoidanceTime;
+
+	const UCCSObstaclesHashGrid* ObstaclesHashGrid = CollisionsSubsystem->GetObstaclesHashGrid();
+	const bool bAvoidEdges                         = ObstaclesHashGrid && ObstaclesHashGrid->IsEdgesIndexBaked();
+
+	const TArray<float>& SpeedInClusters             = EntitiesManagerSubsystem->MovementSpeedsInClusters;
+	const TArray<float>& SpeedInAreas                = EntitiesManagerSubsystem->MovementSpeedsInAreas;
+	const TArray<float>& AvoidanceRadiusInClusters   = EntitiesManagerSubsystem->AvoidanceRadiusInClusters;
+	const TArray<float>& AvoidanceRadiusInAreas      = EntitiesManagerSubsystem->AvoidanceRadiusInAreas;
+	const TArray<float>& AvoidanceStrengthInClusters = EntitiesManagerSubsystem->AvoidanceStrengthInClusters;
+	const TArray<float>& AvoidanceStrengthInAreas    = EntitiesManagerSubsystem->AvoidanceStrengthInAreas;
+
+	EntitiesHashGrid->DataLock.Lock();
+
+	const FCCSEntitiesSnapshot& Snapshot                      = EntitiesHashGrid->GetSnapshot();
+	const TConstArrayView<FMassEntityHandle> SnapshotEntities = EntitiesHashGrid->GetSnapshotEntities();
+
+	// Desired velocities of all entities are gathered before any force is changed. Only home slots are read later.
+	SnapshotVelocities.SetNumUninitialized(Snapshot.Num(), EAllowShrinking::No);
+	ParallelFor(Snapshot.Num(), [&, this](const int32 Slot)
+	{
+		const FMassEntityHandle Entity          = SnapshotEntities[Slot];
+		const FMassForceFragment* ForceFragment = Snapshot.bHomeCell[Slot] && EntityManager.IsEntityValid(Entity)
+			? EntityManager.GetFragmentDataPtr<FMassForceFragment>(Entity)
+			: nullptr;
+		if (!ForceFragment)
+		{
+			SnapshotVelocities[Slot] = FVector2f::ZeroVector;
+			return;
+		}
+
+		const float Speed        = Snapshot.AreaId[Slot] > INDEX_NONE ? SpeedInAreas[Snapshot.AreaId[Slot]] : SpeedInClusters[Snapshot.ClusterType[Slot]];
+		SnapshotVelocities[Slot] = FVector2f{static_cast<float>(ForceFragment->Value.X), static_cast<float>(ForceFragment->Value.Y)} * Speed;
+	});
+
+	// Every entity changes only its own force, neighbours are read from the snapshot
+	EntityQuery.ParallelForEachEntityChunk(EntityManager, Context, [&, this](FMassExecutionContext& Context)
+	{
+		const int32 NumEntities                                 = Context.GetNumEntities();
+		const TConstArrayView<FTransformFragment> TransformList = Context.GetFragmentView<FTransformFragment>();
+		const TConstArrayView<FAgentRadiusFragment> RadiusList  = Context.GetFragmentView<FAgentRadiusFragment>();
+		const TArrayView<FMassForceFragment> ForceList          = Context.GetMutableFragmentView<FMassForceFragment>();
+		const TConstArrayView<FClusterFragment> ClusterList     = Context.GetFragmentView<FClusterFragment>();
+
+		UCCSObstaclesHashGrid::FEdgeIdsBuffer EdgeIdsBuffer;
+
+		for (int32 EntityIndex = 0; EntityIndex < NumEntities; ++EntityIndex)
+		{
+			const FClusterFragment& ClusterFragment = ClusterList[EntityIndex];
+			float Speed                             = SpeedInClusters[ClusterFragment.ClusterType];
+			float AvoidanceRadius                   = AvoidanceRadiusInClusters[ClusterFragment.ClusterType];
+			float AvoidanceStrength                 = AvoidanceStrengthInClusters[ClusterFragment.ClusterType];
+			if (ClusterFragment.AreaId > INDEX_NONE)
+			{
+				Speed             = SpeedInAreas[ClusterFragment.AreaId];
+				AvoidanceRadius   = AvoidanceRadiusInAreas[ClusterFragment.AreaId];
+				AvoidanceStrength = AvoidanceStrengthInAreas[ClusterFragment.AreaId];
+			}
+
+			if (AvoidanceRadius <= 1.f || AvoidanceStrength <= 0.01f)
+			{
+				continue;
+			}
+
+			const FMassEntityHandle Entity  = Context.GetEntity(EntityIndex);
+			const FVector& Location3D       = TransformList[EntityIndex].GetTransform().GetLocation();
+			const FVector2f Location        = FVector2f{static_cast<float>(Location3D.X), static_cast<float>(Location3D.Y)};
+			const float Radius              = RadiusList[EntityIndex].Radius;
+			FVector& Force                  = ForceList[EntityIndex].Value;
+			const FVector2f Direction       = FVector2f{static_cast<float>(Force.X), static_cast<float>(Force.Y)};
+			const FVector2f DesiredVelocity = Direction * Speed;
+			FVector2f SteeringForce         = FVector2f::ZeroVector;
+
+			const TConstArrayView<int32> EdgeIds = bAvoidEdges
+				? ObstaclesHashGrid->GetBakedEdgeIdsAtLocation(EdgeIdsBuffer, Location3D, AvoidanceRadius)
+				: TConstArrayView<int32>();
+
+			// Obstacle edges
+			for (const int32 EdgeId : EdgeIds)
+			{
+				const FCCSBakedObstacleEdge& Edge = ObstaclesHashGrid->GetBakedEdge(EdgeId);
+				const FVector2f RelPos            = Location - ClosestPointOnEdge(Location, Edge);
+				if (FVector2f::DotProduct(RelPos, Edge.LeftDir) < 0.f)
+				{
+					continue;	// Behind the edge
+				}
+
+				// Separation from the edge
+				const float ConDist       = RelPos.Size();
+				const float PenSep        = (Radius + Params.EnvironmentSeparationDistance) - ConDist;
+				const float SeparationMag = FMath::Square(FMath::Clamp(PenSep / Params.EnvironmentSeparationDistance, 0.f, 1.f));
+				SteeringForce            += Edge.LeftDir * SeparationMag * Params.EnvironmentSeparationStiffness;
+
+				// Edges don't move, so the whole relative velocity is ours
+				const float CPA              = ComputeClosestPointOfApproach(RelPos, DesiredVelocity, Radius, Params.PredictiveAvoidanceTime);
+				const float AvoidDist        = FVector2f::DotProduct(RelPos + DesiredVelocity * CPA, Edge.LeftDir);
+				const float AvoidPenetration = (Radius + Params.EnvironmentSeparationDistance) - AvoidDist;
+				const float AvoidMag         = FMath::Square(FMath::Clamp(AvoidPenetration / Params.EnvironmentSeparationDistance, 0.f, 1.f));
+				const float AvoidMagDist     = 1.f - CPA * InvPredictiveAvoidanceTime;
+				SteeringForce               += Edge.LeftDir * AvoidMag * AvoidMagDist * Params.EnvironmentPredictiveStiffness;
+			}
+
+			// Neighbour agents. Only home slots are read, so every entity is visited at most once.
+			const FGridBounds Cells = EntitiesHashGrid->GetCellsInRadius(Location3D, AvoidanceRadius);
+			for (int32 Row = Cells.BottomLeftCell.Y; Row <= Cells.TopRightCell.Y; Row++)
+			{
+				for (int32 Col = Cells.BottomLeftCell.X; Col <= Cells.TopRightCell.X; Col++)
+				{
+					const FCCSDenseSlotsRange Slots = EntitiesHashGrid->GetDenseHomeSlotsInCell(FGridCellPosition{Col, Row});
+					for (int32 Slot = Slots.Start; Slot < Slots.End; ++Slot)
+					{
+						const FVector2f OtherLocation = FVector2f{Snapshot.X[Slot], Snapshot.Y[Slot]};
+						const FVector2f RelPos        = Location - OtherLocation;
+						const float ConDist           = RelPos.Size();
+						if (ConDist > AvoidanceRadius || SnapshotEntities[Slot] == Entity)
+						{
+							continue;
+						}
+
+						const float OtherRadius        = Snapshot.Radius[Slot];
+						const FVector2f& OtherVelocity = SnapshotVelocities[Slot];
+						const bool bOtherIsMoving      = OtherVelocity.SizeSquared() > FMath::Square(Params.StandingSpeed);
+						const FVector2f RelVel         = DesiredVelocity - OtherVelocity;
+						const FVector2f RelVelNorm     = RelVel.GetSafeNormal();
+						const FVector2f ConNorm        = ConDist > 0.f ? RelPos / ConDist : FVector2f{1.f, 0.f};
+
+						// Standing agent doesn't avoid us, so the gap between it and an edge is a local minimum. Gaps narrower than
+						// MinClearance are avoided as a whole.
+						bool bHasForcedNormal  = false;
+						FVector2f ForcedNormal = FVector2f::ZeroVector;
+						if (!bOtherIsMoving)
+						{
+							const float MinClearance = 2.f * Radius * Params.StaticObstacleClearanceScale;
+							float MaxDist            = -1.f;
+							FVector2f ClosestPoint   = FVector2f::ZeroVector;
+							for (const int32 EdgeId : EdgeIds)
+							{
+								const FCCSBakedObstacleEdge& Edge = ObstaclesHashGrid->GetBakedEdge(EdgeId);
+								const FVector2f Point             = ClosestPointOnEdge(OtherLocation, Edge);
+								const FVector2f Offset            = OtherLocation - Point;
+								if (FVector2f::DotProduct(Offset, Edge.LeftDir) < 0.f)
+								{
+									continue;	// Behind the edge
+								}
+
+								const float OffsetLength = Offset.Size();
+								if (OffsetLength - OtherRadius < MinClearance && OffsetLength > MaxDist)
+								{
+									MaxDist      = OffsetLength;
+									ClosestPoint = Point;
+								}
+							}
+							if (MaxDist != -1.f)
+							{
+								ForcedNormal     = (OtherLocation - ClosestPoint).GetSafeNormal();
+								bHasForcedNormal = true;
+							}
+						}
+
+						// The more head on the collision is, the more we avoid towards the forced direction
+						auto BlendWithForcedNormal = [&](const FVector2f& Normal)
+						{
+							if (!bHasForcedNormal)
+							{
+								return Normal;
+							}
+							const float Blend = FMath::Max(0.f, -FVector2f::DotProduct(Normal, RelVelNorm));
+							return FMath::Lerp(Normal, ForcedNormal, Blend).GetSafeNormal();
+						};
+
+						const float StandingScaling = bOtherIsMoving ? 1.f : Params.StandingObstacleAvoidanceScale;
+
+						// Separation force (stay away from agents if possible)
+						const float PenSep        = (Radius + OtherRadius + Params.SeparationDistance) - ConDist;
+						const float SeparationMag = FMath::Square(FMath::Clamp(PenSep / Params.SeparationDistance, 0.f, 1.f));
+						SteeringForce            += BlendWithForcedNormal(ConNorm) * SeparationMag * Params.SeparationStiffness * StandingScaling;
+
+						// Penetration at the closest point of approach
+						const float CPA              = ComputeClosestPointOfApproach(RelPos, RelVel, Radius + OtherRadius, Params.PredictiveAvoidanceTime);
+						const FVector2f AvoidRelPos  = RelPos + RelVel * CPA;
+						const float AvoidDist        = AvoidRelPos.Size();
+						const FVector2f AvoidConNorm = AvoidDist > 0.f ? AvoidRelPos / AvoidDist : FVector2f{1.f, 0.f};
+						const float AvoidPenetration = (Radius + OtherRadius + Params.PredictiveAvoidanceDistance) - AvoidDist;
+						const float AvoidMag         = FMath::Square(FMath::Clamp(AvoidPenetration / Params.PredictiveAvoidanceDistance, 0.f, 1.f));
+						const float AvoidMagDist     = 1.f - CPA * InvPredictiveAvoidanceTime;	// No clamp, CPA is between 0 and PredictiveAvoidanceTime
+						SteeringForce               += BlendWithForcedNormal(AvoidConNorm) * AvoidMag * AvoidMagDist * Params.PredictiveAvoidanceStiffness * StandingScaling;
+					}
+				}
+			}
+
+			if (SteeringForce.IsNearlyZero())
+			{
+				continue;
+			}
+			SteeringForce            = (SteeringForce * AvoidanceStrength).GetClampedToMaxSize(Params.MaxSteering);
+			const FVector2f NewForce = (Direction + SteeringForce).GetClampedToMaxSize(1.f);	// Avoidance doesn't speed agents up
+			Force                    = FVector{NewForce.X, NewForce.Y, Force.Z};
+		}
+	});
+
+	EntitiesHashGrid->DataLock.Unlock();
 }
 
-FVector::FReal URVOProcessor::ComputeClosestPointOfApproach(const FVector RelPos, const FVector RelVel, const FVector::FReal TotalRadius,
-	const FVector::FReal TimeHoriz)
+float URVOProcessor::ComputeClosestPointOfApproach(const FVector2f& RelPos, const FVector2f& RelVel, const float TotalRadius, const float TimeHoriz)
 {
 	// Calculate time of impact based on relative agent positions and velocities.
-	const FVector::FReal A = FVector::DotProduct(RelVel, RelVel);
-	const FVector::FReal Inv2A = A > SMALL_NUMBER ? 1. / (2. * A) : 0.;
-	const FVector::FReal B = FMath::Min(0., 2. * FVector::DotProduct(RelVel, RelPos));
-	const FVector::FReal C = FVector::DotProduct(RelPos, RelPos) - FMath::Square(TotalRadius);
+	const float A     = FVector2f::DotProduct(RelVel, RelVel);
+	const float Inv2A = A > SMALL_NUMBER ? 1.f / (2.f * A) : 0.f;
+	const float B     = FMath::Min(0.f, 2.f * FVector2f::DotProduct(RelVel, RelPos));
+	const float C     = FVector2f::DotProduct(RelPos, RelPos) - FMath::Square(TotalRadius);
 	// Using max() here gives us CPA (closest point on arrival) when there is no hit.
-	const FVector::FReal Discr = FMath::Sqrt(FMath::Max(0., B * B - 4. * A * C));
-	const FVector::FReal T = (-B - Discr) * Inv2A;
-	return FMath::Clamp(T, 0., TimeHoriz);
+	const float Discr = FMath::Sqrt(FMath::Max(0.f, B * B - 4.f * A * C));
+	const float T     = (-B - Discr) * Inv2A;
+	return FMath::Clamp(T, 0.f, TimeHoriz);
 }
@@ -28,25 +28,42 @@ protected:
 
 private:
 	int32 CellSize = 100;
-	TMap<FGridCellPosition, int32> CollisionsInCells;
+	TMap<FGridCellPosition, int32> CollisionsInCells;	// Cells outside of CountersBounds, or all cells if the cell counters are not initialized
 	
 	FCriticalSection DataLock;
 
+	// CELL COUNTERS ------
+	// Collisions of cells inside CountersBounds are kept in dense arrays. They are added to PendingCellCounters with atomics
+	// (no locks, nothing is dropped) and moved into CellCounters by MergePendingCollisions().
+	
+	bool bCellCountersUsed = false;
+	FGridBounds CountersBounds;
+	int32 CountersCols = 0;
+	TArray<int32> CellCounters;			// One counter per cell of CountersBounds
+	TArray<int32> PendingCellCounters;	// Collisions added since the last merge
+
 	// DENSE CROWD AREAS SEARCH ------
 	
-	TSet<FGridCellPosition> DenseCells;
-	TSet<FGridCellPosition> VisitedDenseCells;
+	TBitArray<> DenseCellsBits;					// Cells of CountersBounds with enough collisions, built when the search starts
+	TSet<FGridCellPosition> DenseCells;			// Dense cells outside of CountersBounds
+	TSet<FGridCellPosition> VisitedDenseCells;	// Dense cells outside of CountersBounds that were grouped already
 
 public:
 	FCCSCollisionsHashGrid();
 
 	void operator= (const FCCSCollisionsHashGrid& Other)
 	{
-		DenseAreasCached  = Other.DenseAreasCached;
-		CellSize          = Other.CellSize;
-		CollisionsInCells = Other.CollisionsInCells;
-		DenseCells        = Other.DenseCells;
-		VisitedDenseCells = Other.VisitedDenseCells;
+		DenseAreasCached    = Other.DenseAreasCached;
+		CellSize            = Other.CellSize;
+		CollisionsInCells   = Other.CollisionsInCells;
+		bCellCountersUsed   = Other.bCellCountersUsed;
+		CountersBounds      = Other.CountersBounds;
+		CountersCols        = Other.CountersCols;
+		CellCounters        = Other.CellCounters;
+		PendingCellCounters = Other.PendingCellCounters;
+		DenseCellsBits      = Other.DenseCellsBits;
+		DenseCells          = Other.DenseCells;
+		VisitedDenseCells   = Other.VisitedDenseCells;
 	}
 	
 public:
@@ -57,21 +74,32 @@ public:
 
 	// COLLISIONS CELLS ------
 
-	TMap<FGridCellPosition, int32>& GetCollisionsInCells() { return CollisionsInCells; };
+	void ForEachCellWithCollisions(const TFunctionRef<void(const FGridCellPosition&, const int32)>& Callback) const;
 
 	int32 GetCellSize() const { return CellSize; }
 	int32 GetCollisionsCountAtLocation(const FVector& Location);
 	int32 GetCollisionsCountAtCell(const FGridCellPosition& CellPosition);
 	void AddCollisionsCountAtLocation(const FVector& Location, const int32 AdditiveCollisions);
-	void AddCollisionsCountAtCell(const FGridCellPosition& CellPosition, const int32 AdditiveCollisions);	// Can be used to increase and decrease collision counters
+	void AddCollisionsCountAtCell(const FGridCellPosition& CellPosition, const int32 AdditiveCollisions);	// Can be used to increase and decrease collision counters. Thread safe.
+
+	// Enables lock-free collisions counting and dense counters inside Bounds. Cells outside of them are still counted, but under the lock.
+	void InitializeCellCounters(const FGridBounds& Bounds);
+	// Applies collisions added since the last merge. Has to be called once per tick, while no collisions are added.
+	void MergePendingCollisions();
 
+	// Saturating decrement of all counters. Cells outside of CountersBounds are removed when they reach zero.
 	void DecrementCollisionsCountAtAllCells();
 
 	void CopyMainData(FCCSCollisionsHashGrid& OutCopiedHashGrid) const
 	{
-		OutCopiedHashGrid.DenseAreasCached  = DenseAreasCached;
-		OutCopiedHashGrid.CellSize          = CellSize;
-		OutCopiedHashGrid.CollisionsInCells = CollisionsInCells;
+		OutCopiedHashGrid.DenseAreasCached    = DenseAreasCached;
+		OutCopiedHashGrid.CellSize            = CellSize;
+		OutCopiedHashGrid.CollisionsInCells   = CollisionsInCells;
+		OutCopiedHashGrid.bCellCountersUsed   = bCellCountersUsed;
+		OutCopiedHashGrid.CountersBounds      = CountersBounds;
+		OutCopiedHashGrid.CountersCols        = CountersCols;
+		OutCopiedHashGrid.CellCounters        = CellCounters;
+		OutCopiedHashGrid.PendingCellCounters = PendingCellCounters;
 	}
 
 	// DEBUG ------
@@ -80,6 +108,22 @@ public:
 
 private:
 	void PreSearchForDenseAreas();
+	// Adds bounds of the dense component, or of its tiles if the component is bigger than MaxDenseAreaSize
+	void AddDenseAreasOfComponent(TArray<FGridBounds>& OutDenseAreas, const FGridConnectedComponent& Component, const int32 ComponentIndex,
+		const TArray<int32>& Labels) const;
+
+	bool IsCellInCounters(const FGridCellPosition& CellPosition) const
+	{
+		return bCellCountersUsed && CountersBounds.IsCellInBounds(CellPosition);
+	}
+	int32 GetCounterIndex(const FGridCellPosition& CellPosition) const
+	{
+		return (CellPosition.Y - CountersBounds.BottomLeftCell.Y) * CountersCols + (CellPosition.X - CountersBounds.BottomLeftCell.X);
+	}
+	FGridCellPosition GetCounterCellPosition(const int32 CounterIndex) const
+	{
+		return FGridCellPosition{CountersBounds.BottomLeftCell.X + CounterIndex % CountersCols, CountersBounds.BottomLeftCell.Y + CounterIndex / CountersCols};
+	}
 
 	void AddCollisionsCountAtCellNonSync(const FGridCellPosition& CellPosition, const int32 AdditiveCollisions);
 };
@@ -6,11 +6,16 @@
 #include "MassProcessor.h"
 #include "CCSCollisionsProcessor.generated.h"
 
+struct FCCSDenseSlotsRange;
+struct FCCSEntitiesSnapshot;
+struct FClusterFragment;
 struct FCollisionFragment;
 class UCrowdStatisticsSubsystem;
 struct FTransformFragment;
 class UCCSEntitiesHashGrid;
+class UCCSObstaclesHashGrid;
 class UCCSCollisionsSubsystem;
+class UCCSEntitiesManagerSubsystem;
 
 UCLASS()
 class CLEVERCROWD_API UCCSCollisionsProcessor : public UMassProcessor
@@ -27,19 +32,39 @@ private:
 		FCollisionFragment& CollisionFragment;
 	};
 
+	// Collisions of one entity resolved in the hash grid snapshot
+	struct FCollisionResult
+	{
+		FVector2f Displacement = FVector2f::ZeroVector;
+		int32 StrongCollisions = 0;
+		int32 WeakCollisions   = 0;
+		bool bCollided         = false;
+	};
+
 	FMassEntityQuery EntityQuery;
 
+	TArray<FCollisionResult> CollisionResults;	// Indexed by the hash grid snapshot slots
+
 	UPROPERTY()
 	UCCSEntitiesHashGrid* EntitiesHashGrid;
 	UPROPERTY()
 	UCCSCollisionsSubsystem* CollisionsSubsystem;
 	UPROPERTY()
 	UCrowdStatisticsSubsystem* CrowdStatisticsSubsystem;
+	UPROPERTY()
+	UCCSEntitiesManagerSubsystem* EntitiesManagerSubsystem;
+
+	bool bSkipObstaclesForOrcaAgents = false;	// ORCA solver avoids obstacles itself, see UE::CleverCrowd::Globals
 	
 public:
 	
 	UCCSCollisionsProcessor();
 
+	// Compares scalar and SIMD snapshot collision kernels on a synthetic crowd, logs timings and mismatches
+	static void BenchmarkSnapshotKernels(const TArray<int32>& AgentsNums, const int32 Iterations);
+	// Compares obstacle push-outs of the edges and of the baked distance field near obstacle edges, logs the differences
+	static void CompareObstacleCollisionBackends(const UCCSCollisionsSubsystem& InCollisionsSubsystem, const int32 SamplesNum);
+
 protected:
 	
 	virtual void ConfigureQueries() override;
@@ -48,8 +73,25 @@ protected:
 
 private:
 
+	// Entities and their fragments are fetched by handles from the hash grid. Used when the hash grid has no snapshot.
+	void ResolveCollisionsWithHandles(FMassEntityManager& EntityManager, const float CurrentTime);
+	// Pairwise pass reads only the hash grid snapshot, then results are written into fragments in one scatter pass
+	void ResolveCollisionsWithSnapshot(FMassEntityManager& EntityManager, const float CurrentTime);
+	// Entities outside of the snapshot (outside of the dense bounds) are resolved with handles after the snapshot pass
+	void ResolveCollisionsOutsideSnapshot(FMassEntityManager& EntityManager, const float CurrentTime);
+	// Resolves the entity against other entities and obstacles. Neighbours may contain the entity itself and invalid entities.
+	void ResolveEntityCollisionsWithHandles(FMassEntityManager& EntityManager, const FMassEntityHandle& Entity, TConstArrayView<FMassEntityHandle> Neighbours, const float CurrentTime);
+	
 	void ResolveTwoAgentsCollisions(bool& bOutCollisionOccured, FEntityProxyData& EntityData, FEntityProxyData& OtherEntityData);
+	// Resolves the entity against a range of others, 4 of them at a time with SIMD
+	static void ResolveAgentCollisionsInSnapshotBatch(TArrayView<FCollisionResult> Results, const FCCSEntitiesSnapshot& Snapshot, const int32 Slot, const FCCSDenseSlotsRange& OtherSlots);
+	static void ResolveTwoAgentsCollisionsInSnapshot(FCollisionResult& Result, FCollisionResult& OtherResult, const FCCSEntitiesSnapshot& Snapshot, const int32 Slot, const int32 OtherSlot);
+	// Slots seed the direction to split coincident agents in
+	static void ApplyTwoAgentsCollision(FCollisionResult& Result, FCollisionResult& OtherResult, const FVector2f& ToOther, const float Distance, const float CollisionResolveDistance,
+	                                    const int32 Slot, const int32 OtherSlot);
+	void CountCollision(FCollisionFragment& CollisionFragment, const FClusterFragment& ClusterFragment, const FVector& Location, const float CurrentTime);
 	void ResolveAgentCollisionsWithObstacles(FEntityProxyData& EntityData);
+	static FVector2f GetObstaclesPushOutWithEdges(const UCCSObstaclesHashGrid& ObstaclesHashGrid, const FVector& Location, const float Radius);
 	void TryIncreaseCollisionsCount(bool bCollisionOccured, const FVector& Location) const;
 
 	// DEBUG ------
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "MassEntityTypes.h"
+#include "Grids/UtilsGridTypes.h"
 #include "CollisionsFragments.generated.h"
 
 USTRUCT()
@@ -19,7 +20,12 @@ struct CLEVERCROWD_API FCollisionFragment : public FMassFragment
 	// To-the-side Avoidance---
 	float AvoidingToSideTimeLeft = -1.f;
 	bool bAvoidToTheRight        = false;
+	int32 AvoidanceRandomSeed    = 0;	// Current seed of the entity's random stream, 0 until the first use
 
 	// ORCA
 	int32 OrcaIndex = -1;
+
+	// Entities hash grid
+	FGridBounds HashGridCells;	// Cells the entity was added to during the last hash grid update
+	bool bInHashGrid = false;
 };
@@ -0,0 +1,49 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Grids/UtilsGridTypes.h"
+
+class UCCSObstaclesHashGrid;
+
+// Baked 2D signed distance to static obstacle edges (negative inside obstacles) and its gradient. Samples are placed in the
+// corners of sub-cells of Bounds, so pushing an agent out of obstacles is one bilinear sample instead of a loop over nearby edges.
+struct CLEVERCROWD_API FCCSObstaclesDistanceField
+{
+public:
+	static constexpr int32 SamplesPerCell = 4;
+	
+private:
+	static constexpr int32 CacheVersion = 1;
+
+	FGridBounds Bounds;
+	FVector2f Origin    = FVector2f::ZeroVector;	// Location of the first sample
+	float SampleSpacing = 25.f;
+	float MaxDistance   = 100.f;	// Distances are clamped to it, edges farther than it don't affect samples
+	int32 SamplesX      = 0;
+	int32 SamplesY      = 0;
+	uint32 EdgesHash    = 0;		// Hash of the obstacle edges the field is built from. Validates the disk cache.
+	TArray<float> Distances;
+	TArray<FVector2f> Gradients;
+
+public:
+	bool IsBuilt() const { return !Distances.IsEmpty(); }
+
+	// Obstacles hash grid must have baked edges index
+	void Build(const UCCSObstaclesHashGrid& ObstaclesHashGrid, const FGridBounds& InBounds, const int32 CellSize);
+	// Loads the field from the file if it was built for the same edges and bounds. Otherwise builds the field and saves it into the file.
+	void BuildOrLoadCached(const UCCSObstaclesHashGrid& ObstaclesHashGrid, const FGridBounds& InBounds, const int32 CellSize, const FString& CacheFilePath);
+
+	// Bilinear sample. Locations outside of the field are far from obstacles: MaxDistance and zero gradient.
+	float Sample(FVector2f& OutGradient, const FVector2f& Location) const;
+	// Translation that pushes a circle out of obstacles, zero if the circle doesn't touch them
+	FVector2f GetPushOut(const FVector2f& Location, const float Radius) const;
+
+	friend FArchive& operator<<(FArchive& Ar, FCCSObstaclesDistanceField& Field);
+
+private:
+	void InitializeLayout(const FGridBounds& InBounds, const int32 CellSize);
+	float ComputeSignedDistance(FVector2f& OutGradient, const UCCSObstaclesHashGrid& ObstaclesHashGrid, const FVector2f& Location) const;
+	static uint32 MakeEdgesHash(const UCCSObstaclesHashGrid& ObstaclesHashGrid);
+};
@@ -16,10 +16,24 @@ class CLEVERCROWD_API UCCSObstaclesHashGrid : public UObject
 {
 	GENERATED_BODY()
 
+public:
+	using FEdgeIdsBuffer = TArray<int32, TInlineAllocator<32>>;	// Query results of an agent fit it without heap allocations
+
 private:
 
 	int32 CellSize;
-	TMap<FGridCellPosition, TArray<FCCSObstacleEdge>> ObstacleEdgesInCells;
+	TArray<FCCSObstacleEdge> ObstacleEdges;	// Every added edge once
+	TMap<FGridCellPosition, TArray<int32>> ObstacleEdgeIdsInCells;
+
+	// BAKED EDGES INDEX ------
+	// Immutable flat copy of the edges, built by BakeEdgesIndex() once all obstacles are added. Edge ids of the cells of
+	// BakedBounds are stored in CSR layout: ids of the cell are BakedEdgeIds[BakedCellStarts[Cell], BakedCellStarts[Cell + 1]).
+	
+	bool bEdgesIndexBaked = false;
+	FGridBounds BakedBounds;
+	TArray<FCCSBakedObstacleEdge> BakedEdges;
+	TArray<int32> BakedCellStarts;
+	TArray<int32> BakedEdgeIds;
 
 public:
 
@@ -29,7 +43,6 @@ public:
 
 	int32 GetCellSize() const { return CellSize; }
 	
-	void GetObstacleEdgesAtLocation(TArray<FCCSObstacleEdge>& OutEdges, const FVector& Location, const float& Radius);
 	void AddObstacleEdge(const FCCSObstacleEdge& Edge);
 	void AddObstacleEdges(const TArray<FCCSObstacleEdge>& Edges);
 
@@ -38,8 +51,17 @@ public:
 
 	// void AddObstacleRect(const FCCSObstacleRectangle& ObstacleRect);	// Make it call AddObstacleEdge for all 4 rectangle edges
 
+	// BAKED EDGES INDEX ------
+
+	// Has to be called after all obstacle edges are added. Edges can't be added after that.
+	void BakeEdgesIndex();
+	bool IsEdgesIndexBaked() const { return bEdgesIndexBaked; }
+	// Ids of the edges in cells touched by the circle, each edge once. The view points into OutBuffer. Thread safe.
+	TConstArrayView<int32> GetBakedEdgeIdsAtLocation(FEdgeIdsBuffer& OutBuffer, const FVector& Location, const float Radius) const;
+	const FCCSBakedObstacleEdge& GetBakedEdge(const int32 EdgeId) const { return BakedEdges[EdgeId]; }
+	TConstArrayView<FCCSBakedObstacleEdge> GetBakedEdges() const { return BakedEdges; }
+
 private:
 
-	void FetchObstacleEdgesFromCell(TArray<FCCSObstacleEdge>& OutEdges, const FGridCellPosition& CellPosition);
-	void AddObstacleEdgeInCell(const FGridCellPosition& CellPosition, const FCCSObstacleEdge& Edge);
+	void AddObstacleEdgeIdInCell(const FGridCellPosition& CellPosition, const int32 EdgeId);
 };
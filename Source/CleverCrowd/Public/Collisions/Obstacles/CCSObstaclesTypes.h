@@ -46,3 +46,19 @@ struct CLEVERCROWD_API FCCSObstacleEdge
 			BoxCenter + BoxRotation.RotateVector(FVector(-BoxExtent.X, -BoxExtent.Y, 0.f))));
 	}
 };
+
+// 2D copy of FCCSObstacleEdge kept in the baked obstacles index
+struct CLEVERCROWD_API FCCSBakedObstacleEdge
+{
+	FVector2f Start   = FVector2f::ZeroVector;
+	FVector2f End     = FVector2f::ZeroVector;
+	FVector2f LeftDir = FVector2f::ZeroVector;
+
+	FCCSBakedObstacleEdge() = default;
+	explicit FCCSBakedObstacleEdge(const FCCSObstacleEdge& Edge)
+		: Start(FVector2f{static_cast<float>(Edge.Start.X), static_cast<float>(Edge.Start.Y)})
+		, End(FVector2f{static_cast<float>(Edge.End.X), static_cast<float>(Edge.End.Y)})
+		, LeftDir(FVector2f{static_cast<float>(Edge.LeftDir.X), static_cast<float>(Edge.LeftDir.Y)})
+	{
+	}
+};
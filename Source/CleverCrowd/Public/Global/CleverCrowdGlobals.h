@@ -7,4 +7,8 @@
 namespace UE::CleverCrowd::Globals
 {
 	constexpr bool bDrawDebugCollisionsCountsPeriodically = false;	// If true, will constantly draw collisions counts debug in hash grid cells
+	constexpr bool bUseObstaclesDistanceField = false;				// If true, agents are pushed out of obstacles with the baked distance field instead of obstacle edges
+	constexpr bool bSkipObstacleCollisionsForOrcaAgents = false;	// If true, ORCA agents are not pushed out of obstacles, the ORCA solver avoids obstacles itself
+	constexpr bool bUseHashGridForOrcaNeighbours = false;			// If true, ORCA neighbours are searched in the entities hash grid snapshot instead of the ORCA agent tree
+	constexpr bool bUseIncrementalHashGridUpdates = false;			// If true, the entities hash grid starts in the incremental update mode (can be switched with CCS_SetHashGridUpdateMode)
 }
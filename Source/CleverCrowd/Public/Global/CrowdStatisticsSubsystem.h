@@ -5,6 +5,8 @@
 #include "CoreMinimal.h"
 #include "Subsystems/WorldSubsystem.h"
 #include "MassEntityTypes.h"
+#include "MassExternalSubsystemTraits.h"
+#include "Common/CommonTypes.h"
 #include "CrowdStatisticsSubsystem.generated.h"
 
 DECLARE_DELEGATE_TwoParams(FUpdatedEntitiesCountSignature, int32 /*NewCount*/, int32 /*OldCount*/);
@@ -33,6 +35,8 @@ struct CLEVERCROWD_API FCrowdStatistics
 	
 	TMap<int32, TMap<FMassEntityHandle, float>> EntitiesTotalTimeInArea; // [AreaTypeId][Entity][TotalTimeInArea]
 
+	FAggregatedValueFloat OrcaAgentTreeTime;	// Time spent on ORCA agent tree builds and refits, in seconds per step
+
 	FUpdatedEntitiesCountSignature UpdatedEntitiesCountDelegate;
 
 private:
@@ -116,3 +120,13 @@ public:
 	UPROPERTY()
 	FCrowdStatistics Stats;
 };
+
+// Stats are written by one processor at a time, the dependency solver orders writers by their subsystem requirements
+template<>
+struct TMassExternalSubsystemTraits<UCrowdStatisticsSubsystem> final
+{
+	enum
+	{
+		GameThreadOnly = false
+	};
+};
@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "MassEntityTypes.h"
+#include "Async/ParallelFor.h"
+#include "Containers/StaticArray.h"
+#include "Common/CommonTypes.h"
 #include "Grids/UtilsGridTypes.h"
 #include "UObject/Object.h"
 #include "CCSEntitiesHashGrid.generated.h"
@@ -11,6 +14,52 @@
 
 class UCCSEntitiesManagerSubsystem;
 
+UENUM()
+enum class EEntitiesHashGridUpdateMode : uint8
+{
+	FullRebuild = 0,	// The grid is cleared and refilled every tick. Uses the dense storage if it's initialized.
+	Incremental			// Entities are moved only when their cells change. Uses only the sparse storage.
+};
+
+// Entity data that is copied into FCCSEntitiesSnapshot
+struct FCCSEntitySnapshotData
+{
+	FVector2f Location = FVector2f::ZeroVector;
+	float Radius       = 0.f;
+	int32 ClusterType  = 0;
+	int32 AreaId       = INDEX_NONE;
+};
+
+// Per-tick SoA copy of entities data. Indexed the same way as the dense storage slots, so entities of one cell are contiguous.
+struct FCCSEntitiesSnapshot
+{
+	TArray<float> X;
+	TArray<float> Y;
+	TArray<float> Radius;
+	TArray<int32> ClusterType;
+	TArray<int32> AreaId;
+	TArray<bool> bHomeCell;	// True for the slot in the cell that contains the entity location. Every entity has at most one such slot.
+
+	int32 Num() const { return X.Num(); }
+	
+	void SetNumUninitialized(const int32 Num)
+	{
+		X.SetNumUninitialized(Num, EAllowShrinking::No);
+		Y.SetNumUninitialized(Num, EAllowShrinking::No);
+		Radius.SetNumUninitialized(Num, EAllowShrinking::No);
+		ClusterType.SetNumUninitialized(Num, EAllowShrinking::No);
+		AreaId.SetNumUninitialized(Num, EAllowShrinking::No);
+		bHomeCell.SetNumUninitialized(Num, EAllowShrinking::No);
+	}
+};
+
+// Range of slots [Start, End) in the dense storage
+struct FCCSDenseSlotsRange
+{
+	int32 Start = 0;
+	int32 End   = 0;
+};
+
 UCLASS()
 class CLEVERCROWD_API UCCSEntitiesHashGrid : public UObject
 {
@@ -21,27 +70,210 @@ class CLEVERCROWD_API UCCSEntitiesHashGrid : public UObject
 public:
 	FCriticalSection DataLock;
 
+	EEntitiesHashGridUpdateMode UpdateMode = EEntitiesHashGridUpdateMode::FullRebuild;
+	float FullRebuildInterval = 5.f;	// Incremental mode does a full rebuild with this interval to fix any drift
+
+	FAggregatedValueFloat UpdateTime;	// Time spent on grid updates, in seconds per update
+
+	bool bBuildSnapshot = true;	// Whether to build FCCSEntitiesSnapshot along with the dense storage
+
 protected:
 	FMassEntityManager* EntityManager;
 	
 	int32 CellSize;
-	// ToDo: remove destroyed entities from this container.
+	// Sparse storage. Used for all cells when the dense storage is disabled, and for cells outside of DenseBounds otherwise.
 	TMap<FGridCellPosition, TArray<FMassEntityHandle>> EntitiesInCells;
 
+	// DENSE STORAGE ------
+	// Entities of all cells inside DenseBounds are kept in one contiguous array sorted by cell index (counting sort).
+	// Entities of cell I are DenseCellEntities[DenseCellOffsets[I] .. DenseCellOffsets[I + 1]).
+	bool bDenseStorageEnabled = false;
+	FGridBounds DenseBounds;
+	int32 DenseCols = 0;
+	int32 DenseRows = 0;
+	TArray<int32> DenseCellOffsets;				// CellsNum + 1 elements
+	TArray<int32> DenseCellHomeEnds;			// Home slots of cell I are [DenseCellOffsets[I] .. DenseCellHomeEnds[I]), see FCCSEntitiesSnapshot::bHomeCell
+	TArray<FMassEntityHandle> DenseCellEntities;
+	TArray<int32> DenseNonEmptyCells;			// Indices of cells that contain at least one entity, in ascending order
+	TArray<int32> DenseCellCursors;				// Scratch write positions used by CommitDenseStorage()
+	TArray<int32> DenseRowOffsets;				// Scratch row sums used by CommitDenseStorage(), DenseRows + 1 elements
+	TArray<int32> DenseSlotStagedIndices;		// Scratch StagedEntities indices of every slot used by CommitDenseStorage()
+
+	// Cells that share an entity pair in ParallelForEachSnapshotPair() are of different colours
+	static constexpr int32 HalfShellColumnColours = 3;
+	static constexpr int32 HalfShellRowColours    = 2;
+	static constexpr int32 HalfShellColoursNum    = HalfShellColumnColours * HalfShellRowColours;
+	TStaticArray<TArray<int32>, HalfShellColoursNum> DenseNonEmptyCellsByColour;
+
+	// Entity waiting to be sorted into the dense storage
+	struct FStagedEntity
+	{
+		FMassEntityHandle Entity;
+		FGridBounds Cells;
+		FCCSEntitySnapshotData SnapshotData;
+		int32 HomeCellIndex = INDEX_NONE;	// Dense cell that contains the entity location. Found in CommitDenseStorage().
+	};
+	TArray<FStagedEntity> StagedEntities;		// Entities added since the last ClearData() or BeginParallelStaging()
+	std::atomic<int32> StagedEntitiesNum = 0;	// Claimed part of StagedEntities during parallel staging
+	bool bStagedWithoutSnapshotData = false;	// Some entities were added without data, so the snapshot can't be built
+
+	FCCSEntitiesSnapshot Snapshot;
+	bool bSnapshotValid = false;
+	TArray<FMassEntityHandle> EntitiesOutsideSnapshot;	// Staged entities whose location is outside of the dense bounds, so they have no home slot
+
+	double LastFullRebuildTime = -1.0;
+	bool bFullRebuildRequested = true;
+	std::atomic<int32> RequestedUpdateMode = INDEX_NONE;	// Set by SetUpdateMode() on any thread, INDEX_NONE if there is no request
+
 public:
 	UCCSEntitiesHashGrid();
 
 public:
 	// Removes all entities from all grid cells
 	void ClearData();
+	// Like ClearData(), but keeps staged entities, so they can be committed after
+	void ClearCells();
 	void FetchEntitiesFromCell(TArray<FMassEntityHandle>& OutEntities, const FGridCellPosition& CellPosition);	// Unlike Get, Fetch will not clear old OutEntities data
 	void GetEntitiesInCell(TArray<FMassEntityHandle>& OutEntities, const FGridCellPosition& CellPosition);
 	void GetEntitiesAtLocation(TArray<FMassEntityHandle>& OutEntities, const FVector& Location);
 	void GetEntitiesInBounds(TArray<FMassEntityHandle>& OutEntities, const FGridBounds& Bounds);
 	void AddEntityInCell(const FGridCellPosition& CellPosition, const FMassEntityHandle& Entity);
 	void AddEntityAtLocation(const FVector& Location, const FMassEntityHandle& Entity, const float& EntityRadius);
+	void AddEntityInCells(const FGridBounds& Cells, const FMassEntityHandle& Entity);
+	void RemoveEntityFromCell(const FGridCellPosition& CellPosition, const FMassEntityHandle& Entity);
+	void RemoveEntityFromCells(const FGridBounds& Cells, const FMassEntityHandle& Entity);
+	// Removes the entity from cells cached in its FCollisionFragment. Called before the entity is destroyed.
+	void RemoveEntity(const FMassEntityHandle& Entity);
+	// Cells that an entity with the given location and radius occupies
+	FGridBounds GetCellsInRadius(const FVector& Location, const float EntityRadius) const;
 
 	void ForEachNonEmptyCell(const TFunction<void(const FGridCellPosition&, FMassEntityManager&)>& Callback);
-	void ForEachNonEmptyCell(const TFunction<void(const FGridCellPosition&, const TArray<FMassEntityHandle>&, FMassEntityManager&)>& Callback);
+	void ForEachNonEmptyCell(const TFunction<void(const FGridCellPosition&, TConstArrayView<FMassEntityHandle>, FMassEntityManager&)>& Callback);
 	void ParallelForEachNonEmptyCell(const TFunction<void(const FGridCellPosition&)>& Callback);
+
+	// Returns a view of the entities in the cell. The view is valid until the next grid rebuild.
+	TConstArrayView<FMassEntityHandle> GetEntitiesViewInCell(const FGridCellPosition& CellPosition) const;
+	int32 GetCellSize() const { return CellSize; }
+
+	// Switches cells inside Bounds to the dense storage. Bounds are in this grid's cells (usually the flowfield bounds).
+	void InitializeDenseStorage(const FGridBounds& Bounds);
+	// Sorts entities added since the last ClearData() into the dense storage. Must be called after the grid is filled.
+	void CommitDenseStorage();
+	bool IsDenseStorageEnabled() const { return bDenseStorageEnabled; }
+	bool IsDenseStorageUsed() const
+	{
+		return bDenseStorageEnabled && UpdateMode == EEntitiesHashGridUpdateMode::FullRebuild;
+	}
+
+	// PARALLEL STAGING ------
+	// Lets worker threads stage entities for the dense storage without locks: every worker claims its own range of slots.
+	// Usage: BeginParallelStaging() -> ClaimStagedEntities() + SetStagedEntity() from workers -> EndParallelStaging() -> CommitDenseStorage().
+
+	void BeginParallelStaging(const int32 MaxEntitiesNum);
+	// Returns the index of the first of EntitiesNum claimed slots. Thread safe.
+	int32 ClaimStagedEntities(const int32 EntitiesNum);
+	void SetStagedEntity(const int32 Index, const FMassEntityHandle& Entity, const FGridBounds& Cells, const FCCSEntitySnapshotData& SnapshotData)
+	{
+		StagedEntities[Index] = FStagedEntity{Entity, Cells, SnapshotData};
+	}
+	void EndParallelStaging();
+
+	// SNAPSHOT ------
+	// Valid only with the dense storage, when all entities were staged with their data. Cells outside the dense bounds are not in the snapshot.
+
+	bool HasSnapshot() const { return bSnapshotValid; }
+	const FCCSEntitiesSnapshot& GetSnapshot() const { return Snapshot; }
+	// Entity of every snapshot slot
+	TConstArrayView<FMassEntityHandle> GetSnapshotEntities() const { return DenseCellEntities; }
+	FCCSDenseSlotsRange GetDenseSlotsInCell(const FGridCellPosition& CellPosition) const;
+	// Home slots go first in every cell, so they are contiguous
+	FCCSDenseSlotsRange GetDenseHomeSlotsInCell(const FGridCellPosition& CellPosition) const;
+	// Entities that snapshot passes don't process. Users handle them with entity handles after the snapshot pass.
+	TConstArrayView<FMassEntityHandle> GetEntitiesOutsideSnapshot() const { return EntitiesOutsideSnapshot; }
+
+	// HALF-SHELL PAIRS ------
+	// Calls Callback(Slot, OtherSlot) exactly once for every unordered pair of snapshot entities whose home cells are the same or adjacent.
+	// Every cell is paired with itself and with 4 of its 8 neighbours, so pairs between two cells are found only from one of them.
+	// Cells are processed in colour passes: cells of one colour never reach the same cell, so Callback may write results of both slots without locks.
+	template <typename FuncType>
+	void ParallelForEachSnapshotPair(const FuncType& Callback);
+	// Same pairs, but batched: Callback(Slot, OtherSlots) is called with contiguous ranges of home slots, e.g. for SIMD kernels
+	template <typename FuncType>
+	void ParallelForEachSnapshotPairRange(const FuncType& Callback);
+
+	// UPDATE MODES ------
+
+	// Only requests the mode. The grid is updated off the game thread, so the switch is applied by the hash grid processor before its next update.
+	void SetUpdateMode(const EEntitiesHashGridUpdateMode NewUpdateMode);
+	// Logs the mean update time of the previous mode, then clears the grid and starts measuring anew. Called by the hash grid processor.
+	void ApplyRequestedUpdateMode();
+	// True when the next update has to clear and refill the grid (always in FullRebuild mode)
+	bool ShouldDoFullRebuild(const double CurrentTime) const;
+	void OnFullRebuildFinished(const double CurrentTime);
+
+protected:
+	int32 GetDenseCellIndex(const FGridCellPosition& CellPosition) const
+	{
+		return (CellPosition.Y - DenseBounds.BottomLeftCell.Y) * DenseCols + (CellPosition.X - DenseBounds.BottomLeftCell.X);
+	}
+	FGridCellPosition GetDenseCellPosition(const int32 CellIndex) const
+	{
+		return FGridCellPosition{DenseBounds.BottomLeftCell.X + CellIndex % DenseCols, DenseBounds.BottomLeftCell.Y + CellIndex / DenseCols};
+	}
+	bool IsCellInDenseStorage(const FGridCellPosition& CellPosition) const
+	{
+		return IsDenseStorageUsed() && DenseBounds.IsCellInBounds(CellPosition);
+	}
 };
+
+template <typename FuncType>
+void UCCSEntitiesHashGrid::ParallelForEachSnapshotPair(const FuncType& Callback)
+{
+	ParallelForEachSnapshotPairRange([&Callback](const int32 Slot, const FCCSDenseSlotsRange& OtherSlots)
+	{
+		for (int32 OtherSlot = OtherSlots.Start; OtherSlot < OtherSlots.End; OtherSlot++)
+		{
+			Callback(Slot, OtherSlot);
+		}
+	});
+}
+
+template <typename FuncType>
+void UCCSEntitiesHashGrid::ParallelForEachSnapshotPairRange(const FuncType& Callback)
+{
+	// Forward half of the 3x3 neighbourhood. Cells reached from one cell span 3 columns and 2 rows, hence 3x2 colours.
+	static const FGridCellPosition HalfShellOffsets[] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+	
+	DataLock.Lock();
+	for (const TArray<int32>& ColourCells : DenseNonEmptyCellsByColour)
+	{
+		ParallelFor(ColourCells.Num(), [this, &Callback, &ColourCells](const int32 Index)
+		{
+			const int32 CellIndex   = ColourCells[Index];
+			const int32 CellHomeEnd = DenseCellHomeEnds[CellIndex];
+			const FGridCellPosition Cell = GetDenseCellPosition(CellIndex);
+			
+			FCCSDenseSlotsRange NeighbourSlots[UE_ARRAY_COUNT(HalfShellOffsets)];
+			for (int32 OffsetIndex = 0; OffsetIndex < UE_ARRAY_COUNT(HalfShellOffsets); OffsetIndex++)
+			{
+				NeighbourSlots[OffsetIndex] = GetDenseHomeSlotsInCell(Cell + HalfShellOffsets[OffsetIndex]);
+			}
+
+			for (int32 Slot = DenseCellOffsets[CellIndex]; Slot < CellHomeEnd; Slot++)
+			{
+				if (Slot + 1 < CellHomeEnd)
+				{
+					Callback(Slot, FCCSDenseSlotsRange{Slot + 1, CellHomeEnd});
+				}
+				for (const FCCSDenseSlotsRange& Range : NeighbourSlots)
+				{
+					if (Range.Start < Range.End)
+					{
+						Callback(Slot, Range);
+					}
+				}
+			}
+		});
+	}
+	DataLock.Unlock();
+}
@@ -6,6 +6,7 @@
 #include "MassProcessor.h"
 #include "CCSEntitiesHashGridProcessor.generated.h"
 
+class UCCSEntitiesHashGrid;
 class UCCSEntitiesManagerSubsystem;
 /**
  * 
@@ -21,6 +22,8 @@ private:
 	
 	UPROPERTY()
 	UCCSEntitiesManagerSubsystem* EntitiesManager;
+
+	double CurrentTime = 0.0;	// Sum of the execution context delta times. The world isn't read, because the processor runs off the game thread.
 	
 public:
 	
@@ -31,4 +34,13 @@ protected:
 	virtual void ConfigureQueries() override;
 	virtual void Initialize(UObject& Owner) override;
 	virtual void Execute(FMassEntityManager& EntityManager, FMassExecutionContext& Context) override;
+
+private:
+
+	// Clears the grid and adds all entities again
+	void RebuildHashGrid(FMassEntityManager& EntityManager, FMassExecutionContext& Context, UCCSEntitiesHashGrid& HashGrid);
+	// Same as RebuildHashGrid, but entities are staged from worker threads and sorted into the dense storage in parallel
+	void RebuildHashGridParallel(FMassEntityManager& EntityManager, FMassExecutionContext& Context, UCCSEntitiesHashGrid& HashGrid);
+	// Moves only entities whose cells have changed since the last update
+	void UpdateHashGridIncrementally(FMassEntityManager& EntityManager, FMassExecutionContext& Context, UCCSEntitiesHashGrid& HashGrid);
 };
@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "Collisions/CCSCollisionsHashGrid.h"
+#include "Collisions/Obstacles/CCSObstaclesDistanceField.h"
+#include "MassExternalSubsystemTraits.h"
 #include "Subsystems/WorldSubsystem.h"
 #include "CCSCollisionsSubsystem.generated.h"
 
@@ -19,6 +21,9 @@ private:
 	UPROPERTY()
 	TObjectPtr<UCCSObstaclesHashGrid> ObstaclesHashGrid;
 	FCCSCollisionsHashGrid CollisionsHashGrid;
+	FCCSObstaclesDistanceField ObstaclesDistanceField;
+	FGridBounds ObstaclesDistanceFieldBounds;
+	bool bObstaclesDistanceFieldBoundsSet = false;
 
 	FTimerHandle DebugCollisionsCountTh;
 
@@ -31,10 +36,27 @@ public:
 public:
 
 	void InitializeObstaclesOnMap();
+	// Sets bounds of the obstacles distance field. The field is baked or loaded from the cache of the map only if collisions use it
+	// (bUseObstaclesDistanceField). Has to be called after InitializeObstaclesOnMap().
+	void InitializeObstaclesDistanceField(const FGridBounds& Bounds);
+	// Bakes the field in memory if it isn't built yet, without touching the cache. False if the bounds aren't set.
+	bool BuildObstaclesDistanceFieldIfNeeded();
 
 	UCCSObstaclesHashGrid* GetObstaclesHashGrid() { return ObstaclesHashGrid; };
+	const UCCSObstaclesHashGrid* GetObstaclesHashGrid() const { return ObstaclesHashGrid; };
 	FCCSCollisionsHashGrid& GetCollisionsHashGrid() { return CollisionsHashGrid; };
+	const FCCSObstaclesDistanceField& GetObstaclesDistanceField() const { return ObstaclesDistanceField; };
 
 private:
 	void DrawDebugCollisionsCountsPeriodically();
 };
+
+// Obstacles are read only after initialization, collisions counts are added atomically
+template<>
+struct TMassExternalSubsystemTraits<UCCSCollisionsSubsystem> final
+{
+	enum
+	{
+		GameThreadOnly = false
+	};
+};
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "MassExternalSubsystemTraits.h"
 #include "Subsystems/WorldSubsystem.h"
 #include "CCSEntitiesManagerSubsystem.generated.h"
 
@@ -60,3 +61,13 @@ public:
 	void SetDetourEnabledForAllEntities(bool bEnabled);
 	// DETOUR END
 };
+
+// Processors only read avoidance and movement parameters, they are changed between ticks
+template<>
+struct TMassExternalSubsystemTraits<UCCSEntitiesManagerSubsystem> final
+{
+	enum
+	{
+		GameThreadOnly = false
+	};
+};
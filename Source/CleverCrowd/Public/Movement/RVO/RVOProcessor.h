@@ -7,6 +7,7 @@
 #include "RVOProcessor.generated.h"
 
 class UOrcaSolver;
+class UCCSObstaclesHashGrid;
 class UCCSCollisionsSubsystem;
 struct FClusterFragment;
 struct FCollisionFragment;
@@ -33,8 +34,35 @@ private:
 		FClusterFragment& ClusterFragment;
 	};
 
+	// Simple avoidance of one entity done in the hash grid snapshot
+	struct FAvoidanceResult
+	{
+		FVector2f ForceDelta = FVector2f::ZeroVector;
+		bool bAvoided        = false;
+	};
+
+	// Predictive avoidance parameters. Distances are in cm, stiffnesses are in units of the movement direction (force of length 1).
+	struct FPredictiveAvoidanceParams
+	{
+		float SeparationDistance             = 30.f;	// Extra distance kept between agents
+		float SeparationStiffness            = 0.5f;
+		float PredictiveAvoidanceTime        = 2.5f;	// Seconds to look ahead for collisions
+		float PredictiveAvoidanceDistance    = 40.f;	// Extra distance kept between agents at the closest point of approach
+		float PredictiveAvoidanceStiffness   = 1.2f;
+		float EnvironmentSeparationDistance  = 30.f;	// Extra distance kept from obstacle edges
+		float EnvironmentSeparationStiffness = 1.f;
+		float EnvironmentPredictiveStiffness = 0.6f;
+		float StandingObstacleAvoidanceScale = 0.65f;	// Standing agents are avoided less, so we can push through a standing crowd
+		float StaticObstacleClearanceScale   = 0.7f;	// Gaps between a standing agent and an edge narrower than agent diameter times this are avoided
+		float StandingSpeed                  = 5.f;	// Agents with desired velocity below it are considered standing
+		float MaxSteering                    = 1.5f;
+	};
+
 	FMassEntityQuery EntityQuery;
 
+	TArray<FAvoidanceResult> AvoidanceResults;	// Indexed by the hash grid snapshot slots
+	TArray<FVector2f> SnapshotVelocities;		// Desired velocity of the entity in every hash grid snapshot slot
+
 	UPROPERTY()
 	UCCSEntitiesHashGrid* EntitiesHashGrid;
 	UPROPERTY()
@@ -45,8 +73,15 @@ private:
 	UCCSCollisionsSubsystem* CollisionsSubsystem;
 
 	UPROPERTY()
-	TObjectPtr<UOrcaSolver> OrcaSolver;
-	bool bInitializedOrcaAgents = false;
+	TObjectPtr<UOrcaSolver> OrcaSolver;	// Created in Initialize(), the processor runs off the game thread
+	bool bOrcaSolverInitialized = false;
+	TArray<FVector2f> OrcaPositions;		// Indexed by ORCA agent indices, exchanged with the solver once per tick
+	TArray<FVector2f> OrcaPrefVelocities;
+	TArray<FMassEntityHandle> OrcaEntities;	// Indexed by ORCA agent indices. Used to update OrcaIndex of agents moved by the solver
+	TSet<FMassEntityHandle> DestroyedOrcaEntities;	// Destroyed entities stay in queries until deferred commands are flushed
+	TArray<FMassEntityHandle> NewOrcaEntities;		// Entities without an ORCA agent found by the parallel chunk pass
+	FCriticalSection NewOrcaEntitiesLock;
+	TArray<int32> SnapshotOrcaIndices;				// ORCA index of the entity in every hash grid snapshot slot
 	
 public:
 	
@@ -60,12 +95,35 @@ protected:
 
 private:
 
-	void DoSimpleAvoidance(FEntityProxyData& EntityData, FEntityProxyData& OtherEntityData, float AvoidanceRadius, float AvoidanceStrength, float DeltaTime);
-	void DoToTheSideAvoidance(FCollisionFragment& CollisionFragment, FVector& Force, FTransform& Transform, FMassExecutionContext& Context, float Duration, float DeltaTime);
+	// Entities and their fragments are fetched by handles from the hash grid. Used when the hash grid has no snapshot.
+	void DoSimpleAvoidanceWithHandles(FMassEntityManager& EntityManager, float CurrentTime);
+	// Handles pass over entities that are out of the dense bounds, so the snapshot passes don't see them. Neighbours are taken within the avoidance radius.
+	void DoSimpleAvoidanceOutsideSnapshot(FMassEntityManager& EntityManager, float CurrentTime);
+	void DoEntitySimpleAvoidanceWithHandles(FMassEntityManager& EntityManager, const FMassEntityHandle& Entity, TConstArrayView<FMassEntityHandle> Neighbours, float CurrentTime);
+	// Per-entity pass over the snapshot within the avoidance radius, then force deltas are added to fragments in one scatter pass
+	void DoSimpleAvoidanceWithSnapshot(FMassEntityManager& EntityManager, float CurrentTime);
+	// Radius of the cluster or the area of the entity, zero if the entity doesn't avoid
+	void GetAvoidanceParameters(const int32 ClusterType, const int32 AreaId, float& OutRadius, float& OutStrength) const;
+	void DoSimpleAvoidance(FEntityProxyData& EntityData, FEntityProxyData& OtherEntityData, float AvoidanceRadius, float AvoidanceStrength, float CurrentTime);
+	// Side is picked from the per-entity random stream, so results don't depend on the order chunks are processed in
+	void DoToTheSideAvoidance(FCollisionFragment& CollisionFragment, FVector& Force, const FMassEntityHandle& Entity, float Duration, float DeltaTime);
 
 	// ORCA
+	// Sets up agent defaults and obstacles on the first tick with ORCA avoidance
 	void InitializeOrcaSolver();
-	
-	void DoMassORCA(FEntityProxyData& EntityData, TArray<FEntityProxyData>& OtherEntityDatas, float AvoidanceRadius, float AvoidanceStrength, float DeltaTime);
-	static FVector::FReal ComputeClosestPointOfApproach(const FVector RelPos, const FVector RelVel, const FVector::FReal TotalRadius, const FVector::FReal TimeHoriz);
+	// Adds agents of entities collected during the parallel chunk pass. Sorted by entity, so agent indices don't depend on the chunks order.
+	void AddNewOrcaAgents(FMassEntityManager& EntityManager);
+	// Chains obstacle edges into polygons, edges that don't form a closed polygon are added as line obstacles
+	static void AddObstaclesToOrcaSolver(UOrcaSolver& Solver, const UCCSObstaclesHashGrid& ObstaclesHashGrid);
+	void OnPreDestroyEntity(const FMassEntityHandle& Entity);
+	// Removes agents of destroyed entities from the solver, moved agents get their new indices
+	void RemoveDeletedOrcaAgents(FMassEntityManager& EntityManager);
+	// Lets the solver take neighbour candidates from the hash grid snapshot instead of building its agent tree. Snapshot must be locked.
+	void SetOrcaNeighboursFromSnapshot(FMassEntityManager& EntityManager);
+
+	// Predictive avoidance
+	// Separation and closest point of approach steering done chunk-parallel on fragments. Neighbours are read from the hash grid snapshot,
+	// obstacle edges from the obstacles hash grid. Requires the snapshot.
+	void DoPredictiveAvoidance(FMassEntityManager& EntityManager, FMassExecutionContext& Context);
+	static float ComputeClosestPointOfApproach(const FVector2f& RelPos, const FVector2f& RelVel, const float TotalRadius, const float TimeHoriz);
 };
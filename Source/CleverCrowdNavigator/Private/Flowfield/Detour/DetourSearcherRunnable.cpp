@@ -5,6 +5,7 @@
 
 #include "Flowfield/Misc/FlowfieldCalculationFunctionsLibrary.h"
 #include "Grids/GridUtilsFunctionLibrary.h"
+#include "Tasks/Task.h"
 
 
 FDetourSearcherRunnable::FDetourSearcherRunnable(EThreadPriority ThreadPriority, const int32 StackSize)
@@ -73,14 +74,21 @@ void FDetourSearcherRunnable::Main()
 		UpdateCostsInDenseArea(DenseArea);
 	}
 
-	// Calculate detour directions grids using new costs
+	// Calculate detour directions grids using new costs. Goals are independent, each task only writes its own grid.
+	TArray<UE::Tasks::FTask> CalculationTasks;
+	CalculationTasks.Reserve(Payload.GoalsInfos.Num());
 	for (int32 GoalIdx = 0; GoalIdx < Payload.GoalsInfos.Num(); GoalIdx++)
 	{
 		TSharedPtr<FDirectionsGrid> NewDirectionsGrid = MakeShareable<FDirectionsGrid>(new FDirectionsGrid());
-		UFlowfieldCalculationFunctionsLibrary::CalculateDirectionsGrid(*NewDirectionsGrid.Get(), ModifiedCostsGrid,
-		                                                               Payload.GoalsInfos[GoalIdx].CellPosition, Payload.GoalsInfos[GoalIdx].GridSizes);
 		DetourDirectionsGrids.Add(NewDirectionsGrid);
+		CalculationTasks.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, NewDirectionsGrid, GoalIdx]()
+		{
+			UFlowfieldCalculationFunctionsLibrary::CalculateDirectionsGrid(*NewDirectionsGrid.Get(), ModifiedCostsGrid,
+			                                                               Payload.GoalsInfos[GoalIdx].CellPosition, Payload.GoalsInfos[GoalIdx].GridSizes,
+			                                                               Payload.IntegrationMethod);
+		}));
 	}
+	UE::Tasks::Wait(CalculationTasks);
 
 	// Send detour directions grids through game thread
 	FSimpleDelegateGraphTask::CreateAndDispatchWhenReady
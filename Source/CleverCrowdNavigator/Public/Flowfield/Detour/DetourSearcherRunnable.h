@@ -26,6 +26,7 @@ public:
 		FCostsGrid CostsGrid;                  // To increase costs in areas with high collisions count and calculate directions grids
 		FCCSCollisionsHashGrid CollisionsGrid; // To look up areas with high collisions count
 		TArray<GoalInfo> GoalsInfos;            
+		EFlowfieldIntegrationMethod IntegrationMethod = EFlowfieldIntegrationMethod::Dijkstra;
 	} Payload;
 
 	FCalculatedDetoursSignature CalculatedDetoursDelegate;
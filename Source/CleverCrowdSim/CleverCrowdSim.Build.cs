@@ -14,7 +14,7 @@ public class CleverCrowdSim : ModuleRules
 		// Our custom modules
 		PrivateDependencyModuleNames.AddRange(new string[]
 		{
-			"Navigation", "CleverCrowd", "CleverCrowdNavigator", "CCSUtils", "Evaluator"
+			"Navigation", "CleverCrowd", "CleverCrowdNavigator", "CCSUtils", "Evaluator", "ORCA"
 		});
 		
 		// Mass framework modules
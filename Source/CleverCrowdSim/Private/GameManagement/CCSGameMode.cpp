@@ -4,6 +4,7 @@
 #include "CleverCrowdSim/Public/GameManagement/CCSGameMode.h"
 
 #include "EngineUtils.h"
+#include "Collisions/Obstacles/CCSObstaclesHashGrid.h"
 #include "GameEvaluatorSubsystem.h"
 #include "Entity/EntityNotifierSubsystem.h"
 #include "Flowfield/Flowfield.h"
@@ -12,6 +13,7 @@
 #include "Global/CrowdNavigationSubsystem.h"
 #include "Global/CrowdStatisticsSubsystem.h"
 #include "Grids/GridUtilsFunctionLibrary.h"
+#include "HashGrid/CCSEntitiesHashGrid.h"
 #include "Management/CCSEntitiesManagerSubsystem.h"
 #include "Management/CrowdNavigatorSubsystem.h"
 #include "MapAnalyzer/MapAnalyzerSubsystem.h"
@@ -31,9 +33,12 @@ void ACCSGameMode::BeginPlay()
 	CrowdNavigator           = GetWorld()->GetSubsystem<UCrowdNavigatorSubsystem>();
 	CrowdNavigationSubsystem = GetWorld()->GetSubsystem<UCrowdNavigationSubsystem>();
 	CrowdNavigationSubsystem->InitializeNavigation();
+	InitializeEntitiesHashGrid();
 
 	CollisionsSubsystem = GetWorld()->GetSubsystem<UCCSCollisionsSubsystem>();
 	CollisionsSubsystem->InitializeObstaclesOnMap();
+	InitializeCollisionsHashGrid();
+	InitializeObstaclesDistanceField();
 
 	MapAnalyzerSubsystem                           = GetWorld()->GetSubsystem<UMapAnalyzerSubsystem>();
 	USimpleMapClusterDefiner* ClusterDefiner       = NewObject<USimpleMapClusterDefiner>();
@@ -125,6 +130,66 @@ AFlowfield* ACCSGameMode::GetFlowfield()
 	return CrowdNavigationSubsystem->GetFlowfield();
 }
 
+void ACCSGameMode::InitializeEntitiesHashGrid()
+{
+	AFlowfield* Flowfield = GetFlowfield();
+	UCCSEntitiesHashGrid* EntitiesHashGrid = EntitiesManagerSubsystem->GetEntitiesHashGrid();
+	if (!IsValid(Flowfield) || !EntitiesHashGrid)
+	{
+		return;
+	}
+
+	// Flowfield bounds are used as they are, so both grids must have the same cells
+	if (Flowfield->GridSettings.CellSize != EntitiesHashGrid->GetCellSize())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Flowfield and entities hash grid cell sizes differ, the dense storage is not used."), __FUNCTION__);
+		return;
+	}
+
+	FGridBounds FlowfieldBounds;
+	Flowfield->GetGridBounds(FlowfieldBounds);
+	EntitiesHashGrid->InitializeDenseStorage(FlowfieldBounds);
+}
+
+void ACCSGameMode::InitializeCollisionsHashGrid()
+{
+	AFlowfield* Flowfield = GetFlowfield();
+	if (!IsValid(Flowfield))
+	{
+		return;
+	}
+
+	FCCSCollisionsHashGrid& CollisionsHashGrid = CollisionsSubsystem->GetCollisionsHashGrid();
+	if (Flowfield->GridSettings.CellSize != CollisionsHashGrid.GetCellSize())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Flowfield and collisions hash grid cell sizes differ, collisions are counted under the lock."), __FUNCTION__);
+		return;
+	}
+
+	FGridBounds FlowfieldBounds;
+	Flowfield->GetGridBounds(FlowfieldBounds);
+	CollisionsHashGrid.InitializeCellCounters(FlowfieldBounds);
+}
+
+void ACCSGameMode::InitializeObstaclesDistanceField()
+{
+	AFlowfield* Flowfield = GetFlowfield();
+	if (!IsValid(Flowfield))
+	{
+		return;
+	}
+
+	if (Flowfield->GridSettings.CellSize != CollisionsSubsystem->GetObstaclesHashGrid()->GetCellSize())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Flowfield and obstacles hash grid cell sizes differ, the obstacles distance field is not built."), __FUNCTION__);
+		return;
+	}
+
+	FGridBounds FlowfieldBounds;
+	Flowfield->GetGridBounds(FlowfieldBounds);
+	CollisionsSubsystem->InitializeObstaclesDistanceField(FlowfieldBounds);
+}
+
 void ACCSGameMode::InitDetoursSearcher()
 {
 	check(IsValid(CrowdNavigator));
@@ -135,6 +200,7 @@ void ACCSGameMode::InitDetoursSearcher()
 	
 	FDetourSearcherRunnable::FPayload DetourPayload;
 	DetourPayload.CostsGrid = *CrowdNavigationSubsystem->GetFlowfield()->CostsGrid.Get();
+	CollisionsSubsystem->GetCollisionsHashGrid().MergePendingCollisions();	// Copy has to include the latest collisions
 	DetourPayload.CollisionsGrid = CollisionsSubsystem->GetCollisionsHashGrid();
 
 	TArray<FDetourSearcherRunnable::GoalInfo> GoalsInfos;
@@ -150,7 +216,8 @@ void ACCSGameMode::InitDetoursSearcher()
 		GoalInfo.GridSizes    = GoalPoint->GetGridSizes();
 		GoalsInfos.Add(GoalInfo);
 	}
-	DetourPayload.GoalsInfos = GoalsInfos;
+	DetourPayload.GoalsInfos        = GoalsInfos;
+	DetourPayload.IntegrationMethod = CrowdNavigationSubsystem->GetFlowfield()->GridSettings.IntegrationMethod;
 	
 	DetourSearcherRunnable->StartCalculation(DetourPayload);
 }
@@ -185,41 +185,27 @@ void UMapAnalyzerSubsystem::EvaluateMapAreaDataInBounds(FMapAreaData& OutAreaDat
 	OutAreaData.ObstacleCellsFraction = static_cast<float>(ObstacleCellsNum) / AllCellsNum;
 
 	// (Average) ObstaclesIslandSize param ------
-	TMap<FGridCellPosition, int32> ObstacleCellsByIslands;	// [ObstacleCell][IslandIndex]
-	TArray<FGridCellPosition> CellsWithObstaclesTemp = CellsWithObstacles;
-	TArray<float> IslandsSizes;
-	int32 IslandIndex = 0;
-	while (CellsWithObstaclesTemp.IsEmpty() == false)
+	TBitArray<> ObstacleCellsBits(false, AllCellsNum);
+	for (const FGridCellPosition& Cell : CellsWithObstacles)
 	{
-		int32 ObstacleCellsCounter = 0;
-		TQueue<FGridCellPosition> CellsQueue;
-		TSet<FGridCellPosition> VisitedCells;
-		CellsQueue.Enqueue(CellsWithObstaclesTemp[0]);
-		VisitedCells.Add(CellsWithObstaclesTemp[0]);
-
-		FGridCellPosition Cell;
-		while (CellsQueue.Dequeue(Cell))
+		if (Bounds.IsCellInBounds(Cell))
 		{
-			ObstacleCellsCounter += 1;
-			CellsWithObstaclesTemp.Remove(Cell);
-			ObstacleCellsByIslands.Add(Cell, IslandIndex);
-
-			TArray<FGridCellPosition> AdjacentCells;
-			UGridUtilsFunctionLibrary::GetAdjacentCells4(AdjacentCells, Cell);
-			for (const FGridCellPosition& AdjacentCell : AdjacentCells)
-			{
-				if (!CellsWithObstaclesTemp.Contains(AdjacentCell) || VisitedCells.Contains(AdjacentCell))
-				{
-					continue;
-				}
-				VisitedCells.Add(AdjacentCell);
-				CellsQueue.Enqueue(AdjacentCell);
-			}
+			ObstacleCellsBits[Bounds.GetCellIndex(Cell)] = true;
 		}
-		
-		IslandsSizes.Add(static_cast<float>(ObstacleCellsCounter) / AllCellsNum);
-		IslandIndex += 1;
 	}
+	TArray<FGridConnectedComponent> Islands;
+	TArray<int32> IslandIndexOfCells;	// [CellIndexInBounds][IslandIndex]
+	UGridUtilsFunctionLibrary::LabelConnectedComponents(Islands, IslandIndexOfCells, Bounds, ObstacleCellsBits);
+	
+	TArray<float> IslandsSizes;
+	for (const FGridConnectedComponent& Island : Islands)
+	{
+		IslandsSizes.Add(static_cast<float>(Island.CellsNum) / AllCellsNum);
+	}
+	const auto GetIslandIndex = [&Bounds, &IslandIndexOfCells](const FGridCellPosition& Cell)
+	{
+		return Bounds.IsCellInBounds(Cell) ? IslandIndexOfCells[Bounds.GetCellIndex(Cell)] : INDEX_NONE;
+	};
 
 	float IslandSizesSum = 0;
 	for (float IslandSize : IslandsSizes)
@@ -232,12 +218,12 @@ void UMapAnalyzerSubsystem::EvaluateMapAreaDataInBounds(FMapAreaData& OutAreaDat
 	FAggregatedValueFloat NormalizedAggregatedProximity;
 	for (const FGridCellPosition& Cell : CellsWithObstacles)
 	{
-		const int32 CurrentIslandIndex = *ObstacleCellsByIslands.Find(Cell);
+		const int32 CurrentIslandIndex = GetIslandIndex(Cell);
 		int32 OtherIslandsNearbyCells = 0;
-		auto CountNearbyCellsLambda = [this, CurrentIslandIndex, &OtherIslandsNearbyCells, &ObstacleCellsByIslands](const FGridCellPosition& OtherCell)
+		auto CountNearbyCellsLambda = [CurrentIslandIndex, &OtherIslandsNearbyCells, &GetIslandIndex](const FGridCellPosition& OtherCell)
 		{
-			const int32* OtherIslandIndex = ObstacleCellsByIslands.Find(OtherCell);
-			if (OtherIslandIndex != nullptr && *OtherIslandIndex != CurrentIslandIndex)
+			const int32 OtherIslandIndex = GetIslandIndex(OtherCell);
+			if (OtherIslandIndex != INDEX_NONE && OtherIslandIndex != CurrentIslandIndex)
 			{
 				OtherIslandsNearbyCells += 1;
 			}
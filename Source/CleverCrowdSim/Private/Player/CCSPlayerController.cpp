@@ -5,8 +5,15 @@
 
 #include "CrowdEvaluationHashGrid.h"
 #include "GameEvaluatorSubsystem.h"
+#include "Collisions/CCSCollisionsProcessor.h"
+#include "Flowfield/TiledFlowfield.h"
+#include "Flowfield/Misc/FlowfieldCalculationFunctionsLibrary.h"
 #include "GameManagement/GCCGameInstance.h"
+#include "HashGrid/CCSEntitiesHashGrid.h"
 #include "Kismet/GameplayStatics.h"
+#include "OrcaSolver.h"
+#include "Management/CCSCollisionsSubsystem.h"
+#include "Management/CCSEntitiesManagerSubsystem.h"
 
 
 void ACCSPlayerController::ClearSaves(bool bClearParams, bool bClearMapAreas, int32 Mode)
@@ -71,6 +78,40 @@ void ACCSPlayerController::CCS_SaveEvaluationData()
 	GameEvaluator->WriteEvaluationDataToFileAsText();
 }
 
+void ACCSPlayerController::CCS_BenchmarkCollisionKernels(int32 Iterations)
+{
+	UCCSCollisionsProcessor::BenchmarkSnapshotKernels({1000, 4000, 16000}, FMath::Max(Iterations, 1));
+}
+
+void ACCSPlayerController::CCS_CompareObstacleCollisionBackends(int32 SamplesNum)
+{
+	UCCSCollisionsSubsystem* CollisionsSubsystem = GetWorld()->GetSubsystem<UCCSCollisionsSubsystem>();
+	CollisionsSubsystem->BuildObstaclesDistanceFieldIfNeeded();	// Collisions don't read the field unless bUseObstaclesDistanceField is set, so it's baked on demand
+	UCCSCollisionsProcessor::CompareObstacleCollisionBackends(*CollisionsSubsystem, FMath::Max(SamplesNum, 1));
+}
+
+void ACCSPlayerController::CCS_BenchmarkOrcaSteps(int32 StepsNum)
+{
+	UOrcaSolver::BenchmarkSteps({1000, 4000, 16000}, FMath::Max(StepsNum, 1));
+}
+
+void ACCSPlayerController::CCS_BenchmarkFlowfieldIntegration(int32 Iterations)
+{
+	UFlowfieldCalculationFunctionsLibrary::BenchmarkIntegration({100, 250, 500, 1000}, FMath::Max(Iterations, 1));
+}
+
+void ACCSPlayerController::CCS_CheckTiledFlowfieldCycles(int32 TileSize)
+{
+	FTiledFlowfield::CheckPathsReachGoals({100, 250, 500}, TileSize);
+}
+
+void ACCSPlayerController::CCS_SetHashGridUpdateMode(int32 Mode)
+{
+	UCCSEntitiesHashGrid* EntitiesHashGrid = GetWorld()->GetSubsystem<UCCSEntitiesManagerSubsystem>()->GetEntitiesHashGrid();
+	const EEntitiesHashGridUpdateMode NewUpdateMode = Mode == 1 ? EEntitiesHashGridUpdateMode::Incremental : EEntitiesHashGridUpdateMode::FullRebuild;
+	EntitiesHashGrid->SetUpdateMode(NewUpdateMode);	// The grid logs the time of the previous mode when it switches
+}
+
 void ACCSPlayerController::DebugDrawCrowdGroupAreasAveraged()
 {
 	GetWorld()->GetGameInstance()->GetSubsystem<UGameEvaluatorSubsystem>()->GetEvaluationHashGrid()->DebugDrawCrowdGroupAreasAveraged(GetWorld(), 5.f, 15.f);
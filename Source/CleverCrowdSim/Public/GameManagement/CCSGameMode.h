@@ -62,6 +62,9 @@ public:
 
 private:
 
+	void InitializeEntitiesHashGrid();
+	void InitializeCollisionsHashGrid();
+	void InitializeObstaclesDistanceField();
 	void InitDetoursSearcher();
 	void ApplyDetourDirectionsGrids(TArray<TSharedPtr<FDirectionsGrid>> DetourDirectionsGrids, TArray<FGridBounds> DenseAreas);
 };
@@ -24,6 +24,20 @@ public:
 	void CCS_SaveMapAreasData();
 	UFUNCTION(Exec)
 	void CCS_SaveEvaluationData();
+
+	UFUNCTION(Exec)
+	void CCS_BenchmarkCollisionKernels(int32 Iterations = 20);
+	UFUNCTION(Exec)
+	void CCS_CompareObstacleCollisionBackends(int32 SamplesNum = 100000);
+	UFUNCTION(Exec)
+	void CCS_BenchmarkOrcaSteps(int32 StepsNum = 50);
+	UFUNCTION(Exec)
+	void CCS_BenchmarkFlowfieldIntegration(int32 Iterations = 3);
+	UFUNCTION(Exec)
+	void CCS_CheckTiledFlowfieldCycles(int32 TileSize = 16);
+	// 0 - full rebuild, 1 - incremental. Logs the mean update time of the previous mode and starts measuring anew.
+	UFUNCTION(Exec)
+	void CCS_SetHashGridUpdateMode(int32 Mode = 0);
 	
 	UFUNCTION(BlueprintCallable, Category = "Debug")
 	void DebugDrawCrowdGroupAreasAveraged();
@@ -42,77 +42,92 @@ void ACrowdEvaluationHashGrid::MakeCrowdGroupAreasSnapshot()
 	{
 		RecalculateAveragedGroupAreasStats();
 	}
+
+	TArray<FCrowdGroupAreaSnapshot> Snapshots;
+	MakeGroupAreaSnapshots(Snapshots);
 	
-	while (!CrowdGroupCells.IsEmpty())
+	for (FCrowdGroupAreaSnapshot& Snapshot : Snapshots)
 	{
-		bool bFoundNonDefaultGroup = false;
-		
-		for (const auto& [CrowdGroupCell, CellData] : CrowdGroupCells)
-		{
-			if (CellData.AgentsOfGroups.GetTotalAgents() == CellData.AgentsOfGroups.GetAgentsOfGroup(0))
-			{
-				continue;
-			}
-			bFoundNonDefaultGroup = true;
-
-			FCrowdGroupAreaSnapshot Snapshot;
-			MakeGroupAreaSnapshotFromCell(Snapshot, CrowdGroupCell);
-
-			if (Snapshot.Bounds.GetArea() < MinCrowdGroupArea)
-			{
-				break;
-			}
-			
-			Snapshot.Bounds.Expand(1);
-			const bool bMergedWithOtherBounds = AssignGroupTypeAndTryMerge(Snapshot);
-			
-			break;
-		}
-		if (!bFoundNonDefaultGroup)
+		if (Snapshot.Bounds.GetArea() < MinCrowdGroupArea)
 		{
-			break;
+			continue;
 		}
+		
+		Snapshot.Bounds.Expand(1);
+		const bool bMergedWithOtherBounds = AssignGroupTypeAndTryMerge(Snapshot);
 	}
 
 	OnMadeGroupAreasSnapshotDelegate.Broadcast();
 }
 
-void ACrowdEvaluationHashGrid::MakeGroupAreaSnapshotFromCell(FCrowdGroupAreaSnapshot& OutSnapshot, const FGridCellPosition& InitCellPosition)
+void ACrowdEvaluationHashGrid::MakeGroupAreaSnapshots(TArray<FCrowdGroupAreaSnapshot>& OutSnapshots)
 {
-	OutSnapshot        = FCrowdGroupAreaSnapshot();
-	OutSnapshot.Bounds = FGridBounds{InitCellPosition, InitCellPosition};
-
-	TQueue<FGridCellPosition> CellsQueue;
-	TSet<FGridCellPosition> VisitedCells;
-	CellsQueue.Enqueue(InitCellPosition);
-	VisitedCells.Add(InitCellPosition);
+	OutSnapshots.Reset();
+	
+	// Cells with agents of GroupIndex == 0 only don't form areas, they are added to statistics of adjacent areas
+	const auto IsDefaultGroupCell = [](const FCrowdGroupCell& GroupCell)
+	{
+		return GroupCell.AgentsOfGroups.GetTotalAgents() == GroupCell.AgentsOfGroups.GetAgentsOfGroup(0);
+	};
 
-	FGridCellPosition Cell;
-	while (CellsQueue.Dequeue(Cell))
+	TOptional<FGridBounds> CellsBounds;
+	for (const auto& [CellPosition, GroupCell] : CrowdGroupCells)
 	{
-		// If a cell contains only agents of GroupIndex == 0, add the cell to statistics but ignore when updating bounds
-		FCrowdGroupCell& GroupCell = CrowdGroupCells[Cell];
-		if (GroupCell.AgentsOfGroups.GetTotalAgents() == GroupCell.AgentsOfGroups.GetAgentsOfGroup(0))
+		if (IsDefaultGroupCell(GroupCell))
 		{
-			OutSnapshot.AgentsOfGroups.AddAgentsFromGroup(GroupCell.AgentsOfGroups);
-			CrowdGroupCells.Remove(Cell);
 			continue;
 		}
+		if (!CellsBounds.IsSet())
+		{
+			CellsBounds = FGridBounds{CellPosition, CellPosition};
+		}
+		CellsBounds->UpdateToFitCell(CellPosition);
+	}
+	if (!CellsBounds.IsSet())
+	{
+		return;
+	}
+
+	const FGridBounds& Bounds = CellsBounds.GetValue();
+	TBitArray<> GroupCellsBits(false, Bounds.GetCols() * Bounds.GetRows());
+	for (const auto& [CellPosition, GroupCell] : CrowdGroupCells)
+	{
+		if (!IsDefaultGroupCell(GroupCell))
+		{
+			GroupCellsBits[Bounds.GetCellIndex(CellPosition)] = true;
+		}
+	}
 
-		OutSnapshot.AgentsOfGroups.AddAgentsFromGroup(GroupCell.AgentsOfGroups);
-		OutSnapshot.Bounds.UpdateToFitCell(Cell);
-		CrowdGroupCells.Remove(Cell);
+	TArray<FGridConnectedComponent> Components;
+	TArray<int32> Labels;
+	UGridUtilsFunctionLibrary::LabelConnectedComponents(Components, Labels, Bounds, GroupCellsBits);
+
+	OutSnapshots.SetNum(Components.Num());
+	for (int32 ComponentIndex = 0; ComponentIndex < Components.Num(); ComponentIndex++)
+	{
+		OutSnapshots[ComponentIndex].Bounds = Components[ComponentIndex].Bounds;
+	}
+
+	for (TConstSetBitIterator<> It(GroupCellsBits); It; ++It)
+	{
+		const FGridCellPosition CellPosition = Bounds.GetCellPositionAtIndex(It.GetIndex());
+		FCrowdGroupAreaSnapshot& Snapshot    = OutSnapshots[Labels[It.GetIndex()]];
+		
+		Snapshot.AgentsOfGroups.AddAgentsFromGroup(CrowdGroupCells.FindChecked(CellPosition).AgentsOfGroups);
+		CrowdGroupCells.Remove(CellPosition);
 
+		// Adjacent default group cells are counted once, by the first area that reaches them
 		TArray<FGridCellPosition> AdjacentCells;
-		UGridUtilsFunctionLibrary::GetAdjacentCells4(AdjacentCells, Cell);
+		UGridUtilsFunctionLibrary::GetAdjacentCells4(AdjacentCells, CellPosition);
 		for (const FGridCellPosition& AdjacentCell : AdjacentCells)
 		{
-			if (!CrowdGroupCells.Contains(AdjacentCell) || VisitedCells.Contains(AdjacentCell))
+			const FCrowdGroupCell* AdjacentGroupCell = CrowdGroupCells.Find(AdjacentCell);
+			if (AdjacentGroupCell == nullptr || !IsDefaultGroupCell(*AdjacentGroupCell))
 			{
 				continue;
 			}
-			VisitedCells.Add(AdjacentCell);
-			CellsQueue.Enqueue(AdjacentCell);
+			Snapshot.AgentsOfGroups.AddAgentsFromGroup(AdjacentGroupCell->AgentsOfGroups);
+			CrowdGroupCells.Remove(AdjacentCell);
 		}
 	}
 }
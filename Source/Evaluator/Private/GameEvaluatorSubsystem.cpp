@@ -8,6 +8,7 @@
 #include "MassSpawner.h"
 #include "Common/Clusters/CrowdClusterTypes.h"
 #include "Global/CrowdStatisticsSubsystem.h"
+#include "HashGrid/CCSEntitiesHashGrid.h"
 #include "Kismet/GameplayStatics.h"
 #include "Management/CrowdNavigatorSubsystem.h"
 #include "Management/CCSCollisionsSubsystem.h"
@@ -115,6 +116,8 @@ void UGameEvaluatorSubsystem::SaveTestData()
 	constexpr int32 ClustersNum = FCrowdStatistics::MaxClusterType;
 	
 	MetricParams.TestDuration.Get() = World->GetTimeSeconds();
+	MetricParams.UserParam01.Get()  = EntityManagerSubsystem->GetEntitiesHashGrid()->UpdateTime.GetMean();
+	MetricParams.UserParam02.Get()  = CrowdStatisticsSubsystem->Stats.OrcaAgentTreeTime.GetMean();
 
 	for (int32 ClusterType = 0; ClusterType < ClustersNum; ClusterType++)
 	{
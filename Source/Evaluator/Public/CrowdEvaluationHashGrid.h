@@ -238,7 +238,8 @@ public:
 	int32 GetAreaIdAtLocation(const FVector& Location) const;
 
 private:
-	void MakeGroupAreaSnapshotFromCell(FCrowdGroupAreaSnapshot& OutSnapshot, const FGridCellPosition& InitCellPosition);
+	// Consumes CrowdGroupCells: groups 4-connected cells with non-default agents into areas in one labelling pass
+	void MakeGroupAreaSnapshots(TArray<FCrowdGroupAreaSnapshot>& OutSnapshots);
 	// Merges the specified snapshot into another overlapping snapshot with overlapping Bounds (merges into a snapshot with the bigger bounds area)
 	bool AssignGroupTypeAndTryMerge(FCrowdGroupAreaSnapshot& Snapshot);
 	void SearchIntersectingGroupsOnSnapshots(int32& OutMaxIntersectingGroupId, int32& OutMaxIntersectionArea, FCrowdGroupAreaSnapshotsContainer*& OutSnapshotsContainer, FCrowdGroupAreaSnapshot& Snapshot,
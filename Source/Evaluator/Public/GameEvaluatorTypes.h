@@ -287,7 +287,7 @@ struct EVALUATOR_API FEvaluatorMetaParamsContainer
 	TEvaluatorMetaArealParam<float> AvoidanceRadiusAreal{{"AvoRad", 150.f, {50.f, 270.f}, 40.f, false, true}};
 	TEvaluatorMetaArealParam<float> ToTheSideAvoidanceDurationAreal{{"SideAvoDur", 4.f, {0.f, 5.f}, 0.f, false, false}};
 	TEvaluatorMetaParam<float> DefaultToTheSideAvoidanceDuration{"SideAvoDur", 4.f, {0.f, 5.f}, 0.f, false, false};
-	TEvaluatorMetaParam<int32> AvoidanceType{"AvoidanceType", 1, {0, 2}, 0, false, false};	// Avoidance algorithms switcher. Currently, for all areas at once.
+	TEvaluatorMetaParam<int32> AvoidanceType{"AvoidanceType", 1, {0, 3}, 0, false, false};	// Avoidance algorithms switcher (0 - to the side, 1 - simple, 2 - ORCA, 3 - predictive). Currently, for all areas at once.
 	
 	TEvaluatorMetaParam<float> AgentMovementSpeedSpaciousCluster{"SpeedClustSpac", 50.f, {40.f, 80.f}, 0.f};
 	TEvaluatorMetaParam<float> AgentMovementSpeedDenseCluster{"SpeedClustDense", 50.f, {40.f, 80.f}, 0.f};
@@ -426,8 +426,8 @@ struct EVALUATOR_API FEvaluatorMetricParamsContainer
 	TEvaluatorMetricArealParam<float> AverageEntityTimeInAreas{"AvgTimeIn"};
 	TEvaluatorMetricParam<float> AverageEntityFinishedTime{"AvgFinishTime"};
 
-	TEvaluatorMetricParam<float> UserParam01{"UserParam01"};	// User params one may use to avoid incompatibility with old save files
-	TEvaluatorMetricParam<float> UserParam02{"UserParam02"};
+	TEvaluatorMetricParam<float> UserParam01{"AvgHashGridTime"};	// User params one may use to avoid incompatibility with old save files. 01: average entities hash grid update time (part of AvgMassProcTime)
+	TEvaluatorMetricParam<float> UserParam02{"AvgOrcaTreeTime"};	// 02: average ORCA agent tree build time per step (part of AvgMassProcTime)
 
 	friend FArchive& operator <<(FArchive& Ar, FEvaluatorMetricParamsContainer& Container)
 	{
@@ -452,6 +452,8 @@ struct EVALUATOR_API FEvaluatorMetricParamsContainer
 		TestDuration.WriteNameIntoString(OutString);
 		AggregatedTickTime.WriteNameIntoString(OutString);
 		AggregatedMassProcExecutionTime.WriteNameIntoString(OutString);
+		UserParam01.WriteNameIntoString(OutString);
+		UserParam02.WriteNameIntoString(OutString);
 		AggregatedEntitiesMovementSpeed.WriteNameIntoString(OutString);
 		AggregatedEntitiesMovementSpeedInClusters.WriteNameIntoString(OutString);
 		AggregatedEntitiesMovementSpeedAreal.WriteNameIntoString(OutString);
@@ -467,6 +469,8 @@ struct EVALUATOR_API FEvaluatorMetricParamsContainer
 		OutString += FString::SanitizeFloat(TestDuration.Get()) + ",";
 		OutString += FString::SanitizeFloat(AggregatedTickTime.Get().GetMean()) + ",";
 		OutString += FString::SanitizeFloat(AggregatedMassProcExecutionTime.Get().GetMean()) + ",";
+		OutString += FString::SanitizeFloat(UserParam01.Get()) + ",";
+		OutString += FString::SanitizeFloat(UserParam02.Get()) + ",";
 		OutString += FString::SanitizeFloat(AggregatedEntitiesMovementSpeed.Get().GetMean()) + ",";
 		
 		for (int32 i = 0; i < AggregatedEntitiesMovementSpeedInClusters.GetClustersNum(); i++)
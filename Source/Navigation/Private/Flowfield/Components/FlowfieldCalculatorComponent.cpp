@@ -7,8 +7,16 @@
 #include "Flowfield/GoalPoint.h"
 #include "Flowfield/Misc/FlowfieldCalculationFunctionsLibrary.h"
 #include "Flowfield/Misc/GridsFunctionsLibrary.h"
+#include "Flowfield/NavigationAffector/Interfaces/NavigationAffector.h"
+#include "Flowfield/TiledFlowfield.h"
 #include "Grids/GridUtilsFunctionLibrary.h"
+#include "Async/ParallelFor.h"
+#include "EngineUtils.h"
 #include "Kismet/GameplayStatics.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Tasks/Task.h"
 
 
 UFlowfieldCalculatorComponent::UFlowfieldCalculatorComponent()
@@ -50,28 +58,165 @@ void UFlowfieldCalculatorComponent::RecalculateCostsGrid()
 	FGridBounds FlowfieldGridBounds;
 	const int32 GridCellSize = Flowfield->GridSettings.CellSize;
 	UGridsFunctionsLibrary::GetGridAreaBounds(FlowfieldGridBounds, Flowfield->GetActorLocation(), Flowfield->GridSettings.GridSizes, GridCellSize);
+	Flowfield->CostsGrid->Initialize(FlowfieldGridBounds);
+
+	// Costs are read once per actor, and the same actors state means the same bake result
+	TMap<const AActor*, uint8> ActorsCosts;
+	FCostsGridCacheKey CacheKey;
+	GatherNavigationActors(ActorsCosts, CacheKey);
+	CacheKey.Bounds   = FlowfieldGridBounds;
+	CacheKey.CellSize = GridCellSize;
+	if (Flowfield->GridSettings.bCacheCostsGridOnDisk && LoadCostsGridFromCache(*Flowfield->CostsGrid.Get(), CacheKey))
+	{
+		UE_LOG(LogTemp, Display, TEXT("[%hs] Costs grid has been loaded from cache."), __FUNCTION__);
+		return;
+	}
 	
 	// Sweep cubes of CellSize in each cell location to check if a walkable surface is there.
+	// Scene queries are read-only, so rows are swept in parallel. Only hit actors are stored, costs are assigned on the game thread.
 	// @note You can add "Walkable Surface type" checks to assign different costs in different areas of the map. 
-	UGridUtilsFunctionLibrary::ForEachGridCell(FlowfieldGridBounds, [this, GridCellSize](const FGridCellPosition& CellPosition)
+	const UWorld* World = GetWorld();
+	TArray<AActor*> HitActors;
+	HitActors.SetNumZeroed(FlowfieldGridBounds.GetCols() * FlowfieldGridBounds.GetRows());
+	ParallelFor(TEXT("FlowfieldCostsSweeps"), FlowfieldGridBounds.GetRows(), 1, [World, &FlowfieldGridBounds, &HitActors, GridCellSize](const int32 Row)
 	{
-		FHitResult HitResults;
-		const FVector CellLocation = UGridUtilsFunctionLibrary::GetGridCellLocationAtPosition(CellPosition, GridCellSize);
 		const FCollisionShape TraceShape = FCollisionShape::MakeBox(FVector(GridCellSize, GridCellSize, GridCellSize));
+		for (int32 Col = 0; Col < FlowfieldGridBounds.GetCols(); ++Col)
+		{
+			const FGridCellPosition CellPosition{FlowfieldGridBounds.BottomLeftCell.X + Col, FlowfieldGridBounds.BottomLeftCell.Y + Row};
+			const FVector CellLocation = UGridUtilsFunctionLibrary::GetGridCellLocationAtPosition(CellPosition, GridCellSize);
 
-		GetWorld()->SweepSingleByChannel(HitResults,
-										CellLocation + FVector(0, 0, TraceStartHeight),
-										CellLocation + FVector(0, 0, TraceEndHeight),
-										FQuat{}, UE::NavigationGlobals::NavigationAffectorChannel, TraceShape);
+			FHitResult HitResults;
+			World->SweepSingleByChannel(HitResults,
+			                            CellLocation + FVector(0, 0, TraceStartHeight),
+			                            CellLocation + FVector(0, 0, TraceEndHeight),
+			                            FQuat{}, UE::NavigationGlobals::NavigationAffectorChannel, TraceShape);
+			if (HitResults.IsValidBlockingHit())
+			{
+				HitActors[FlowfieldGridBounds.GetCellIndex(CellPosition)] = HitResults.GetActor();
+			}
+		}
+	});
 
-		uint8 CellCost = UE::NavigationGlobals::MaxCost;
-		if (HitResults.IsValidBlockingHit() && IsValid(HitResults.GetActor()))
+	TArray<FCostsGridCell>& CostCells = Flowfield->CostsGrid->Cells.Values;
+	for (int32 CellIndex = 0; CellIndex < HitActors.Num(); ++CellIndex)
+	{
+		AActor* HitActor = HitActors[CellIndex];
+		if (!IsValid(HitActor))
+		{
+			continue;	// Stays at max cost
+		}
+		
+		const uint8* ActorCost = ActorsCosts.Find(HitActor);
+		if (!ActorCost)
 		{
-			CellCost = UFlowfieldCalculationFunctionsLibrary::GetNavigationAffectorCost(HitResults.GetActor());
+			// Hit actor wasn't gathered, so its cost is read here once
+			ActorCost = &ActorsCosts.Add(HitActor, UFlowfieldCalculationFunctionsLibrary::GetNavigationAffectorCost(HitActor));
 		}
+		CostCells[CellIndex].Cost = *ActorCost;
+	}
 
-		Flowfield->CostsGrid.Get()->AddCell(CellPosition, CellCost);
-	});
+	if (Flowfield->GridSettings.bCacheCostsGridOnDisk)
+	{
+		SaveCostsGridToCache(*Flowfield->CostsGrid.Get(), CacheKey);
+	}
+}
+
+void UFlowfieldCalculatorComponent::GatherNavigationActors(TMap<const AActor*, uint8>& OutActorsCosts, FCostsGridCacheKey& OutCacheKey) const
+{
+	UWorld* World            = GetWorld();
+	OutCacheKey.MapPackage   = UWorld::RemovePIEPrefix(World->GetOutermost()->GetName());
+	OutCacheKey.ActorsHashes.Reset();
+
+	// Every actor that blocks the navigation channel may be hit by the sweeps
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		AActor* Actor = *It;
+		bool bBlocksNavigationChannel = false;
+		Actor->ForEachComponent<UPrimitiveComponent>(false, [&bBlocksNavigationChannel](const UPrimitiveComponent* Component)
+		{
+			bBlocksNavigationChannel |= Component->IsCollisionEnabled()
+				&& Component->GetCollisionResponseToChannel(UE::NavigationGlobals::NavigationAffectorChannel) == ECR_Block;
+		});
+		if (!bBlocksNavigationChannel)
+		{
+			continue;
+		}
+
+		uint8 Cost = UE::NavigationGlobals::MaxCost;
+		if (Actor->Implements<UNavigationAffector>())
+		{
+			Cost = UFlowfieldCalculationFunctionsLibrary::GetNavigationAffectorCost(Actor);
+			OutActorsCosts.Add(Actor, Cost);
+		}
+
+		const FTransform& Transform = Actor->GetActorTransform();
+		const FVector Location      = Transform.GetLocation();
+		const FQuat Rotation        = Transform.GetRotation();
+		const FVector Scale         = Transform.GetScale3D();
+		uint32 ActorHash            = FCrc::StrCrc32(*Actor->GetName());	// FName hashes aren't stable between runs
+		ActorHash                   = FCrc::MemCrc32(&Location, sizeof(Location), ActorHash);
+		ActorHash                   = FCrc::MemCrc32(&Rotation, sizeof(Rotation), ActorHash);
+		ActorHash                   = FCrc::MemCrc32(&Scale, sizeof(Scale), ActorHash);
+		OutCacheKey.ActorsHashes.Add(HashCombine(ActorHash, Cost));
+	}
+
+	OutCacheKey.ActorsHashes.Sort();	// Iteration order of actors isn't stable between runs
+}
+
+FString UFlowfieldCalculatorComponent::GetCostsGridCacheFilePath(const FCostsGridCacheKey& CacheKey)
+{
+	FString FileName = CacheKey.MapPackage;
+	FileName.ReplaceCharInline('/', '_');
+	return FPaths::ProjectSavedDir() + "/Flowfield/CostsGrids/" + FileName + ".bin";
+}
+
+bool UFlowfieldCalculatorComponent::LoadCostsGridFromCache(FCostsGrid& OutCostsGrid, const FCostsGridCacheKey& CacheKey)
+{
+	const FString CacheFilePath = GetCostsGridCacheFilePath(CacheKey);
+	TArray<uint8> BinData;
+	if (!FPaths::FileExists(CacheFilePath) || !FFileHelper::LoadFileToArray(BinData, *CacheFilePath))
+	{
+		return false;
+	}
+
+	FMemoryReader Ar = FMemoryReader(BinData, true);
+	FCostsGridCacheKey SavedKey;
+	TArray<uint8> Costs;
+	Ar << SavedKey;
+	Ar << Costs;
+	if (Ar.IsError() || !(SavedKey == CacheKey) || Costs.Num() != OutCostsGrid.Cells.Num())
+	{
+		UE_LOG(LogTemp, Log, TEXT("[%hs] Costs grid cache is outdated."), __FUNCTION__);
+		return false;
+	}
+
+	for (int32 CellIndex = 0; CellIndex < Costs.Num(); ++CellIndex)
+	{
+		OutCostsGrid.Cells.Values[CellIndex].Cost = Costs[CellIndex];
+	}
+	return true;
+}
+
+void UFlowfieldCalculatorComponent::SaveCostsGridToCache(const FCostsGrid& CostsGrid, const FCostsGridCacheKey& CacheKey)
+{
+	TArray<uint8> Costs;
+	Costs.Reserve(CostsGrid.Cells.Num());
+	for (const FCostsGridCell& Cell : CostsGrid.Cells.Values)
+	{
+		Costs.Add(Cell.Cost);
+	}
+
+	TArray<uint8> BinData;
+	FMemoryWriter Ar = FMemoryWriter(BinData, true);
+	FCostsGridCacheKey Key = CacheKey;
+	Ar << Key;
+	Ar << Costs;
+
+	if (!FFileHelper::SaveArrayToFile(BinData, *GetCostsGridCacheFilePath(CacheKey)))
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%hs] Failed to save costs grid cache."), __FUNCTION__);
+	}
 }
 
 void UFlowfieldCalculatorComponent::CalculateDirectionsGridToGoalPoint(TSharedPtr<FDirectionsGrid> DirectionsGrid, AGoalPoint* GoalPoint)
@@ -83,11 +228,76 @@ void UFlowfieldCalculatorComponent::CalculateDirectionsGridToGoalPoint(TSharedPt
 	
 	FDirectionsGrid NewDirectionsGrid;
 	DirectionsGrid->GoalPoint = GoalPoint;
-	UFlowfieldCalculationFunctionsLibrary::CalculateDirectionsGrid(*DirectionsGrid.Get(), *Flowfield->CostsGrid.Get(), GoalCellPosition, GoalPoint->GridSizes);
+	UFlowfieldCalculationFunctionsLibrary::CalculateDirectionsGrid(*DirectionsGrid.Get(), *Flowfield->CostsGrid.Get(), GoalCellPosition, GoalPoint->GridSizes,
+	                                                               Flowfield->GridSettings.IntegrationMethod);
 
 	GoalPoint->OwningDirectionsGrid = DirectionsGrid;
 }
 
+void UFlowfieldCalculatorComponent::CalculateDirectionsGridsToGoalPoints(const TArray<AGoalPoint*>& GoalPoints)
+{
+	check (Flowfield->CostsGrid.IsValid());
+
+	if (Flowfield->GridSettings.bUseTiledDirections)
+	{
+		InitializeTiledDirections(GoalPoints);
+		return;
+	}
+	Flowfield->TiledFlowfield.Reset();
+
+	const FCostsGrid& CostsGrid                         = *Flowfield->CostsGrid.Get();
+	const EFlowfieldIntegrationMethod IntegrationMethod = Flowfield->GridSettings.IntegrationMethod;
+
+	// Goal points are read on the game thread. Tasks only read the shared costs grid and write their own directions grid.
+	TArray<UE::Tasks::FTask> CalculationTasks;
+	CalculationTasks.Reserve(GoalPoints.Num());
+	for (AGoalPoint* GoalPoint : GoalPoints)
+	{
+		check(GoalPoint);
+
+		TSharedPtr<FDirectionsGrid> NewDirectionsGrid = MakeShareable<FDirectionsGrid>(new FDirectionsGrid());
+		NewDirectionsGrid->GoalPoint                  = GoalPoint;
+		GoalPoint->OwningDirectionsGrid               = NewDirectionsGrid;
+		Flowfield->DirectionsGrids.Add(NewDirectionsGrid);
+
+		const FGridCellPosition GoalCellPosition = UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(GoalPoint->GetActorLocation(), Flowfield->GridSettings.CellSize);
+		const FGridSizes GridSizes               = GoalPoint->GridSizes;
+		CalculationTasks.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [NewDirectionsGrid, &CostsGrid, GoalCellPosition, GridSizes, IntegrationMethod]()
+		{
+			UFlowfieldCalculationFunctionsLibrary::CalculateDirectionsGrid(*NewDirectionsGrid.Get(), CostsGrid, GoalCellPosition, GridSizes, IntegrationMethod);
+		}));
+	}
+	UE::Tasks::Wait(CalculationTasks);
+}
+
+void UFlowfieldCalculatorComponent::InitializeTiledDirections(const TArray<AGoalPoint*>& GoalPoints)
+{
+	const FFlowfieldGridSettings& GridSettings = Flowfield->GridSettings;
+
+	// Directions Grids stay as per goal handles for detours, their own cells aren't calculated
+	TArray<FGridCellPosition> GoalCells;
+	TArray<FGridBounds> GoalWindows;
+	for (AGoalPoint* GoalPoint : GoalPoints)
+	{
+		check(GoalPoint);
+
+		TSharedPtr<FDirectionsGrid> NewDirectionsGrid = MakeShareable<FDirectionsGrid>(new FDirectionsGrid());
+		NewDirectionsGrid->GoalPoint                  = GoalPoint;
+		GoalPoint->OwningDirectionsGrid               = NewDirectionsGrid;
+		Flowfield->DirectionsGrids.Add(NewDirectionsGrid);
+
+		const FGridCellPosition GoalCellPosition = UGridUtilsFunctionLibrary::GetGridCellPositionAtLocation(GoalPoint->GetActorLocation(), GridSettings.CellSize);
+		const FGridSizes& GridSizes              = GoalPoint->GridSizes;
+		GoalCells.Add(GoalCellPosition);
+		GoalWindows.Emplace(FGridCellPosition{GoalCellPosition.X - GridSizes.Cols / 2, GoalCellPosition.Y - GridSizes.Rows / 2},
+		                    FGridCellPosition{GoalCellPosition.X + GridSizes.Cols / 2, GoalCellPosition.Y + GridSizes.Rows / 2});
+	}
+
+	Flowfield->TiledFlowfield = MakeShared<FTiledFlowfield>();
+	Flowfield->TiledFlowfield->Initialize(Flowfield->CostsGrid, GridSettings.TileSize, GridSettings.MaxCachedTiles);
+	Flowfield->TiledFlowfield->SetGoals(GoalCells, GoalWindows);
+}
+
 void UFlowfieldCalculatorComponent::RecalculateDirectionsGrids()
 {
 	Flowfield->DirectionsGrids.Empty();
@@ -95,29 +305,22 @@ void UFlowfieldCalculatorComponent::RecalculateDirectionsGrids()
 	TArray<AActor*> FoundActors;
 	UGameplayStatics::GetAllActorsOfClass(GetWorld(), AGoalPoint::StaticClass(), FoundActors);
 
+	TArray<AGoalPoint*> GoalPoints;
 	for (AActor* Actor : FoundActors)
 	{
 		AGoalPoint* GoalPoint = Cast<AGoalPoint>(Actor);
 		check(GoalPoint);
-
-		TSharedPtr<FDirectionsGrid> NewDirectionsGrid = MakeShareable<FDirectionsGrid>(new FDirectionsGrid());
-		CalculateDirectionsGridToGoalPoint(NewDirectionsGrid, GoalPoint);
-		Flowfield->DirectionsGrids.Add(NewDirectionsGrid);
+		GoalPoints.Add(GoalPoint);
 		Flowfield->GoalPoints.Add(GoalPoint);
 	}
+
+	CalculateDirectionsGridsToGoalPoints(GoalPoints);
 }
 
 void UFlowfieldCalculatorComponent::RecalculateDirectionsGrids(TArray<AGoalPoint*>& GoalPoints)
 {
 	Flowfield->DirectionsGrids.Empty();
 	
-	for (AGoalPoint* GoalPoint : GoalPoints)
-	{
-		check(GoalPoint);
-
-		TSharedPtr<FDirectionsGrid> NewDirectionsGrid = MakeShareable<FDirectionsGrid>(new FDirectionsGrid());
-		CalculateDirectionsGridToGoalPoint(NewDirectionsGrid, GoalPoint);
-		Flowfield->DirectionsGrids.Add(NewDirectionsGrid);
-	}
+	CalculateDirectionsGridsToGoalPoints(GoalPoints);
 }
 
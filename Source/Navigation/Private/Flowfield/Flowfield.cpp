@@ -4,6 +4,7 @@
 #include "Flowfield/Flowfield.h"
 
 #include "Flowfield/GoalPoint.h"
+#include "Flowfield/TiledFlowfield.h"
 #include "Flowfield/Components/FlowfieldCalculatorComponent.h"
 #include "Flowfield/Misc/GridsFunctionsLibrary.h"
 #include "Grids/GridUtilsFunctionLibrary.h"
@@ -81,7 +82,11 @@ FVector AFlowfield::GetDirectionAtCell(const FGridCellPosition& CellPosition, in
 	TSharedPtr<FDirectionsGrid> DirGrid = DirectionsGrids[DirectionsGridIndex];
 	if (bUseDetour && DirGrid->DetourDirectionsGrid)
 	{
-		DirGrid = DirGrid->DetourDirectionsGrid;
+		return DirGrid->DetourDirectionsGrid->GetDirection(CellPosition);
+	}
+	if (TiledFlowfield.IsValid())
+	{
+		return TiledFlowfield->GetDirection(CellPosition, DirectionsGridIndex);
 	}
 
 	return DirGrid->GetDirection(CellPosition);
@@ -8,53 +8,216 @@
 #include "Flowfield/NavigationAffector/Interfaces/NavigationAffector.h"
 #include "Grids/GridUtilsFunctionLibrary.h"
 
+namespace
+{
+	struct FNeighbourOffset
+	{
+		int32 X;
+		int32 Y;
+		uint32 Step;	// Fixed point length of the step, used by Dijkstra
+	};
+
+	constexpr uint32 StraightStep = 10;
+	constexpr uint32 DiagonalStep = 14;
+
+	constexpr FNeighbourOffset NeighbourOffsets8[] =
+	{
+		{0, 1, StraightStep}, {1, 1, DiagonalStep}, {1, 0, StraightStep}, {1, -1, DiagonalStep},
+		{0, -1, StraightStep}, {-1, -1, DiagonalStep}, {-1, 0, StraightStep}, {-1, 1, DiagonalStep}
+	};
+	constexpr FNeighbourOffset NeighbourOffsets4[] =
+	{
+		{0, 1, StraightStep}, {1, 0, StraightStep}, {0, -1, StraightStep}, {-1, 0, StraightStep}
+	};
+
+	// Copies costs of the integration grid cells into an array indexed the same way, so engines don't look up the costs grid
+	void GatherCosts(TArray<uint8>& OutCosts, const FGridBounds& Bounds, const FCostsGrid& CostsGrid)
+	{
+		OutCosts.SetNumUninitialized(Bounds.GetCols() * Bounds.GetRows());
+		for (int32 Row = 0; Row < Bounds.GetRows(); ++Row)
+		{
+			const FGridCellPosition RowStart{Bounds.BottomLeftCell.X, Bounds.BottomLeftCell.Y + Row};
+			const FCostsGridCell* CostCells = &CostsGrid.Cells[RowStart];
+			uint8* RowCosts                 = &OutCosts[Row * Bounds.GetCols()];
+			for (int32 Col = 0; Col < Bounds.GetCols(); ++Col)
+			{
+				RowCosts[Col] = CostCells[Col].Cost;
+			}
+		}
+	}
+}
+
 void UFlowfieldCalculationFunctionsLibrary::CalculateIntegrationGrid(FIntegrationGrid& OutIntegrationGrid, const FGridCellPosition& GoalCellPosition,
-                                                                     const FGridBounds& GridBounds, const FCostsGrid& CostsGrid)
+                                                                     const FCostsGrid& CostsGrid, const EFlowfieldIntegrationMethod Method)
 {
-	const FGridCellPosition& GoalPos = GoalCellPosition;
+	checkf(OutIntegrationGrid.Contains(GoalCellPosition), TEXT("Goal cell has to be inside of the integration grid"));
 	
-	TQueue<FGridCellPosition> CellsQueue;
-	CellsQueue.Enqueue(GoalPos);
-	OutIntegrationGrid.SetCost(GoalPos, 1);
+	switch (Method)
+	{
+	case EFlowfieldIntegrationMethod::FastMarching:
+		CalculateIntegrationGridFastMarching(OutIntegrationGrid, GoalCellPosition, CostsGrid);
+		break;
+	default:
+		CalculateIntegrationGridDijkstra(OutIntegrationGrid, GoalCellPosition, CostsGrid);
+		break;
+	}
+}
+
+void UFlowfieldCalculationFunctionsLibrary::CalculateIntegrationGridDijkstra(FIntegrationGrid& OutIntegrationGrid, const FGridCellPosition& GoalCellPosition,
+                                                                             const FCostsGrid& CostsGrid)
+{
+	constexpr uint32 BucketsNum = UE::NavigationGlobals::MaxCost * DiagonalStep + 1;	// All pending distances are within one max step from the current one
+	constexpr uint32 Unreached  = MAX_uint32;
+
+	const FGridBounds& Bounds = OutIntegrationGrid.Cells.Bounds;
+	const int32 Cols          = Bounds.GetCols();
+	const int32 Rows          = Bounds.GetRows();
+
+	TArray<uint8> Costs;
+	GatherCosts(Costs, Bounds, CostsGrid);
+	TArray<uint32> Distances;
+	Distances.Init(Unreached, Cols * Rows);
+	TArray<TArray<int32>> Buckets;
+	Buckets.SetNum(BucketsNum);
+
+	// Goal cell has the integration value of 1, the same as before
+	const int32 GoalIndex = Bounds.GetCellIndex(GoalCellPosition);
+	Distances[GoalIndex]  = StraightStep;
+	Buckets[StraightStep].Add(GoalIndex);
+	int32 PendingNum = 1;
+
+	for (uint32 Distance = StraightStep; PendingNum > 0; ++Distance)
+	{
+		// Zero cost cells are added into the current bucket while it's iterated
+		TArray<int32>& Bucket = Buckets[Distance % BucketsNum];
+		for (int32 EntryIndex = 0; EntryIndex < Bucket.Num(); ++EntryIndex)
+		{
+			const int32 CellIndex = Bucket[EntryIndex];
+			--PendingNum;
+			if (Distances[CellIndex] != Distance)
+			{
+				continue;	// A shorter path has been found after the cell was added
+			}
 
-	FGridCellPosition CurrentCellPos;
-	while (CellsQueue.Dequeue(CurrentCellPos))
+			const int32 X = CellIndex % Cols;
+			const int32 Y = CellIndex / Cols;
+			for (const FNeighbourOffset& Offset : NeighbourOffsets8)
+			{
+				const int32 NeighbourX = X + Offset.X;
+				const int32 NeighbourY = Y + Offset.Y;
+				if (NeighbourX < 0 || NeighbourY < 0 || NeighbourX >= Cols || NeighbourY >= Rows)
+				{
+					continue;
+				}
+
+				const int32 NeighbourIndex = NeighbourY * Cols + NeighbourX;
+				const uint32 NewDistance   = Distance + Costs[NeighbourIndex] * Offset.Step;
+				if (NewDistance < Distances[NeighbourIndex])
+				{
+					Distances[NeighbourIndex] = NewDistance;
+					Buckets[NewDistance % BucketsNum].Add(NeighbourIndex);
+					++PendingNum;
+				}
+			}
+		}
+		Bucket.Reset();
+	}
+
+	for (int32 CellIndex = 0; CellIndex < Distances.Num(); ++CellIndex)
+	{
+		OutIntegrationGrid.Cells.Values[CellIndex] = Distances[CellIndex] == Unreached ? -1.f : static_cast<float>(Distances[CellIndex]) / StraightStep;
+	}
+}
+
+void UFlowfieldCalculationFunctionsLibrary::CalculateIntegrationGridFastMarching(FIntegrationGrid& OutIntegrationGrid, const FGridCellPosition& GoalCellPosition,
+                                                                                 const FCostsGrid& CostsGrid)
+{
+	struct FFrontCell
+	{
+		float Time;
+		int32 CellIndex;
+		bool operator<(const FFrontCell& Other) const { return Time < Other.Time; }
+	};
+	constexpr float Unreached = TNumericLimits<float>::Max();
+
+	const FGridBounds& Bounds = OutIntegrationGrid.Cells.Bounds;
+	const int32 Cols          = Bounds.GetCols();
+	const int32 Rows          = Bounds.GetRows();
+
+	TArray<uint8> Costs;
+	GatherCosts(Costs, Bounds, CostsGrid);
+	TArray<float> Times;
+	Times.Init(Unreached, Cols * Rows);
+	TBitArray<> KnownCells(false, Cols * Rows);
+	TArray<FFrontCell> Front;	// Binary heap. Cells are pushed again when their time decreases, outdated entries are skipped.
+
+	const auto GetKnownTime = [&](const int32 X, const int32 Y)
 	{
-		const float CurrentTotalCost = OutIntegrationGrid.GetCost(CurrentCellPos);
-		
-		TArray<FGridCellPosition> NeighbourCells;
-		UGridsFunctionsLibrary::GetGridCellValidNeighbours8(NeighbourCells, CostsGrid, CurrentCellPos);
+		if (X < 0 || Y < 0 || X >= Cols || Y >= Rows)
+		{
+			return Unreached;
+		}
+		const int32 CellIndex = Y * Cols + X;
+		return KnownCells[CellIndex] ? Times[CellIndex] : Unreached;
+	};
+
+	const int32 GoalIndex = Bounds.GetCellIndex(GoalCellPosition);
+	Times[GoalIndex]      = 1.f;	// Goal cell has the integration value of 1, the same as in Dijkstra
+	Front.HeapPush(FFrontCell{1.f, GoalIndex});
+
+	FFrontCell Current;
+	while (!Front.IsEmpty())
+	{
+		Front.HeapPop(Current, EAllowShrinking::No);
+		if (KnownCells[Current.CellIndex] || Current.Time > Times[Current.CellIndex])
+		{
+			continue;
+		}
+		KnownCells[Current.CellIndex] = true;
 
-		for (FGridCellPosition& NeighbourCellPos : NeighbourCells)
+		const int32 X = Current.CellIndex % Cols;
+		const int32 Y = Current.CellIndex / Cols;
+		for (const FNeighbourOffset& Offset : NeighbourOffsets4)
 		{
-		if (!GridBounds.IsCellInBounds(NeighbourCellPos) || !OutIntegrationGrid.Cells.Contains(NeighbourCellPos))
+			const int32 NeighbourX = X + Offset.X;
+			const int32 NeighbourY = Y + Offset.Y;
+			if (NeighbourX < 0 || NeighbourY < 0 || NeighbourX >= Cols || NeighbourY >= Rows)
 			{
 				continue;
 			}
-			
-			float CostMult = 1.f;
-			// Diagonal path is longer by 1.41f
-			const FGridCellPosition NeighbourDirection = CurrentCellPos - NeighbourCellPos;
-			if (NeighbourDirection.X != 0 && NeighbourDirection.Y != 0)
+			const int32 NeighbourIndex = NeighbourY * Cols + NeighbourX;
+			if (KnownCells[NeighbourIndex])
 			{
-				CostMult *= 1.41f;
+				continue;
+			}
+
+			// First order upwind solution of |grad T| = Cost from known neighbours along each axis
+			const float Cost  = Costs[NeighbourIndex];
+			const float TimeX = FMath::Min(GetKnownTime(NeighbourX - 1, NeighbourY), GetKnownTime(NeighbourX + 1, NeighbourY));
+			const float TimeY = FMath::Min(GetKnownTime(NeighbourX, NeighbourY - 1), GetKnownTime(NeighbourX, NeighbourY + 1));
+			float NewTime     = FMath::Min(TimeX, TimeY) + Cost;
+			if (FMath::Abs(TimeX - TimeY) < Cost)
+			{
+				NewTime = 0.5f * (TimeX + TimeY + FMath::Sqrt(2.f * Cost * Cost - FMath::Square(TimeX - TimeY)));
 			}
-			
-			const float MoveToNeighbourCost = CostsGrid.GetCost(NeighbourCellPos) * CostMult;
-			const float NewNeighbourTotalCost = CurrentTotalCost + MoveToNeighbourCost;
 
-			const float NeighbourCost = OutIntegrationGrid.GetCost(NeighbourCellPos);	// -1 in Integration field means the cell is not processed yet
-			if (NewNeighbourTotalCost < NeighbourCost || NeighbourCost == -1)			// If we found a shorter path to the neighbour cell
+			if (NewTime < Times[NeighbourIndex])
 			{
-				OutIntegrationGrid.SetCost(NeighbourCellPos, NewNeighbourTotalCost);
-				CellsQueue.Enqueue(NeighbourCellPos);
+				Times[NeighbourIndex] = NewTime;
+				Front.HeapPush(FFrontCell{NewTime, NeighbourIndex});
 			}
 		}
 	}
+
+	for (int32 CellIndex = 0; CellIndex < Times.Num(); ++CellIndex)
+	{
+		OutIntegrationGrid.Cells.Values[CellIndex] = Times[CellIndex] == Unreached ? -1.f : Times[CellIndex];
+	}
 }
 
 void UFlowfieldCalculationFunctionsLibrary::CalculateDirectionsGrid(FDirectionsGrid& OutDirectionsGrid, const FCostsGrid& CostsGrid,
-                                                                    const FGridCellPosition& GoalCellPosition, const FGridSizes& GridSizes)
+                                                                    const FGridCellPosition& GoalCellPosition, const FGridSizes& GridSizes,
+                                                                    const EFlowfieldIntegrationMethod Method)
 {
 	if (OutDirectionsGrid.bCalculated)
 	{
@@ -64,39 +227,101 @@ void UFlowfieldCalculationFunctionsLibrary::CalculateDirectionsGrid(FDirectionsG
 	
 	FGridCellPosition BottomLeftCell = {GoalCellPosition.X - (GridSizes.Cols / 2), GoalCellPosition.Y - (GridSizes.Rows / 2)};
 	FGridCellPosition TopRightCell   = {GoalCellPosition.X + (GridSizes.Cols / 2), GoalCellPosition.Y + (GridSizes.Rows / 2)};
-	FGridBounds GridBounds{BottomLeftCell, TopRightCell};
+
+	// Only the part of the goal window covered by the costs grid is calculated
+	const FGridBounds& CostsBounds = CostsGrid.GetBounds();
+	const FGridBounds CalculatedBounds{
+		FGridCellPosition{FMath::Max(BottomLeftCell.X, CostsBounds.BottomLeftCell.X), FMath::Max(BottomLeftCell.Y, CostsBounds.BottomLeftCell.Y)},
+		FGridCellPosition{FMath::Min(TopRightCell.X, CostsBounds.TopRightCell.X), FMath::Min(TopRightCell.Y, CostsBounds.TopRightCell.Y)}
+	};
+	if (CostsGrid.Cells.IsEmpty() || CalculatedBounds.GetCols() <= 0 || CalculatedBounds.GetRows() <= 0 || !CalculatedBounds.IsCellInBounds(GoalCellPosition))
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%hs] Goal cell is outside of the costs grid."), __FUNCTION__);
+		return;
+	}
 
 	// Each Integration Grid cell contains a distance from this cell to the goal cell.
 	FIntegrationGrid IntegrationGrid;
-	UGridUtilsFunctionLibrary::ForEachGridCell(GridBounds, [&IntegrationGrid, &CostsGrid](const FGridCellPosition& CellPosition)
-	{
-		if (CostsGrid.Bounds.IsCellInBounds(CellPosition))
-		{
-			IntegrationGrid.AddCell(CellPosition, -1);	// -1 in Integration field means the cell is not processed yet
-		}
-	});
+	IntegrationGrid.Initialize(CalculatedBounds, -1.f);	// -1 in Integration field means the cell is not processed yet
 	
-	CalculateIntegrationGrid(IntegrationGrid, GoalCellPosition, GridBounds, CostsGrid);
+	CalculateIntegrationGrid(IntegrationGrid, GoalCellPosition, CostsGrid, Method);
+
+	OutDirectionsGrid.Cells.Initialize(CalculatedBounds, FDirectionsGridCell{});
+	CalculateDirections(OutDirectionsGrid.Cells, IntegrationGrid);
+
+	OutDirectionsGrid.bCalculated = true;
+}
 
-	OutDirectionsGrid.Cells.Reserve(IntegrationGrid.Cells.Num());
+void UFlowfieldCalculationFunctionsLibrary::CalculateIntegrationGridFromSeeds(FIntegrationGrid& OutIntegrationGrid, const TArray<TPair<FGridCellPosition, float>>& Seeds,
+                                                                              const FCostsGrid& CostsGrid, const FGridBounds& ExpandedBounds)
+{
+	struct FPendingCell
+	{
+		float Distance;
+		int32 CellIndex;
+		bool operator<(const FPendingCell& Other) const { return Distance < Other.Distance; }
+	};
 
-	// Iterate through each cell of the integration grid and set its direction towards a neighbour with the lowest value
-	for (auto& [CellPosition, Cell] : IntegrationGrid.Cells)
+	// Seeds have arbitrary initial values, so a binary heap is used instead of the buckets
+	const FGridBounds& Bounds = OutIntegrationGrid.Cells.Bounds;
+	TArray<float>& Distances  = OutIntegrationGrid.Cells.Values;
+	TArray<FPendingCell> Pending;
+	for (const TPair<FGridCellPosition, float>& Seed : Seeds)
 	{
-		float const* ClosestCellValue;
-		EDirection DirectionToClosestCell = EDirection::Top;
-		UGridsFunctionsLibrary::GetGridCellClosestNeighbour8(ClosestCellValue, DirectionToClosestCell, IntegrationGrid, CellPosition);
-		if (!ClosestCellValue)
+		if (!Bounds.IsCellInBounds(Seed.Key))
 		{
-			OutDirectionsGrid.Cells.Add(CellPosition, FDirectionsGridCell{});
 			continue;
 		}
+		const int32 CellIndex = Bounds.GetCellIndex(Seed.Key);
+		if (Distances[CellIndex] < 0.f || Seed.Value < Distances[CellIndex])
+		{
+			Distances[CellIndex] = Seed.Value;
+			Pending.HeapPush(FPendingCell{Seed.Value, CellIndex});
+		}
+	}
+
+	FPendingCell Current;
+	while (!Pending.IsEmpty())
+	{
+		Pending.HeapPop(Current, EAllowShrinking::No);
+		if (Current.Distance > Distances[Current.CellIndex])
+		{
+			continue;	// A shorter path has been found after the cell was added
+		}
+
+		const FGridCellPosition CellPosition = Bounds.GetCellPositionAtIndex(Current.CellIndex);
+		for (const FNeighbourOffset& Offset : NeighbourOffsets8)
+		{
+			const FGridCellPosition NeighbourPosition{CellPosition.X + Offset.X, CellPosition.Y + Offset.Y};
+			if (!ExpandedBounds.IsCellInBounds(NeighbourPosition) || !Bounds.IsCellInBounds(NeighbourPosition))
+			{
+				continue;
+			}
 
-		const FVector Direction = UGridsFunctionsLibrary::DirectionToVector(DirectionToClosestCell);
-		OutDirectionsGrid.Cells.Add(CellPosition, FDirectionsGridCell{Direction});
+			const int32 NeighbourIndex = Bounds.GetCellIndex(NeighbourPosition);
+			const float NewDistance    = Current.Distance + CostsGrid.GetCostSafe(NeighbourPosition) * Offset.Step / StraightStep;
+			if (Distances[NeighbourIndex] < 0.f || NewDistance < Distances[NeighbourIndex])
+			{
+				Distances[NeighbourIndex] = NewDistance;
+				Pending.HeapPush(FPendingCell{NewDistance, NeighbourIndex});
+			}
+		}
 	}
+}
 
-	OutDirectionsGrid.bCalculated = true;
+void UFlowfieldCalculationFunctionsLibrary::CalculateDirections(TFlowfieldDenseGrid<FDirectionsGridCell>& OutCells, const FIntegrationGrid& IntegrationGrid)
+{
+	// Set direction of each cell towards a neighbour with the lowest value
+	for (int32 CellIndex = 0; CellIndex < OutCells.Num(); ++CellIndex)
+	{
+		float const* ClosestCellValue     = nullptr;
+		EDirection DirectionToClosestCell = EDirection::Top;
+		UGridsFunctionsLibrary::GetGridCellClosestNeighbour8(ClosestCellValue, DirectionToClosestCell, IntegrationGrid, OutCells.Bounds.GetCellPositionAtIndex(CellIndex));
+		if (ClosestCellValue)
+		{
+			OutCells.Values[CellIndex].Direction = DirectionToClosestCell;
+		}
+	}
 }
 
 int32 UFlowfieldCalculationFunctionsLibrary::GetNavigationAffectorCost(AActor* Actor)
@@ -110,3 +335,39 @@ int32 UFlowfieldCalculationFunctionsLibrary::GetNavigationAffectorCost(AActor* A
 
 	return INavigationAffector::Execute_GetFlowfieldNavigationCost(Actor);
 }
+
+void UFlowfieldCalculationFunctionsLibrary::BenchmarkIntegration(const TArray<int32>& GridSideSizes, const int32 Iterations)
+{
+	constexpr int32 RandomSeed       = 1337;
+	constexpr float WallCellsPercent = 0.15f;
+
+	for (const int32 SideSize : GridSideSizes)
+	{
+		// Random costs with scattered walls of max cost
+		FRandomStream RandomStream(RandomSeed);
+		const FGridBounds Bounds{FGridCellPosition{0, 0}, FGridCellPosition{SideSize - 1, SideSize - 1}};
+		FCostsGrid CostsGrid;
+		CostsGrid.Initialize(Bounds);
+		for (FCostsGridCell& Cell : CostsGrid.Cells.Values)
+		{
+			Cell.Cost = RandomStream.FRand() < WallCellsPercent ? UE::NavigationGlobals::MaxCost : static_cast<uint8>(RandomStream.RandRange(1, 10));
+		}
+
+		const FGridCellPosition GoalCellPosition = Bounds.GetCenterCell();
+		for (const EFlowfieldIntegrationMethod Method : {EFlowfieldIntegrationMethod::Dijkstra, EFlowfieldIntegrationMethod::FastMarching})
+		{
+			FIntegrationGrid IntegrationGrid;
+			IntegrationGrid.Initialize(Bounds, -1.f);
+			
+			const double StartTime = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				CalculateIntegrationGrid(IntegrationGrid, GoalCellPosition, CostsGrid, Method);
+			}
+			const double IntegrationTime = FPlatformTime::Seconds() - StartTime;
+
+			UE_LOG(LogTemp, Display, TEXT("[%hs] Grid: %dx%d, method: %s, integration: %.3f ms"), __FUNCTION__, SideSize, SideSize,
+				*UEnum::GetValueAsString(Method), IntegrationTime * 1000.0 / Iterations);
+		}
+	}
+}
@@ -31,13 +31,13 @@ void UFlowfieldDebugBPFunctionLibrary::DrawDebugCostsGridInRadius(AFlowfield* Fl
 	{
 		FVector CellCenter = UGridUtilsFunctionLibrary::GetGridCellLocationAtPosition(CellPosition, CellSize);
 		
-		if (!Flowfield->CostsGrid->Cells.Contains(CellPosition))
+		if (!Flowfield->CostsGrid->Contains(CellPosition))
 		{
 			DrawDebugLine(Flowfield->GetWorld(), CellCenter, CellCenter + FVector::UpVector * DebugLineMaxLength, FColor::Green, false, DebugLifetime, 0, 3.f);
 			return;
 		}
 
-		float Cost                = Flowfield->CostsGrid->Cells[CellPosition].Cost;
+		float Cost                = Flowfield->CostsGrid->GetCost(CellPosition);
 		float DebugLineLengthMult = FMath::GetMappedRangeValueClamped(
 			FVector2D{0.f, static_cast<float>(UE::NavigationGlobals::MaxCost)}, FVector2D{0.2f, 1.f}, Cost);
 		
@@ -83,7 +83,7 @@ void UFlowfieldDebugBPFunctionLibrary::DrawDebugDirectionsGridInRadius(AFlowfiel
 			return;
 		}
 
-		const FVector CellDirection = DirectionsGrid.Cells[CellPosition].Direction;
+		const FVector CellDirection = DirectionsGrid.GetDirectionChecked(CellPosition);
 		CellCenter.Z = DebugCenter.Z + 50.f;
 		DrawDebugLine(Flowfield->GetWorld(), CellCenter, CellCenter + CellDirection * CellSize / 1.4f, FColor::Red, false, DebugLifetime, 0, 3.f);
 		DrawDebugSphere(Flowfield->GetWorld(), CellCenter, 5.f, 6, FColor::Blue, false, DebugLifetime, 0, 2.f);
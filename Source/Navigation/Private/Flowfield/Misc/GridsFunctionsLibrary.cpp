@@ -41,13 +41,13 @@ void UGridsFunctionsLibrary::GetGridCellValidNeighbours8(TArray<FGridCellPositio
 void UGridsFunctionsLibrary::GetGridCellClosestNeighbour8(float const*& OutClosestCellValue, EDirection& OutDirectionToClosestCell, const FIntegrationGrid& IntegrationGrid,
                                                       FGridCellPosition CellPosition)
 {
-	int32 MinCost = INT32_MAX;
+	float MinCost = TNumericLimits<float>::Max();	// Integration values are fractional
 
 	for (EDirection Direction : TEnumRange<EDirection>())
 	{
 		const FGridCellPosition NeighbourPosition = DirectionToCellPosition(Direction) + CellPosition;
-		const float* AdjacentCellValue            = IntegrationGrid.Cells.Find(NeighbourPosition);
-		if (!AdjacentCellValue)
+		const float* AdjacentCellValue            = IntegrationGrid.Cells.Find(NeighbourPosition);	// Array index, cells outside of the bounds return nullptr
+		if (!AdjacentCellValue || *AdjacentCellValue < 0.f)	// Negative value means the cell wasn't reached
 		{
 			continue;
 		}
@@ -102,16 +102,10 @@ FVector2D UGridsFunctionsLibrary::CalculateGridSize(const FGridSizes& GridSizes,
 
 void UGridsFunctionsLibrary::ForEachCostsGridCell(const FCostsGrid& CostsGrid, const TFunction<void(const FGridCellPosition&, const FCostsGridCell&)>& Callback)
 {
-	for (auto& [CellPosition, Cell] : CostsGrid.Cells)
-	{
-		Callback(CellPosition, Cell);
-	}
+	CostsGrid.Cells.ForEachCell(Callback);
 }
 
 void UGridsFunctionsLibrary::ForEachDirectionsGridCell(const FDirectionsGrid& DirectionsGrid, const TFunction<void(const FGridCellPosition&, const FDirectionsGridCell&)>& Callback)
 {
-	for (auto& [CellPosition, Cell] : DirectionsGrid.Cells)
-	{
-		Callback(CellPosition, Cell);
-	}
+	DirectionsGrid.Cells.ForEachCell(Callback);
 }
@@ -34,7 +34,7 @@ bool AExitPoint::InteractWithEntity(FMassEntityManager& EntityManager, const FMa
 	{
 		return false;
 	}
-	GetWorld()->GetSubsystem<UEntityNotifierSubsystem>()->PreDestroyEntityDelegate.Execute(Entity);	// ToDo: cache the subsystem
+	GetWorld()->GetSubsystem<UEntityNotifierSubsystem>()->PreDestroyEntityDelegate.Broadcast(Entity);	// ToDo: cache the subsystem
 	EntityManager.Defer().DestroyEntity(Entity);
 	return true;
 }
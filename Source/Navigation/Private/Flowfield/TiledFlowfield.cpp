@@ -0,0 +1,450 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Flowfield/TiledFlowfield.h"
+
+#include "Flowfield/Misc/FlowfieldCalculationFunctionsLibrary.h"
+
+namespace
+{
+	// Length of the shortest 8-connected path between cells, in straight steps
+	float GetOctileDistance(const FGridCellPosition& A, const FGridCellPosition& B)
+	{
+		const int32 DeltaX = FMath::Abs(A.X - B.X);
+		const int32 DeltaY = FMath::Abs(A.Y - B.Y);
+		return FMath::Max(DeltaX, DeltaY) + 0.4f * FMath::Min(DeltaX, DeltaY);
+	}
+
+	uint64 GetTileCacheKey(const int32 GoalIndex, const int32 TileIndex)
+	{
+		return (static_cast<uint64>(GoalIndex) << 32) | static_cast<uint32>(TileIndex);
+	}
+}
+
+void FTiledFlowfield::Initialize(const TSharedPtr<const FCostsGrid>& InCostsGrid, const int32 InTileSize, const int32 MaxCachedTiles)
+{
+	check(InCostsGrid.IsValid());
+	
+	CostsGrid = InCostsGrid;
+	TileSize  = FMath::Max(InTileSize, 4);
+	TilesCols = FMath::DivideAndRoundUp(CostsGrid->GetBounds().GetCols(), TileSize);
+	TilesRows = FMath::DivideAndRoundUp(CostsGrid->GetBounds().GetRows(), TileSize);
+	if (CostsGrid->Cells.IsEmpty())
+	{
+		TilesCols = TilesRows = 0;
+	}
+
+	Portals.Reset();
+	Goals.Reset();
+	TilesPortals.Reset();
+	TilesPortals.SetNum(TilesCols * TilesRows);
+	TilesMeanCosts.SetNumZeroed(TilesCols * TilesRows);
+	for (int32 TileIndex = 0; TileIndex < TilesMeanCosts.Num(); ++TileIndex)
+	{
+		const FGridBounds TileBounds = GetTileBounds(TileIndex);
+		uint64 CostsSum              = 0;
+		for (int32 Y = TileBounds.BottomLeftCell.Y; Y <= TileBounds.TopRightCell.Y; ++Y)
+		{
+			for (int32 X = TileBounds.BottomLeftCell.X; X <= TileBounds.TopRightCell.X; ++X)
+			{
+				CostsSum += CostsGrid->Cells[FGridCellPosition{X, Y}].Cost;
+			}
+		}
+		TilesMeanCosts[TileIndex] = static_cast<float>(CostsSum) / TileBounds.GetArea();
+	}
+
+	for (int32 TileY = 0; TileY < TilesRows; ++TileY)
+	{
+		for (int32 TileX = 0; TileX < TilesCols; ++TileX)
+		{
+			const int32 TileIndex = TileY * TilesCols + TileX;
+			if (TileX + 1 < TilesCols)
+			{
+				AddPortalsBetweenTiles(TileIndex, TileIndex + 1, true);
+			}
+			if (TileY + 1 < TilesRows)
+			{
+				AddPortalsBetweenTiles(TileIndex, TileIndex + TilesCols, false);
+			}
+		}
+	}
+
+	TilesCacheLock.Lock();
+	TilesCache.Empty(FMath::Max(MaxCachedTiles, 1));
+	TilesCacheLock.Unlock();
+}
+
+void FTiledFlowfield::SetGoals(const TArray<FGridCellPosition>& GoalCells, const TArray<FGridBounds>& GoalWindows)
+{
+	check(GoalCells.Num() == GoalWindows.Num());
+	
+	Goals.SetNum(GoalCells.Num());
+	for (int32 GoalIndex = 0; GoalIndex < Goals.Num(); ++GoalIndex)
+	{
+		FGoal& Goal    = Goals[GoalIndex];
+		Goal.Cell      = GoalCells[GoalIndex];
+		Goal.Window    = GoalWindows[GoalIndex];
+		Goal.TileIndex = GetTileIndex(Goal.Cell);
+		if (Goal.TileIndex == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[%hs] Goal cell is outside of the costs grid."), __FUNCTION__);
+			continue;
+		}
+		CalculatePortalsDistances(Goal);
+	}
+
+	TilesCacheLock.Lock();
+	TilesCache.Empty(TilesCache.Max());
+	TilesCacheLock.Unlock();
+}
+
+FVector FTiledFlowfield::GetDirection(const FGridCellPosition& CellPosition, const int32 GoalIndex)
+{
+	if (!Goals.IsValidIndex(GoalIndex))
+	{
+		return FDirectionsGrid::NONE_DIRECTION;
+	}
+	const FGoal& Goal     = Goals[GoalIndex];
+	const int32 TileIndex = GetTileIndex(CellPosition);
+	if (Goal.TileIndex == INDEX_NONE || TileIndex == INDEX_NONE || !Goal.Window.IsCellInBounds(CellPosition))
+	{
+		return FDirectionsGrid::NONE_DIRECTION;
+	}
+
+	const uint64 CacheKey = GetTileCacheKey(GoalIndex, TileIndex);
+	TSharedPtr<const FTileDirections> TileDirections;
+	TilesCacheLock.Lock();
+	if (const TSharedPtr<const FTileDirections>* CachedTileDirections = TilesCache.FindAndTouch(CacheKey))
+	{
+		TileDirections = *CachedTileDirections;
+	}
+	TilesCacheLock.Unlock();
+
+	if (!TileDirections.IsValid())
+	{
+		// Calculated outside of the lock, so cached tiles can be sampled meanwhile
+		TileDirections = CalculateTileDirections(TileIndex, Goal);
+		TilesCacheLock.Lock();
+		TilesCache.Add(CacheKey, TileDirections);
+		TilesCacheLock.Unlock();
+	}
+
+	return (*TileDirections)[CellPosition].GetDirectionVector();
+}
+
+int32 FTiledFlowfield::GetCachedTilesNum()
+{
+	TilesCacheLock.Lock();
+	const int32 CachedTilesNum = TilesCache.Num();
+	TilesCacheLock.Unlock();
+	return CachedTilesNum;
+}
+
+FTiledFlowfield::FPathsCheckResult FTiledFlowfield::FollowPaths(const int32 GoalIndex)
+{
+	FPathsCheckResult Result;
+	if (!Goals.IsValidIndex(GoalIndex) || Goals[GoalIndex].TileIndex == INDEX_NONE)
+	{
+		return Result;
+	}
+	const FGoal& Goal              = Goals[GoalIndex];
+	const FGridBounds& CostsBounds = CostsGrid->GetBounds();
+	const FGridBounds Bounds{
+		FGridCellPosition{FMath::Max(Goal.Window.BottomLeftCell.X, CostsBounds.BottomLeftCell.X), FMath::Max(Goal.Window.BottomLeftCell.Y, CostsBounds.BottomLeftCell.Y)},
+		FGridCellPosition{FMath::Min(Goal.Window.TopRightCell.X, CostsBounds.TopRightCell.X), FMath::Min(Goal.Window.TopRightCell.Y, CostsBounds.TopRightCell.Y)}};
+
+	// Every cell is followed once: a path stops at the first cell whose end is already known and takes that end
+	enum class ECellEnd : uint8 { Unknown, OnPath, Goal, Cycle, DeadEnd };
+	TArray<ECellEnd> CellsEnds;
+	CellsEnds.Init(ECellEnd::Unknown, static_cast<int32>(Bounds.GetArea()));
+	TArray<int32> Path;
+
+	for (int32 StartIndex = 0; StartIndex < CellsEnds.Num(); ++StartIndex)
+	{
+		if (CellsEnds[StartIndex] != ECellEnd::Unknown)
+		{
+			continue;
+		}
+		Path.Reset();
+		FGridCellPosition Cell = Bounds.GetCellPositionAtIndex(StartIndex);
+		ECellEnd PathEnd       = ECellEnd::Goal;
+		while (true)
+		{
+			// Paths leaving the window aren't followed, the goal has no directions outside of it
+			if (Cell == Goal.Cell || !Bounds.IsCellInBounds(Cell))
+			{
+				PathEnd = ECellEnd::Goal;
+				break;
+			}
+			const int32 CellIndex = Bounds.GetCellIndex(Cell);
+			if (CellsEnds[CellIndex] == ECellEnd::OnPath)
+			{
+				const int32 CycleLength = Path.Num() - Path.Find(CellIndex);
+				Result.CyclesNum++;
+				Result.MaxCycleLength = FMath::Max(Result.MaxCycleLength, CycleLength);
+				PathEnd = ECellEnd::Cycle;
+				break;
+			}
+			if (CellsEnds[CellIndex] != ECellEnd::Unknown)
+			{
+				PathEnd = CellsEnds[CellIndex];
+				break;
+			}
+			CellsEnds[CellIndex] = ECellEnd::OnPath;
+			Path.Add(CellIndex);
+
+			const FVector Direction = GetDirection(Cell, GoalIndex);
+			if (Direction.IsZero())
+			{
+				PathEnd = ECellEnd::DeadEnd;
+				break;
+			}
+			Cell = FGridCellPosition{Cell.X + FMath::RoundToInt32(Direction.X), Cell.Y + FMath::RoundToInt32(Direction.Y)};
+		}
+
+		for (const int32 PathCellIndex : Path)
+		{
+			CellsEnds[PathCellIndex] = PathEnd;
+		}
+		if (PathEnd == ECellEnd::Cycle)
+		{
+			Result.CellsLeadingToCyclesNum += Path.Num();
+		}
+		else if (PathEnd == ECellEnd::DeadEnd)
+		{
+			Result.DeadEndCellsNum += Path.Num();
+		}
+	}
+	return Result;
+}
+
+bool FTiledFlowfield::CheckPathsReachGoals(const TArray<int32>& GridSideSizes, const int32 TileSize)
+{
+	constexpr int32 RandomSeed    = 1337;
+	constexpr int32 CellsPerWall  = 200;
+	constexpr int32 MinWallLength = 5;
+	constexpr int32 MaxWallLength = 25;
+
+	bool bPassed = true;
+	for (const int32 SideSize : GridSideSizes)
+	{
+		// Low random costs with straight walls of max cost. Walls make paths detour, so the coarse distances are off the most there.
+		FRandomStream RandomStream(RandomSeed);
+		const FGridBounds Bounds{FGridCellPosition{0, 0}, FGridCellPosition{SideSize - 1, SideSize - 1}};
+		const TSharedPtr<FCostsGrid> CostsGrid = MakeShared<FCostsGrid>();
+		CostsGrid->Initialize(Bounds);
+		for (FCostsGridCell& Cell : CostsGrid->Cells.Values)
+		{
+			Cell.Cost = static_cast<uint8>(RandomStream.RandRange(1, 3));
+		}
+		for (int32 WallIndex = 0; WallIndex < SideSize * SideSize / CellsPerWall; ++WallIndex)
+		{
+			const FGridCellPosition WallStart{RandomStream.RandRange(0, SideSize - 1), RandomStream.RandRange(0, SideSize - 1)};
+			const FGridCellPosition WallStep = RandomStream.FRand() < 0.5f ? FGridCellPosition{1, 0} : FGridCellPosition{0, 1};
+			const int32 WallLength           = RandomStream.RandRange(MinWallLength, MaxWallLength);
+			for (int32 Offset = 0; Offset < WallLength; ++Offset)
+			{
+				CostsGrid->SetCost(FGridCellPosition{WallStart.X + WallStep.X * Offset, WallStart.Y + WallStep.Y * Offset}, UE::NavigationGlobals::MaxCost);
+			}
+		}
+
+		const TArray<FGridCellPosition> GoalCells{Bounds.GetCenterCell(), Bounds.BottomLeftCell, FGridCellPosition{SideSize - 1, SideSize / 3}};
+		const int32 TilesNum = FMath::Square(FMath::DivideAndRoundUp(SideSize, FMath::Max(TileSize, 4)));
+		FTiledFlowfield TiledFlowfield;
+		TiledFlowfield.Initialize(CostsGrid, TileSize, TilesNum * GoalCells.Num());
+		TiledFlowfield.SetGoals(GoalCells, TArray<FGridBounds>{Bounds, Bounds, Bounds});
+
+		int32 FailedCellsNum = 0;
+		for (int32 GoalIndex = 0; GoalIndex < GoalCells.Num(); ++GoalIndex)
+		{
+			const FPathsCheckResult GoalResult = TiledFlowfield.FollowPaths(GoalIndex);
+			const int32 GoalFailedCellsNum     = GoalResult.CellsLeadingToCyclesNum + GoalResult.DeadEndCellsNum;
+			if (GoalFailedCellsNum > 0)
+			{
+				UE_LOG(LogTemp, Error, TEXT("[%hs] Grid: %dx%d, tile: %d, goal: (%d, %d), cycles: %d, max cycle length: %d, cells leading to cycles: %d, dead end cells: %d"),
+					__FUNCTION__, SideSize, SideSize, TileSize, GoalCells[GoalIndex].X, GoalCells[GoalIndex].Y, GoalResult.CyclesNum, GoalResult.MaxCycleLength,
+					GoalResult.CellsLeadingToCyclesNum, GoalResult.DeadEndCellsNum);
+			}
+			FailedCellsNum += GoalFailedCellsNum;
+		}
+		UE_LOG(LogTemp, Display, TEXT("[%hs] Grid: %dx%d, tile: %d, portals: %d, %s"), __FUNCTION__, SideSize, SideSize, TileSize,
+			TiledFlowfield.GetPortalsNum(), FailedCellsNum == 0 ? TEXT("passed") : TEXT("failed"));
+		bPassed = bPassed && FailedCellsNum == 0;
+	}
+	return bPassed;
+}
+
+int32 FTiledFlowfield::GetTileIndex(const FGridCellPosition& CellPosition) const
+{
+	if (!CostsGrid.IsValid() || !CostsGrid->Contains(CellPosition))
+	{
+		return INDEX_NONE;
+	}
+	const FGridCellPosition& Origin = CostsGrid->GetBounds().BottomLeftCell;
+	return ((CellPosition.Y - Origin.Y) / TileSize) * TilesCols + (CellPosition.X - Origin.X) / TileSize;
+}
+
+FGridBounds FTiledFlowfield::GetTileBounds(const int32 TileIndex) const
+{
+	const FGridBounds& CostsBounds = CostsGrid->GetBounds();
+	const FGridCellPosition BottomLeftCell{CostsBounds.BottomLeftCell.X + (TileIndex % TilesCols) * TileSize, CostsBounds.BottomLeftCell.Y + (TileIndex / TilesCols) * TileSize};
+	const FGridCellPosition TopRightCell{FMath::Min(BottomLeftCell.X + TileSize - 1, CostsBounds.TopRightCell.X), FMath::Min(BottomLeftCell.Y + TileSize - 1, CostsBounds.TopRightCell.Y)};
+	return FGridBounds{BottomLeftCell, TopRightCell};
+}
+
+void FTiledFlowfield::AddPortalsBetweenTiles(const int32 TileIndexA, const int32 TileIndexB, const bool bHorizontalNeighbours)
+{
+	// Tile A is on the left of or below tile B. The border is walked along its length.
+	const FGridBounds TileBoundsA = GetTileBounds(TileIndexA);
+	const int32 BorderLength      = bHorizontalNeighbours ? TileBoundsA.GetRows() : TileBoundsA.GetCols();
+	const auto GetBorderCell = [&TileBoundsA, bHorizontalNeighbours](const int32 Offset, const bool bSideB)
+	{
+		return bHorizontalNeighbours
+			? FGridCellPosition{TileBoundsA.TopRightCell.X + (bSideB ? 1 : 0), TileBoundsA.BottomLeftCell.Y + Offset}
+			: FGridCellPosition{TileBoundsA.BottomLeftCell.X + Offset, TileBoundsA.TopRightCell.Y + (bSideB ? 1 : 0)};
+	};
+	const auto AddPortal = [this, TileIndexA, TileIndexB, &GetBorderCell](const int32 StartOffset, const int32 EndOffset)
+	{
+		FPortal& Portal       = Portals.AddDefaulted_GetRef();
+		Portal.TileIndices[0] = TileIndexA;
+		Portal.TileIndices[1] = TileIndexB;
+		for (int32 Side = 0; Side < 2; ++Side)
+		{
+			Portal.Cells[Side]       = FGridBounds{GetBorderCell(StartOffset, Side == 1), GetBorderCell(EndOffset, Side == 1)};
+			Portal.CenterCells[Side] = GetBorderCell((StartOffset + EndOffset) / 2, Side == 1);
+		}
+		TilesPortals[TileIndexA].Add(Portals.Num() - 1);
+		TilesPortals[TileIndexB].Add(Portals.Num() - 1);
+	};
+
+	// Each run of cells passable on both sides becomes a portal
+	const int32 PortalsNum = Portals.Num();
+	int32 RunStart         = INDEX_NONE;
+	for (int32 Offset = 0; Offset <= BorderLength; ++Offset)
+	{
+		const bool bPassable = Offset < BorderLength
+			&& CostsGrid->GetCost(GetBorderCell(Offset, false)) < UE::NavigationGlobals::MaxCost
+			&& CostsGrid->GetCost(GetBorderCell(Offset, true)) < UE::NavigationGlobals::MaxCost;
+		if (bPassable && RunStart == INDEX_NONE)
+		{
+			RunStart = Offset;
+		}
+		else if (!bPassable && RunStart != INDEX_NONE)
+		{
+			AddPortal(RunStart, Offset - 1);
+			RunStart = INDEX_NONE;
+		}
+	}
+
+	// Max cost cells are still traversable in the flowfield, so a walled border is one expensive portal rather than no connection
+	if (PortalsNum == Portals.Num())
+	{
+		AddPortal(0, BorderLength - 1);
+	}
+}
+
+void FTiledFlowfield::CalculatePortalsDistances(FGoal& Goal) const
+{
+	struct FPendingPortal
+	{
+		float Distance;
+		int32 PortalIndex;
+		bool operator<(const FPendingPortal& Other) const { return Distance < Other.Distance; }
+	};
+
+	// Crossing a tile between two border cells is estimated by the octile distance scaled by the mean cost of the tile
+	const auto GetSideInTile = [](const FPortal& Portal, const int32 TileIndex) { return Portal.TileIndices[0] == TileIndex ? 0 : 1; };
+	
+	Goal.PortalsDistances.Init(-1.f, Portals.Num());
+	Goal.PortalsNextTiles.Init(INDEX_NONE, Portals.Num());
+	TArray<FPendingPortal> Pending;
+	for (const int32 PortalIndex : TilesPortals[Goal.TileIndex])
+	{
+		const FPortal& Portal = Portals[PortalIndex];
+		const float Distance  = 1.f + GetOctileDistance(Goal.Cell, Portal.CenterCells[GetSideInTile(Portal, Goal.TileIndex)]) * TilesMeanCosts[Goal.TileIndex];
+		if (Goal.PortalsDistances[PortalIndex] < 0.f || Distance < Goal.PortalsDistances[PortalIndex])
+		{
+			Goal.PortalsDistances[PortalIndex] = Distance;
+			Goal.PortalsNextTiles[PortalIndex] = Goal.TileIndex;
+			Pending.HeapPush(FPendingPortal{Distance, PortalIndex});
+		}
+	}
+
+	FPendingPortal Current;
+	while (!Pending.IsEmpty())
+	{
+		Pending.HeapPop(Current, EAllowShrinking::No);
+		if (Current.Distance > Goal.PortalsDistances[Current.PortalIndex])
+		{
+			continue;
+		}
+
+		const FPortal& CurrentPortal = Portals[Current.PortalIndex];
+		for (const int32 TileIndex : CurrentPortal.TileIndices)
+		{
+			const FGridCellPosition& CurrentCell = CurrentPortal.CenterCells[GetSideInTile(CurrentPortal, TileIndex)];
+			for (const int32 PortalIndex : TilesPortals[TileIndex])
+			{
+				const FPortal& Portal = Portals[PortalIndex];
+				const float Distance  = Current.Distance + GetOctileDistance(CurrentCell, Portal.CenterCells[GetSideInTile(Portal, TileIndex)]) * TilesMeanCosts[TileIndex];
+				if (Goal.PortalsDistances[PortalIndex] < 0.f || Distance < Goal.PortalsDistances[PortalIndex])
+				{
+					Goal.PortalsDistances[PortalIndex] = Distance;
+					Goal.PortalsNextTiles[PortalIndex] = TileIndex;
+					Pending.HeapPush(FPendingPortal{Distance, PortalIndex});
+				}
+			}
+		}
+	}
+}
+
+TSharedPtr<const FTiledFlowfield::FTileDirections> FTiledFlowfield::CalculateTileDirections(const int32 TileIndex, const FGoal& Goal) const
+{
+	const FGridBounds TileBounds = GetTileBounds(TileIndex);
+
+	// Integration window has a ring of the neighbour tiles cells, exit portals cells there are seeded with the coarse distances
+	const FGridBounds& CostsBounds = CostsGrid->GetBounds();
+	const FGridBounds WindowBounds{
+		FGridCellPosition{FMath::Max(TileBounds.BottomLeftCell.X - 1, CostsBounds.BottomLeftCell.X), FMath::Max(TileBounds.BottomLeftCell.Y - 1, CostsBounds.BottomLeftCell.Y)},
+		FGridCellPosition{FMath::Min(TileBounds.TopRightCell.X + 1, CostsBounds.TopRightCell.X), FMath::Min(TileBounds.TopRightCell.Y + 1, CostsBounds.TopRightCell.Y)}
+	};
+
+	TArray<TPair<FGridCellPosition, float>> Seeds;
+	if (TileIndex == Goal.TileIndex)
+	{
+		Seeds.Emplace(Goal.Cell, 1.f);
+	}
+
+	// Only exits are seeded, i.e. portals whose path to the goal goes through the neighbour tile. The neighbour doesn't seed
+	// such a portal back, so cells on the two sides of a border never point at each other.
+	for (const int32 PortalIndex : TilesPortals[TileIndex])
+	{
+		const float PortalDistance = Goal.PortalsDistances[PortalIndex];
+		if (PortalDistance < 0.f || Goal.PortalsNextTiles[PortalIndex] == TileIndex)
+		{
+			continue;
+		}
+		const FPortal& Portal         = Portals[PortalIndex];
+		const int32 OuterSide         = Portal.TileIndices[0] == TileIndex ? 1 : 0;
+		const FGridBounds& OuterCells = Portal.Cells[OuterSide];
+		const float OuterTileMeanCost = TilesMeanCosts[Portal.TileIndices[OuterSide]];
+		for (int32 Y = OuterCells.BottomLeftCell.Y; Y <= OuterCells.TopRightCell.Y; ++Y)
+		{
+			for (int32 X = OuterCells.BottomLeftCell.X; X <= OuterCells.TopRightCell.X; ++X)
+			{
+				// Coarse distance is estimated at the portal centre, so it grows along the portal the same way as in the coarse search
+				const FGridCellPosition Cell{X, Y};
+				Seeds.Emplace(Cell, PortalDistance + GetOctileDistance(Cell, Portal.CenterCells[OuterSide]) * OuterTileMeanCost);
+			}
+		}
+	}
+
+	FIntegrationGrid IntegrationGrid;
+	IntegrationGrid.Initialize(WindowBounds, -1.f);
+	UFlowfieldCalculationFunctionsLibrary::CalculateIntegrationGridFromSeeds(IntegrationGrid, Seeds, *CostsGrid.Get(), TileBounds);
+
+	TSharedPtr<FTileDirections> TileDirections = MakeShared<FTileDirections>();
+	TileDirections->Initialize(TileBounds, FDirectionsGridCell{});
+	UFlowfieldCalculationFunctionsLibrary::CalculateDirections(*TileDirections.Get(), IntegrationGrid);
+	return TileDirections;
+}
@@ -4,13 +4,44 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "Grids/UtilsGridTypes.h"
 #include "FlowfieldCalculatorComponent.generated.h"
 
 
+struct FCostsGrid;
 struct FDirectionsGrid;
 class AGoalPoint;
 class AFlowfield;
 
+// Identifies the state of the map a costs grid has been baked for
+struct FCostsGridCacheKey
+{
+	static constexpr int32 CurrentVersion = 1;	// Increase when the bake or the file layout changes
+
+	int32 Version = CurrentVersion;
+	FString MapPackage;
+	FGridBounds Bounds;
+	int32 CellSize = 0;
+	TArray<uint32> ActorsHashes;	// Sorted hashes of names, transforms and costs of actors blocking the navigation channel
+
+	bool operator==(const FCostsGridCacheKey& Other) const
+	{
+		return Version == Other.Version && MapPackage == Other.MapPackage && Bounds == Other.Bounds && CellSize == Other.CellSize
+			&& ActorsHashes == Other.ActorsHashes;
+	}
+
+	friend FArchive& operator <<(FArchive& Ar, FCostsGridCacheKey& Key)
+	{
+		Ar << Key.Version;
+		Ar << Key.MapPackage;
+		Ar << Key.Bounds.BottomLeftCell;
+		Ar << Key.Bounds.TopRightCell;
+		Ar << Key.CellSize;
+		Ar << Key.ActorsHashes;
+		return Ar;
+	}
+};
+
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
 class NAVIGATION_API UFlowfieldCalculatorComponent : public UActorComponent
 {
@@ -38,4 +69,18 @@ public:
 	void RecalculateDirectionsGrids();
 	// Destroys old Direction Grids and calculates new ones to the Goal Points.
 	void RecalculateDirectionsGrids(TArray<AGoalPoint*>& GoalPoints);
+
+private:
+
+	// Reads costs of navigation affectors once per actor and hashes the state of all actors the bake sweeps may hit
+	void GatherNavigationActors(TMap<const AActor*, uint8>& OutActorsCosts, FCostsGridCacheKey& OutCacheKey) const;
+	static FString GetCostsGridCacheFilePath(const FCostsGridCacheKey& CacheKey);
+	// Fills costs of the already initialized grid if the saved cache has the same key
+	static bool LoadCostsGridFromCache(FCostsGrid& OutCostsGrid, const FCostsGridCacheKey& CacheKey);
+	static void SaveCostsGridToCache(const FCostsGrid& CostsGrid, const FCostsGridCacheKey& CacheKey);
+
+	// Calculates Directions Grids to the Goal Points in parallel tasks and waits for all of them.
+	void CalculateDirectionsGridsToGoalPoints(const TArray<AGoalPoint*>& GoalPoints);
+	// Builds the tiled flowfield to the Goal Points, tiles are calculated later when agents sample them.
+	void InitializeTiledDirections(const TArray<AGoalPoint*>& GoalPoints);
 };
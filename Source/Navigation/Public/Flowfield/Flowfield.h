@@ -9,6 +9,7 @@
 #include "Flowfield.generated.h"
 
 class AGoalPoint;
+class FTiledFlowfield;
 
 UCLASS(Blueprintable)
 class NAVIGATION_API AFlowfield : public AActor
@@ -30,6 +31,7 @@ public:
 	TSharedPtr<FCostsGrid> CostsGrid;
 	TArray<TSharedPtr<FDirectionsGrid>> DirectionsGrids;	// If there are two different goal points agents may be moving to, the array will contain two grids
 	TArray<AGoalPoint*> GoalPoints;	// Goal points to which Directions are calculated. GoalPoints array matches DirectionsGrids array.
+	TSharedPtr<FTiledFlowfield> TiledFlowfield;	// Valid if GridSettings.bUseTiledDirections, then DirectionsGrids only hold detours
 
 	// STATUS ------
 	
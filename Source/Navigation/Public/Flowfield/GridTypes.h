@@ -10,6 +10,15 @@
 class AGoalPoint;
 
 
+// How distances from cells to the goal are calculated
+UENUM(BlueprintType)
+enum class EFlowfieldIntegrationMethod : uint8
+{
+	Dijkstra,		// Bucketed Dijkstra over 8 neighbours, diagonal steps cost 1.4 of straight ones
+	FastMarching	// Eikonal solution, distances are closer to euclidean, so paths are less grid aligned
+};
+
+
 USTRUCT(BlueprintType)
 struct NAVIGATION_API FFlowfieldGridSettings
 {
@@ -20,6 +29,111 @@ struct NAVIGATION_API FFlowfieldGridSettings
 	
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FGridSizes GridSizes;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	EFlowfieldIntegrationMethod IntegrationMethod = EFlowfieldIntegrationMethod::Dijkstra;
+
+	// Costs grid is saved after the bake and loaded instead of it while the map and its navigation actors are unchanged
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bCacheCostsGridOnDisk = true;
+
+	// Directions are calculated per tile when an agent samples the tile first, instead of whole grids per goal (see FTiledFlowfield).
+	// Tiles use coarse portal distances, so paths reaching the goal aren't guaranteed. Check a map with CCS_CheckTiledFlowfieldCycles.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bUseTiledDirections = false;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (EditCondition = "bUseTiledDirections", ClampMin = 4))
+	int32 TileSize = 32;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (EditCondition = "bUseTiledDirections", ClampMin = 1))
+	int32 MaxCachedTiles = 4096;	// Least recently sampled tiles are evicted
+};
+
+
+// Values of all cells of Bounds in one array, row by row (see FGridBounds::GetCellIndex). Cells outside of Bounds don't exist.
+template<typename T>
+struct TFlowfieldDenseGrid
+{
+	FGridBounds Bounds;
+	TArray<T> Values;
+
+	// Allocates all cells of InBounds and sets them to FillValue
+	void Initialize(const FGridBounds& InBounds, const T& FillValue)
+	{
+		Bounds = InBounds;
+		Values.Init(FillValue, InBounds.GetCols() * InBounds.GetRows());
+	}
+
+	// Expands Bounds to contain the cell. Existing values are kept, new cells are set to FillValue.
+	void GrowToFitCell(const FGridCellPosition& Position, const T& FillValue)
+	{
+		if (Values.IsEmpty())
+		{
+			Initialize(FGridBounds{Position, Position}, FillValue);
+			return;
+		}
+		if (Bounds.IsCellInBounds(Position))
+		{
+			return;
+		}
+
+		const FGridBounds OldBounds = Bounds;
+		TArray<T> OldValues         = MoveTemp(Values);
+		FGridBounds NewBounds       = Bounds;
+		NewBounds.UpdateToFitCell(Position);
+		Initialize(NewBounds, FillValue);
+		for (int32 OldIndex = 0; OldIndex < OldValues.Num(); ++OldIndex)
+		{
+			Values[Bounds.GetCellIndex(OldBounds.GetCellPositionAtIndex(OldIndex))] = OldValues[OldIndex];
+		}
+	}
+
+	bool IsEmpty() const
+	{
+		return Values.IsEmpty();
+	}
+
+	bool Contains(const FGridCellPosition& Position) const
+	{
+		return !Values.IsEmpty() && Bounds.IsCellInBounds(Position);
+	}
+
+	T* Find(const FGridCellPosition& Position)
+	{
+		return Contains(Position) ? &Values[Bounds.GetCellIndex(Position)] : nullptr;
+	}
+	const T* Find(const FGridCellPosition& Position) const
+	{
+		return Contains(Position) ? &Values[Bounds.GetCellIndex(Position)] : nullptr;
+	}
+
+	T& operator[](const FGridCellPosition& Position)
+	{
+		checkSlow(Contains(Position));
+		return Values[Bounds.GetCellIndex(Position)];
+	}
+	const T& operator[](const FGridCellPosition& Position) const
+	{
+		checkSlow(Contains(Position));
+		return Values[Bounds.GetCellIndex(Position)];
+	}
+
+	int32 Num() const
+	{
+		return Values.Num();
+	}
+
+	template<typename FuncType>
+	void ForEachCell(FuncType&& Callback) const
+	{
+		for (int32 CellIndex = 0; CellIndex < Values.Num(); ++CellIndex)
+		{
+			Callback(Bounds.GetCellPositionAtIndex(CellIndex), Values[CellIndex]);
+		}
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return Values.GetAllocatedSize();
+	}
 };
 
 
@@ -28,14 +142,20 @@ struct NAVIGATION_API FIntegrationGrid
 {
 	GENERATED_BODY()
 
-	TMap<FGridCellPosition, float> Cells;
+	TFlowfieldDenseGrid<float> Cells;
 	
 	FIntegrationGrid() = default;
 	FIntegrationGrid(const FIntegrationGrid& InGrid) : Cells(InGrid.Cells) {};
 
+	void Initialize(const FGridBounds& Bounds, const float& Value)
+	{
+		Cells.Initialize(Bounds, Value);
+	}
+
 	void AddCell(const FGridCellPosition& Position, const float& Value)
 	{
-		Cells.Add(Position, Value);
+		Cells.GrowToFitCell(Position, -1.f);
+		Cells[Position] = Value;
 	};
 
 	void SetCost(const FGridCellPosition& Position, const float& Value)
@@ -47,6 +167,11 @@ struct NAVIGATION_API FIntegrationGrid
 	{
 		return Cells[Position];
 	}
+
+	bool Contains(const FGridCellPosition& Position) const
+	{
+		return Cells.Contains(Position);
+	}
 };
 
 
@@ -63,23 +188,27 @@ struct NAVIGATION_API FCostsGrid
 {
 	GENERATED_BODY()
 
-	// If some cell is not in the map, then it's outside the Flowfield.
-	TMap<FGridCellPosition, FCostsGridCell> Cells;
-	FGridBounds Bounds;
+	// If some cell is not in the bounds of the grid, then it's outside the Flowfield.
+	TFlowfieldDenseGrid<FCostsGridCell> Cells;
 	
 	FCostsGrid() = default;
-	FCostsGrid(const FCostsGrid& InGrid) : Cells(InGrid.Cells) {};
+
+	// Allocates all cells of the bounds with max cost. Cheaper than adding the cells one by one.
+	void Initialize(const FGridBounds& Bounds)
+	{
+		Cells.Initialize(Bounds, FCostsGridCell{UE::NavigationGlobals::MaxCost});
+	}
 
 	void AddCell(const FGridCellPosition& Position, const uint8& Cost)
 	{
-		Cells.Add(Position, FCostsGridCell{Cost});
-		Bounds.UpdateToFitCell(Position);
+		Cells.GrowToFitCell(Position, FCostsGridCell{UE::NavigationGlobals::MaxCost});
+		Cells[Position] = FCostsGridCell{Cost};
 	};
 
 	// Sets cost in all existing cells to max value
 	void ResetCosts()
 	{
-		for (auto& [CellPosition, Cell] : Cells)
+		for (FCostsGridCell& Cell : Cells.Values)
 		{
 			Cell.Cost = UE::NavigationGlobals::MaxCost;
 		}
@@ -95,7 +224,6 @@ struct NAVIGATION_API FCostsGrid
 		if (FCostsGridCell* CostCell = Cells.Find(Position))
 		{
 			CostCell->Cost = Value;
-			Bounds.UpdateToFitCell(Position);
 		}
 	}
 	
@@ -116,15 +244,26 @@ struct NAVIGATION_API FCostsGrid
 	{
 		return Cells.Contains(Position);
 	}
+
+	const FGridBounds& GetBounds() const
+	{
+		return Cells.Bounds;
+	}
 };
 
 
+// Direction is encoded as EDirection, EDirection::Max means there is no direction in the cell
 USTRUCT()
 struct NAVIGATION_API FDirectionsGridCell
 {
 	GENERATED_BODY()
 	
-	FVector Direction = {0.f, 0.f, 0.f};
+	EDirection Direction = EDirection::Max;
+
+	FVector GetDirectionVector() const
+	{
+		return Direction == EDirection::Max ? FVector::ZeroVector : NavigationGlobals::DirectionVectors[static_cast<int32>(Direction)];
+	}
 };
 
 USTRUCT()
@@ -134,8 +273,7 @@ struct NAVIGATION_API FDirectionsGrid
 
 	inline static const FVector NONE_DIRECTION = FVector::ZeroVector;
 
-	UPROPERTY()
-	TMap<FGridCellPosition, FDirectionsGridCell> Cells;
+	TFlowfieldDenseGrid<FDirectionsGridCell> Cells;
 
 	UPROPERTY()
 	TObjectPtr<AGoalPoint> GoalPoint;
@@ -149,13 +287,13 @@ struct NAVIGATION_API FDirectionsGrid
 
 	FVector GetDirectionChecked(const FGridCellPosition& Position) const
 	{
-		return Cells[Position].Direction;
+		return Cells[Position].GetDirectionVector();
 	}
 	FVector GetDirection(const FGridCellPosition& Position) const
 	{
 		if (const FDirectionsGridCell* DirectionCell = Cells.Find(Position))
 		{
-			return DirectionCell->Direction;
+			return DirectionCell->GetDirectionVector();
 		}
 		return NONE_DIRECTION;
 	}
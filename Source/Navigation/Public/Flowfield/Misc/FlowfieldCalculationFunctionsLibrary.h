@@ -3,17 +3,11 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Flowfield/GridTypes.h"
 #include "UObject/Object.h"
 #include "FlowfieldCalculationFunctionsLibrary.generated.h"
 
 
-struct FIntegrationGrid;
-struct FGridBounds;
-struct FGridSizes;
-struct FGridCellPosition;
-struct FCostsGrid;
-struct FDirectionsGrid;
-
 UCLASS()
 class NAVIGATION_API UFlowfieldCalculationFunctionsLibrary : public UObject
 {
@@ -21,9 +15,27 @@ class NAVIGATION_API UFlowfieldCalculationFunctionsLibrary : public UObject
 
 public:
 
-	// @note OutIntegrationGrid should be initialized from CostsGrid before passing to this method
-	static void CalculateIntegrationGrid(FIntegrationGrid& OutIntegrationGrid, const FGridCellPosition& GoalCellPosition, const FGridBounds& GridBounds, const FCostsGrid& CostsGrid);
-	static void CalculateDirectionsGrid(FDirectionsGrid& OutDirectionsGrid, const FCostsGrid& CostsGrid, const FGridCellPosition& GoalCellPosition, const FGridSizes& GridSizes);
+	// @note OutIntegrationGrid should be initialized with the bounds to calculate, they have to be inside of the CostsGrid bounds
+	static void CalculateIntegrationGrid(FIntegrationGrid& OutIntegrationGrid, const FGridCellPosition& GoalCellPosition, const FCostsGrid& CostsGrid,
+	                                     EFlowfieldIntegrationMethod Method = EFlowfieldIntegrationMethod::Dijkstra);
+	static void CalculateDirectionsGrid(FDirectionsGrid& OutDirectionsGrid, const FCostsGrid& CostsGrid, const FGridCellPosition& GoalCellPosition, const FGridSizes& GridSizes,
+	                                    EFlowfieldIntegrationMethod Method = EFlowfieldIntegrationMethod::Dijkstra);
+	// Dijkstra from several seed cells with initial values. Only cells inside of ExpandedBounds are expanded, seeds may lie outside of them.
+	// @note OutIntegrationGrid should be initialized with -1
+	static void CalculateIntegrationGridFromSeeds(FIntegrationGrid& OutIntegrationGrid, const TArray<TPair<FGridCellPosition, float>>& Seeds,
+	                                              const FCostsGrid& CostsGrid, const FGridBounds& ExpandedBounds);
+	// Points each cell of OutCells to its neighbour with the lowest integration value. OutCells bounds have to be inside of the integration grid.
+	static void CalculateDirections(TFlowfieldDenseGrid<FDirectionsGridCell>& OutCells, const FIntegrationGrid& IntegrationGrid);
+
+	// Logs integration time of every method on square grids with random costs
+	static void BenchmarkIntegration(const TArray<int32>& GridSideSizes, const int32 Iterations);
 
 	static int32 GetNavigationAffectorCost(AActor* Actor);
+
+private:
+
+	// Costs are integers, so distances are kept in fixed point and sorted into buckets instead of a heap. Every cell is expanded once.
+	static void CalculateIntegrationGridDijkstra(FIntegrationGrid& OutIntegrationGrid, const FGridCellPosition& GoalCellPosition, const FCostsGrid& CostsGrid);
+	// Solves the eikonal equation with the fast marching method, cost of a cell is the inverse of the speed in it
+	static void CalculateIntegrationGridFastMarching(FIntegrationGrid& OutIntegrationGrid, const FGridCellPosition& GoalCellPosition, const FCostsGrid& CostsGrid);
 };
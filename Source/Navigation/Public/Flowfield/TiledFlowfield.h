@@ -0,0 +1,80 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/LruCache.h"
+#include "Flowfield/GridTypes.h"
+
+
+// Flowfield split into square tiles of the costs grid. Directions of a tile are calculated when an agent samples the tile first
+// and are kept in an LRU cache, so memory is bounded and nothing is calculated for tiles no agent visits.
+// Neighbour tiles are connected by portals. A coarse search over the portals gives each tile the distances to the goal at its borders.
+class NAVIGATION_API FTiledFlowfield
+{
+public:
+	// Run of border cells through which agents can pass between two neighbour tiles
+	struct FPortal
+	{
+		int32 TileIndices[2];
+		FGridBounds Cells[2];	// Cells of the portal on the side of each tile
+		FGridCellPosition CenterCells[2];
+	};
+
+	struct FGoal
+	{
+		FGridCellPosition Cell;
+		FGridBounds Window;	// Directions are sampled only in this area, the same as the full Directions Grid of the goal
+		int32 TileIndex = INDEX_NONE;
+		TArray<float> PortalsDistances;	// Integration values at the portals, -1 if the portal isn't reached
+		TArray<int32> PortalsNextTiles;	// Tile through which the path from the portal goes to the goal
+	};
+
+	using FTileDirections = TFlowfieldDenseGrid<FDirectionsGridCell>;
+
+private:
+	TSharedPtr<const FCostsGrid> CostsGrid;
+	int32 TileSize  = 32;
+	int32 TilesCols = 0;
+	int32 TilesRows = 0;
+
+	TArray<FPortal> Portals;
+	TArray<TArray<int32>> TilesPortals;	// Indices of portals on the borders of each tile
+	TArray<float> TilesMeanCosts;	// Estimates the cost of crossing a tile in the coarse search
+	TArray<FGoal> Goals;
+
+	FCriticalSection TilesCacheLock;
+	TLruCache<uint64, TSharedPtr<const FTileDirections>> TilesCache;	// Key is the goal index and the tile index
+
+public:
+	// Builds portals of all tiles over the costs grid
+	void Initialize(const TSharedPtr<const FCostsGrid>& InCostsGrid, const int32 InTileSize, const int32 MaxCachedTiles);
+	// Replaces goals and calculates their portals distances. Cached tiles are dropped.
+	void SetGoals(const TArray<FGridCellPosition>& GoalCells, const TArray<FGridBounds>& GoalWindows);
+
+	// Calculates directions of the tile with the cell if they aren't cached
+	FVector GetDirection(const FGridCellPosition& CellPosition, const int32 GoalIndex);
+	
+	int32 GetCachedTilesNum();
+	int32 GetPortalsNum() const { return Portals.Num(); }
+
+	struct FPathsCheckResult
+	{
+		int32 CyclesNum               = 0;
+		int32 MaxCycleLength          = 0;	// In cells
+		int32 CellsLeadingToCyclesNum = 0;	// Including the cells of the cycles
+		int32 DeadEndCellsNum         = 0;	// Paths stopping at a cell without a direction
+	};
+	// Follows directions from every cell of the goal window until the path reaches the goal or revisits a cell. Calculates all tiles of the window.
+	FPathsCheckResult FollowPaths(const int32 GoalIndex);
+	// Builds tiled flowfields over random costs grids with walls and logs an error for every goal with paths not reaching it
+	static bool CheckPathsReachGoals(const TArray<int32>& GridSideSizes, const int32 TileSize);
+
+private:
+	int32 GetTileIndex(const FGridCellPosition& CellPosition) const;
+	FGridBounds GetTileBounds(const int32 TileIndex) const;
+
+	void AddPortalsBetweenTiles(const int32 TileIndexA, const int32 TileIndexB, const bool bHorizontalNeighbours);
+	void CalculatePortalsDistances(FGoal& Goal) const;
+	TSharedPtr<const FTileDirections> CalculateTileDirections(const int32 TileIndex, const FGoal& Goal) const;
+};
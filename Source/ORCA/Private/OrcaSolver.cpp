@@ -2,7 +2,14 @@
 
 
 #include "OrcaSolver.h"
+#include "Async/ParallelFor.h"
 #include "ORCA/ThirdParty/RVO2/src/RVO.h"
+#include "Tasks/Task.h"
+
+DECLARE_STATS_GROUP(TEXT("ORCA"), STATGROUP_ORCA, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("ORCA Build Agent Tree"), STAT_OrcaBuildAgentTree, STATGROUP_ORCA);
+
+static_assert(sizeof(FVector2f) == sizeof(RVO::Vector2) && alignof(FVector2f) >= alignof(RVO::Vector2), "Bulk ORCA API reinterprets FVector2f arrays as RVO::Vector2 arrays");
 
 void UOrcaSolver::BeginDestroy()
 {
@@ -13,25 +20,56 @@ void UOrcaSolver::BeginDestroy()
 
 void UOrcaSolver::Initialize(const FOrcaDefaultAgentParams& AgentDefaults)
 {
-	simulator = new RVO::RVOSimulator();
+	simulator     = new RVO::RVOSimulator();
+	NeighbourDist = AgentDefaults.NeighborDist;
 
 	/* Specify the global time step of the simulation. */
 	simulator->setTimeStep(0.25F);
 
 	/* Specify the default parameters for agents that are subsequently added. */
 	simulator->setAgentDefaults(AgentDefaults.NeighborDist, 10U, 10.0F, 10.0F, AgentDefaults.AgentsRadius, AgentDefaults.MaxSpeed);
+	simulator->setAgentTreeRefit(AgentTreeMaxRefitSteps, AgentTreeMaxOverlapRatio);
 }
 
 int32 UOrcaSolver::AddAgent(const FVector& Location)
 {
-	return simulator->addAgent(RVO::Vector2{static_cast<float>(Location.X), static_cast<float>(Location.Y)});
+	const RVO::Vector2 Position{static_cast<float>(Location.X), static_cast<float>(Location.Y)};
+	if (FreeAgentIndices.IsEmpty())
+	{
+		return simulator->addAgent(Position);
+	}
+
+	const int32 AgentIndex = FreeAgentIndices.Pop(EAllowShrinking::No);
+	simulator->setAgentPosition(AgentIndex, Position);
+	simulator->setAgentVelocity(AgentIndex, RVO::Vector2{});
+	simulator->setAgentPrefVelocity(AgentIndex, RVO::Vector2{});
+	return AgentIndex;
+}
+
+void UOrcaSolver::DeleteAgent(const int32 AgentIndex)
+{
+	checkf(AgentIndex >= 0 && AgentIndex < GetAgentsNum(), TEXT("Deleting invalid ORCA agent %d"), AgentIndex);
+	checkSlow(!FreeAgentIndices.Contains(AgentIndex));
+	FreeAgentIndices.Add(AgentIndex);
+
+	// Until it is removed, the agent stands still and doesn't push its neighbours
+	simulator->setAgentVelocity(AgentIndex, RVO::Vector2{});
+	simulator->setAgentPrefVelocity(AgentIndex, RVO::Vector2{});
 }
 
-void UOrcaSolver::DeleteAgent(const int32 AgentIndex, const FVector& Location)
+void UOrcaSolver::RemoveFreeAgents(const TFunctionRef<void(const int32 OldIndex, const int32 NewIndex)>& OnAgentMoved)
 {
-	// Deleting agent is an issue to solve. Currently, we simply teleport agents far away :_)
-	constexpr float BigFloat = MAX_FLT - 10000.f;
-	simulator->setAgentPosition(AgentIndex, RVO::Vector2{BigFloat, BigFloat});
+	// Going from the highest index guarantees that the moved last agent is never a deleted one
+	FreeAgentIndices.Sort(TGreater<int32>());
+	for (const int32 AgentIndex : FreeAgentIndices)
+	{
+		const int32 MovedAgentIndex = static_cast<int32>(simulator->removeAgent(AgentIndex));
+		if (MovedAgentIndex != AgentIndex)
+		{
+			OnAgentMoved(MovedAgentIndex, AgentIndex);
+		}
+	}
+	FreeAgentIndices.Reset();
 }
 
 void UOrcaSolver::SetAgentLocation(const int32 AgentIndex, const FVector& Location)
@@ -47,7 +85,53 @@ FVector UOrcaSolver::GetAgentLocation(const int32 AgentIndex) const
 
 void UOrcaSolver::DoStep()
 {
-	simulator->doStep();
+	const int32 AgentsNum = static_cast<int32>(simulator->getNumAgents());
+	if (AgentsNum == 0)
+	{
+		LastAgentTreeTime = 0.f;
+		simulator->finishStep();
+		return;
+	}
+
+	if (NeighbourCandidatesProvider)
+	{
+		// Neighbours come from the external spatial index, so the agent tree is not needed
+		LastAgentTreeTime = 0.f;
+		ParallelFor(TEXT("OrcaComputeNewVelocities"), AgentsNum, AgentsBatchSize, [this](const int32 AgentIndex)
+		{
+			const RVO::Vector2& Position = simulator->getAgentPosition(AgentIndex);
+			FNeighbourCandidates Candidates;
+			NeighbourCandidatesProvider(AgentIndex, FVector2f{Position.x(), Position.y()}, Candidates);
+			simulator->computeAgentNewVelocity(AgentIndex, Candidates.GetData(), Candidates.Num());
+		});
+	}
+	else
+	{
+		// Neighbours and new velocities of all agents are computed only after the tree is built
+		const UE::Tasks::FTask BuildTreeTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this]()
+		{
+			SCOPE_CYCLE_COUNTER(STAT_OrcaBuildAgentTree);
+			const double StartTime = FPlatformTime::Seconds();
+			simulator->buildAgentTree();
+			LastAgentTreeTime = FPlatformTime::Seconds() - StartTime;
+		});
+		const UE::Tasks::FTask NewVelocitiesTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, AgentsNum]()
+		{
+			ParallelFor(TEXT("OrcaComputeNewVelocities"), AgentsNum, AgentsBatchSize, [this](const int32 AgentIndex)
+			{
+				simulator->computeAgentNewVelocity(AgentIndex);
+			});
+		}, BuildTreeTask);
+		NewVelocitiesTask.Wait();
+	}
+
+	// Velocities are read by neighbours in the previous phase, so they are updated only after it
+	ParallelFor(TEXT("OrcaUpdateAgents"), AgentsNum, AgentsBatchSize, [this](const int32 AgentIndex)
+	{
+		simulator->updateAgent(AgentIndex);
+	});
+	
+	simulator->finishStep();
 }
 
 void UOrcaSolver::SetTimeStep(const float TimeStep)
@@ -59,3 +143,102 @@ void UOrcaSolver::SetPreferredVelocity(const int32 AgentIndex, const FVector& Di
 {
 	simulator->setAgentPrefVelocity(AgentIndex, RVO::Vector2{static_cast<float>(Direction.X), static_cast<float>(Direction.Y)});
 }
+
+void UOrcaSolver::AddObstacle(TConstArrayView<FVector2f> Vertices)
+{
+	if (bObstaclesProcessed)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%hs] Obstacles are already processed, new obstacle is ignored."), __FUNCTION__);
+		return;
+	}
+	if (Vertices.Num() < 2)
+	{
+		return;
+	}
+
+	std::vector<RVO::Vector2> ObstacleVertices;
+	ObstacleVertices.reserve(Vertices.Num());
+	for (const FVector2f& Vertex : Vertices)
+	{
+		ObstacleVertices.emplace_back(Vertex.X, Vertex.Y);
+	}
+	simulator->addObstacle(ObstacleVertices);
+}
+
+void UOrcaSolver::ProcessObstacles()
+{
+	checkf(!bObstaclesProcessed, TEXT("ORCA obstacles tree is built only once"));
+	simulator->processObstacles();
+	bObstaclesProcessed = true;
+}
+
+uint64 UOrcaSolver::GetStepAllocationsNum()
+{
+	return RVO::RVOSimulator::getNumStepAllocations();
+}
+
+void UOrcaSolver::BenchmarkSteps(const TArray<int32>& AgentsNums, const int32 StepsNum)
+{
+	constexpr float AreaPerAgent   = 100.f * 100.f;
+	constexpr float TimeStep       = 1.f / 30.f;
+	constexpr int32 WarmUpStepsNum = 5;
+	constexpr int32 RandomSeed     = 1337;
+
+	for (const int32 AgentsNum : AgentsNums)
+	{
+		UOrcaSolver* Solver = NewObject<UOrcaSolver>();
+		Solver->Initialize(FOrcaDefaultAgentParams{});
+		Solver->SetTimeStep(TimeStep);
+
+		// Agents walk through the center to the opposite side of the square, so they have to avoid each other
+		FRandomStream RandomStream(RandomSeed);
+		const float Side = FMath::Sqrt(AgentsNum * AreaPerAgent);
+		TArray<FVector2f> Positions;
+		TArray<FVector2f> PrefVelocities;
+		for (int32 AgentIndex = 0; AgentIndex < AgentsNum; AgentIndex++)
+		{
+			const FVector Location{RandomStream.FRandRange(-0.5f, 0.5f) * Side, RandomStream.FRandRange(-0.5f, 0.5f) * Side, 0.f};
+			Solver->AddAgent(Location);
+			Positions.Add(FVector2f{static_cast<float>(Location.X), static_cast<float>(Location.Y)});
+			PrefVelocities.Add(-Positions.Last().GetSafeNormal());
+		}
+		Solver->SetAgentStates(Positions, PrefVelocities);
+
+		for (int32 Step = 0; Step < WarmUpStepsNum; Step++)
+		{
+			Solver->DoStep();
+		}
+
+		const uint64 StartAllocationsNum = GetStepAllocationsNum();
+		double TreeTime                  = 0.0;
+		const double StartTime           = FPlatformTime::Seconds();
+		for (int32 Step = 0; Step < StepsNum; Step++)
+		{
+			Solver->DoStep();
+			TreeTime += Solver->GetLastAgentTreeTime();
+		}
+		const double StepsTime = FPlatformTime::Seconds() - StartTime;
+
+		UE_LOG(LogTemp, Display, TEXT("[%hs] Agents: %d, step: %.3f ms, agent tree: %.3f ms, per step buffer allocations: %llu"), __FUNCTION__,
+			AgentsNum, StepsTime * 1000.0 / StepsNum, TreeTime * 1000.0 / StepsNum, GetStepAllocationsNum() - StartAllocationsNum);
+		Solver->MarkAsGarbage();
+	}
+}
+
+int32 UOrcaSolver::GetAgentsNum() const
+{
+	return static_cast<int32>(simulator->getNumAgents());
+}
+
+void UOrcaSolver::SetAgentStates(TConstArrayView<FVector2f> Positions, TConstArrayView<FVector2f> PrefVelocities)
+{
+	checkf(Positions.Num() == PrefVelocities.Num() && Positions.Num() <= GetAgentsNum(), TEXT("Agent states don't match ORCA agents"));
+	simulator->setAgentStates(reinterpret_cast<const RVO::Vector2*>(Positions.GetData()), reinterpret_cast<const RVO::Vector2*>(PrefVelocities.GetData()),
+	                          Positions.Num());
+}
+
+void UOrcaSolver::GetAgentPositions(TArrayView<FVector2f> OutPositions) const
+{
+	checkf(OutPositions.Num() <= GetAgentsNum(), TEXT("More positions are requested than ORCA agents exist"));
+	simulator->getAgentPositions(reinterpret_cast<RVO::Vector2*>(OutPositions.GetData()), OutPositions.Num());
+}
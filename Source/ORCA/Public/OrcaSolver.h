@@ -29,19 +29,64 @@ class ORCA_API UOrcaSolver : public UObject
 {
 	GENERATED_BODY()
 
+public:
+	static constexpr int32 InlineNeighbourCandidatesNum = 128;
+	using FNeighbourCandidates = TArray<SIZE_T, TInlineAllocator<InlineNeighbourCandidatesNum>>;
+	// Adds indices of agents that may be neighbours of the agent at the position. Called from worker threads during DoStep.
+	using FNeighbourCandidatesProvider = TFunction<void(const int32 AgentIndex, const FVector2f& Position, FNeighbourCandidates& OutCandidates)>;
+
 private:
+	static constexpr int32 AgentsBatchSize = 64;	// Min agents processed by one worker during the step phases
+	static constexpr int32 AgentTreeMaxRefitSteps = 10;	// Agents move only slightly per step, so the agent tree is mostly refitted instead of rebuilt
+	static constexpr float AgentTreeMaxOverlapRatio = 0.1f;	// Agent tree is rebuilt earlier when its sibling nodes overlap too much after a refit
+	
 	RVO::RVOSimulator* simulator;
+	float LastAgentTreeTime = 0.f;
+	float NeighbourDist     = 0.f;
+	FNeighbourCandidatesProvider NeighbourCandidatesProvider;	// If set, the agent tree is not built and neighbours are taken from candidates
+	TArray<int32> FreeAgentIndices;	// Deleted agents. Their slots are reused by new agents until they are removed by RemoveFreeAgents
+	bool bObstaclesProcessed = false;
 
 public:
 	virtual void BeginDestroy() override;
 		
 public:
 	void Initialize(const FOrcaDefaultAgentParams& AgentDefaults);
-	int32 AddAgent(const FVector& Location);	// Returns agent index in Orca Solver
-	void DeleteAgent(const int32 AgentIndex, const FVector& Location);	// Returns agent index in Orca Solver
+	int32 AddAgent(const FVector& Location);	// Returns agent index in Orca Solver. Reuses slots of deleted agents first
+	void DeleteAgent(const int32 AgentIndex);	// Agent stays in the solver until RemoveFreeAgents is called
+	// Removes deleted agents by moving the last agents into their slots. Callback is called for every moved agent
+	void RemoveFreeAgents(const TFunctionRef<void(const int32 OldIndex, const int32 NewIndex)>& OnAgentMoved);
+	int32 GetFreeAgentsNum() const { return FreeAgentIndices.Num(); }
 	void SetAgentLocation(const int32 AgentIndex, const FVector& Location);
 	FVector GetAgentLocation(const int32 AgentIndex) const;
-	void DoStep();
+	void DoStep();	// Agents are processed in parallel batches, the agents tree is built in a separate task
 	void SetTimeStep(const float TimeStep);
 	void SetPreferredVelocity(const int32 AgentIndex, const FVector& Direction);
+	float GetLastAgentTreeTime() const { return LastAgentTreeTime; }	// Time of the agent tree build or refit during the last step, in seconds
+	static uint64 GetStepAllocationsNum();	// Heap allocations of per step buffers of all solvers, they stop once buffers reach their working sizes
+
+	// Steps a synthetic crossing crowd, logs step times and heap allocations of per step buffers after the warm-up steps
+	static void BenchmarkSteps(const TArray<int32>& AgentsNums, const int32 StepsNum);
+
+	// NEIGHBOURS ------
+	// Closest agents within NeighbourDist are chosen among the candidates, up to the max neighbours of the agent
+
+	void SetNeighbourCandidatesProvider(FNeighbourCandidatesProvider&& InProvider) { NeighbourCandidatesProvider = MoveTemp(InProvider); }
+	void ResetNeighbourCandidatesProvider() { NeighbourCandidatesProvider.Reset(); }
+	float GetNeighbourDist() const { return NeighbourDist; }
+
+	// OBSTACLES ------
+	// Obstacles are static: they are added once and their kd-tree is built once by ProcessObstacles
+	
+	// Vertices of a solid polygon are in counterclockwise order, two vertices make a line obstacle
+	void AddObstacle(TConstArrayView<FVector2f> Vertices);
+	void ProcessObstacles();
+	bool AreObstaclesProcessed() const { return bObstaclesProcessed; }
+
+	// BULK ------
+	// Arrays are indexed by agent indices and cover agents [0, Num)
+	
+	int32 GetAgentsNum() const;
+	void SetAgentStates(TConstArrayView<FVector2f> Positions, TConstArrayView<FVector2f> PrefVelocities);
+	void GetAgentPositions(TArrayView<FVector2f> OutPositions) const;
 };
@@ -46,7 +46,24 @@
 #include "Obstacle.h"
 
 namespace RVO {
+std::atomic<std::size_t> Agent::numStepAllocations_(0U);
+
 namespace {
+/**
+ * @relates        Agent
+ * @brief          Reserves the capacity of a per step buffer. Counts the
+ *                 reservations that allocate.
+ * @param[in, out] buffer   The buffer to be reserved.
+ * @param[in]      capacity The required capacity of the buffer.
+ */
+template <typename T>
+void reserveStepBuffer(std::vector<T> &buffer, std::size_t capacity) {
+  if (buffer.capacity() < capacity) {
+    buffer.reserve(capacity);
+    Agent::numStepAllocations_.fetch_add(1U, std::memory_order_relaxed);
+  }
+}
+
 /**
  * @relates        Agent
  * @brief          Solves a one-dimensional linear program on a specified line
@@ -194,7 +211,11 @@ void linearProgram3(const std::vector<Line> &lines, std::size_t numObstLines,
   for (std::size_t i = beginLine; i < lines.size(); ++i) {
     if (det(lines[i].direction, lines[i].point - result) > distance) {
       /* Result does not satisfy constraint of line i. */
-      std::vector<Line> projLines(
+      /* Scratch lines of the worker thread, they keep their capacity
+       * between steps. */
+      static thread_local std::vector<Line> projLines;
+      reserveStepBuffer(projLines, lines.size());
+      projLines.assign(
           lines.begin(),
           lines.begin() + static_cast<std::ptrdiff_t>(numObstLines));
 
@@ -259,6 +280,7 @@ void Agent::computeNeighbors(const KdTree *kdTree) {
   kdTree->computeObstacleNeighbors(this, range * range);
 
   agentNeighbors_.clear();
+  reserveStepBuffer(agentNeighbors_, maxNeighbors_);
 
   if (maxNeighbors_ > 0U) {
     float rangeSq = neighborDist_ * neighborDist_;
@@ -266,9 +288,32 @@ void Agent::computeNeighbors(const KdTree *kdTree) {
   }
 }
 
+void Agent::computeNeighbors(const KdTree *kdTree,
+                             const std::vector<Agent> &agents,
+                             const std::size_t *candidateNos,
+                             std::size_t numCandidates) {
+  obstacleNeighbors_.clear();
+  const float range = timeHorizonObst_ * maxSpeed_ + radius_;
+  kdTree->computeObstacleNeighbors(this, range * range);
+
+  agentNeighbors_.clear();
+  reserveStepBuffer(agentNeighbors_, maxNeighbors_);
+
+  if (maxNeighbors_ > 0U) {
+    float rangeSq = neighborDist_ * neighborDist_;
+
+    for (std::size_t i = 0U; i < numCandidates; ++i) {
+      insertAgentNeighbor(&agents[candidateNos[i]], rangeSq);
+    }
+  }
+}
+
 /* Search for the best new velocity. */
 void Agent::computeNewVelocity(float timeStep) {
   orcaLines_.clear();
+  /* Every neighbor adds at most one line. */
+  reserveStepBuffer(orcaLines_,
+                    obstacleNeighbors_.size() + agentNeighbors_.size());
 
   const float invTimeHorizonObst = 1.0F / timeHorizonObst_;
 
@@ -659,6 +704,10 @@ void Agent::insertObstacleNeighbor(const Obstacle *obstacle, float rangeSq) {
   }
 
   if (distSq < rangeSq) {
+    if (obstacleNeighbors_.size() == obstacleNeighbors_.capacity()) {
+      numStepAllocations_.fetch_add(1U, std::memory_order_relaxed);
+    }
+
     obstacleNeighbors_.push_back(std::make_pair(distSq, obstacle));
 
     std::size_t i = obstacleNeighbors_.size() - 1U;
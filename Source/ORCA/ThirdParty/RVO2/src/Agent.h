@@ -39,6 +39,7 @@
  * @brief Declares the Agent class.
  */
 
+#include <atomic>
 #include <cstddef>
 #include <utility>
 #include <vector>
@@ -54,9 +55,10 @@ class Obstacle;
  * @brief Defines an agent in the simulation.
  */
 class Agent {
- private:
+ public:
   /**
-   * @brief Constructs an agent instance.
+   * @brief Constructs an agent instance. Agents are stored by value in the
+   *        simulator, so they are publicly constructible and copyable.
    */
   Agent();
 
@@ -65,6 +67,14 @@ class Agent {
    */
   ~Agent();
 
+  /**
+   * @brief The number of times the per step buffers of all agents had to grow.
+   *        Stays constant once the buffers have reached their working sizes.
+   */
+  static std::atomic<std::size_t> numStepAllocations_;
+
+ private:
+
   /**
    * @brief     Computes the neighbors of this agent.
    * @param[in] kdTree A pointer to the k-D trees for agents and static
@@ -72,6 +82,20 @@ class Agent {
    */
   void computeNeighbors(const KdTree *kdTree);
 
+  /**
+   * @brief     Computes the neighbors of this agent. Obstacle neighbors are
+   *            found in the obstacle k-D tree, agent neighbors are the nearest
+   *            of the candidates.
+   * @param[in] kdTree        A pointer to the k-D trees for agents and static
+   *                          obstacles in the simulation.
+   * @param[in] agents        The agents of the simulation.
+   * @param[in] candidateNos  The numbers of the candidate agent neighbors.
+   * @param[in] numCandidates The number of the candidate agent neighbors.
+   */
+  void computeNeighbors(const KdTree *kdTree, const std::vector<Agent> &agents,
+                        const std::size_t *candidateNos,
+                        std::size_t numCandidates);
+
   /**
    * @brief     Computes the new velocity of this agent.
    * @param[in] timeStep The time step of the simulation.
@@ -102,12 +126,6 @@ class Agent {
    */
   void update(float timeStep);
 
-  /* Not implemented. */
-  Agent(const Agent &other);
-
-  /* Not implemented. */
-  Agent &operator=(const Agent &other);
-
   std::vector<std::pair<float, const Agent *> > agentNeighbors_;
   std::vector<std::pair<float, const Obstacle *> > obstacleNeighbors_;
   std::vector<Line> orcaLines_;
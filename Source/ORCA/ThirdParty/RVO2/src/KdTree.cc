@@ -160,26 +160,49 @@ KdTree::ObstacleTreeNode::ObstacleTreeNode()
 KdTree::ObstacleTreeNode::~ObstacleTreeNode() {}
 
 KdTree::KdTree(RVOSimulator *simulator)
-    : obstacleTree_(NULL), simulator_(simulator) {}
+    : agentsData_(NULL),
+      agentTreeRefitSteps_(0U),
+      maxAgentTreeRefitSteps_(0U),
+      maxAgentTreeOverlapRatio_(0.0F),
+      obstacleTree_(NULL),
+      simulator_(simulator) {}
 
 KdTree::~KdTree() { deleteObstacleTree(obstacleTree_); }
 
 void KdTree::buildAgentTree() {
-  if (agents_.size() < simulator_->agents_.size()) {
-    agents_.insert(agents_.end(),
-                   simulator_->agents_.begin() +
-                       static_cast<std::ptrdiff_t>(agents_.size()),
-                   simulator_->agents_.end());
-    agentTree_.resize(2U * agents_.size() - 1U);
+  bool rebuild = agentTreeRefitSteps_ >= maxAgentTreeRefitSteps_;
+
+  if (agents_.size() != simulator_->agents_.size() ||
+      agentsData_ != simulator_->agents_.data()) {
+    /* Agents are stored by value, so their addresses change when the storage
+     * of the simulator grows. */
+    agents_.resize(simulator_->agents_.size());
+    for (std::size_t i = 0U; i < agents_.size(); ++i) {
+      agents_[i] = &simulator_->agents_[i];
+    }
+    agentsData_ = simulator_->agents_.data();
+    agentTree_.resize(agents_.empty() ? 0U : 2U * agents_.size() - 1U);
+    rebuild = true;
+  }
+
+  if (agents_.empty()) {
+    return;
   }
 
-  if (!agents_.empty()) {
-    buildAgentTreeRecursive(0U, agents_.size(), 0U);
+  if (!rebuild && refitAgentTree() <= maxAgentTreeOverlapRatio_) {
+    ++agentTreeRefitSteps_;
+    return;
   }
+
+  agentTreeNodes_.clear();
+  buildAgentTreeRecursive(0U, agents_.size(), 0U);
+  agentTreeRefitSteps_ = 0U;
 }
 
 void KdTree::buildAgentTreeRecursive(std::size_t begin, std::size_t end,
                                      std::size_t node) {
+  /* Nodes are recorded in preorder, so children follow their parents. */
+  agentTreeNodes_.push_back(node);
   agentTree_[node].begin = begin;
   agentTree_[node].end = end;
   agentTree_[node].minX = agentTree_[node].maxX = agents_[begin]->position_.x();
@@ -240,6 +263,52 @@ void KdTree::buildAgentTreeRecursive(std::size_t begin, std::size_t end,
   }
 }
 
+float KdTree::refitAgentTree() {
+  float overlapArea = 0.0F;
+  float innerNodesArea = 0.0F;
+
+  /* Children are refitted before their parents. Unused slots of the node
+   * array are skipped. */
+  for (std::vector<std::size_t>::const_reverse_iterator it =
+           agentTreeNodes_.rbegin();
+       it != agentTreeNodes_.rend(); ++it) {
+    AgentTreeNode &node = agentTree_[*it];
+
+    if (node.end - node.begin <= RVO_MAX_LEAF_SIZE) {
+      node.minX = node.maxX = agents_[node.begin]->position_.x();
+      node.minY = node.maxY = agents_[node.begin]->position_.y();
+
+      for (std::size_t i = node.begin + 1U; i < node.end; ++i) {
+        node.maxX = std::max(node.maxX, agents_[i]->position_.x());
+        node.minX = std::min(node.minX, agents_[i]->position_.x());
+        node.maxY = std::max(node.maxY, agents_[i]->position_.y());
+        node.minY = std::min(node.minY, agents_[i]->position_.y());
+      }
+    } else {
+      const AgentTreeNode &left = agentTree_[node.left];
+      const AgentTreeNode &right = agentTree_[node.right];
+
+      node.maxX = std::max(left.maxX, right.maxX);
+      node.minX = std::min(left.minX, right.minX);
+      node.maxY = std::max(left.maxY, right.maxY);
+      node.minY = std::min(left.minY, right.minY);
+
+      const float overlapX =
+          std::min(left.maxX, right.maxX) - std::max(left.minX, right.minX);
+      const float overlapY =
+          std::min(left.maxY, right.maxY) - std::max(left.minY, right.minY);
+
+      if (overlapX > 0.0F && overlapY > 0.0F) {
+        overlapArea += overlapX * overlapY;
+      }
+
+      innerNodesArea += (node.maxX - node.minX) * (node.maxY - node.minY);
+    }
+  }
+
+  return innerNodesArea > 0.0F ? overlapArea / innerNodesArea : 0.0F;
+}
+
 void KdTree::buildObstacleTree() {
   deleteObstacleTree(obstacleTree_);
 
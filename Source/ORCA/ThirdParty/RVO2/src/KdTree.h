@@ -68,10 +68,19 @@ class KdTree {
   ~KdTree();
 
   /**
-   * @brief Builds an agent k-D tree.
+   * @brief Builds an agent k-D tree. The tree of the previous step is only
+   *        refitted when it is allowed and still good enough.
    */
   void buildAgentTree();
 
+  /**
+   * @brief  Updates the bounding boxes of the agent k-D tree nodes bottom-up
+   *         and keeps the agents in their nodes.
+   * @return The overlapping area of sibling nodes relative to the area of all
+   *         inner nodes.
+   */
+  float refitAgentTree();
+
   /**
    * @brief     Recursive function to build an agent k-D tree.
    * @param[in] begin The beginning agent k-D tree node.
@@ -177,6 +186,11 @@ class KdTree {
   KdTree &operator=(const KdTree &other);
 
   std::vector<Agent *> agents_;
+  const Agent *agentsData_;
+  std::vector<std::size_t> agentTreeNodes_;
+  std::size_t agentTreeRefitSteps_;
+  std::size_t maxAgentTreeRefitSteps_;
+  float maxAgentTreeOverlapRatio_;
   std::vector<AgentTreeNode> agentTree_;
   ObstacleTreeNode *obstacleTree_;
   RVOSimulator *simulator_;
@@ -96,10 +96,6 @@ RVOSimulator::~RVOSimulator() {
   delete defaultAgent_;
   delete kdTree_;
 
-  for (std::size_t i = 0U; i < agents_.size(); ++i) {
-    delete agents_[i];
-  }
-
   for (std::size_t i = 0U; i < obstacles_.size(); ++i) {
     delete obstacles_[i];
   }
@@ -107,17 +103,17 @@ RVOSimulator::~RVOSimulator() {
 
 std::size_t RVOSimulator::addAgent(const Vector2 &position) {
   if (defaultAgent_ != NULL) {
-    Agent *const agent = new Agent();
-    agent->position_ = position;
-    agent->velocity_ = defaultAgent_->velocity_;
-    agent->id_ = agents_.size();
-    agent->maxNeighbors_ = defaultAgent_->maxNeighbors_;
-    agent->maxSpeed_ = defaultAgent_->maxSpeed_;
-    agent->neighborDist_ = defaultAgent_->neighborDist_;
-    agent->radius_ = defaultAgent_->radius_;
-    agent->timeHorizon_ = defaultAgent_->timeHorizon_;
-    agent->timeHorizonObst_ = defaultAgent_->timeHorizonObst_;
-    agents_.push_back(agent);
+    agents_.push_back(Agent());
+    Agent &agent = agents_.back();
+    agent.position_ = position;
+    agent.velocity_ = defaultAgent_->velocity_;
+    agent.id_ = agents_.size() - 1U;
+    agent.maxNeighbors_ = defaultAgent_->maxNeighbors_;
+    agent.maxSpeed_ = defaultAgent_->maxSpeed_;
+    agent.neighborDist_ = defaultAgent_->neighborDist_;
+    agent.radius_ = defaultAgent_->radius_;
+    agent.timeHorizon_ = defaultAgent_->timeHorizon_;
+    agent.timeHorizonObst_ = defaultAgent_->timeHorizonObst_;
 
     return agents_.size() - 1U;
   }
@@ -137,21 +133,34 @@ std::size_t RVOSimulator::addAgent(const Vector2 &position, float neighborDist,
                                    std::size_t maxNeighbors, float timeHorizon,
                                    float timeHorizonObst, float radius,
                                    float maxSpeed, const Vector2 &velocity) {
-  Agent *const agent = new Agent();
-  agent->position_ = position;
-  agent->velocity_ = velocity;
-  agent->id_ = agents_.size();
-  agent->maxNeighbors_ = maxNeighbors;
-  agent->maxSpeed_ = maxSpeed;
-  agent->neighborDist_ = neighborDist;
-  agent->radius_ = radius;
-  agent->timeHorizon_ = timeHorizon;
-  agent->timeHorizonObst_ = timeHorizonObst;
-  agents_.push_back(agent);
+  agents_.push_back(Agent());
+  Agent &agent = agents_.back();
+  agent.position_ = position;
+  agent.velocity_ = velocity;
+  agent.id_ = agents_.size() - 1U;
+  agent.maxNeighbors_ = maxNeighbors;
+  agent.maxSpeed_ = maxSpeed;
+  agent.neighborDist_ = neighborDist;
+  agent.radius_ = radius;
+  agent.timeHorizon_ = timeHorizon;
+  agent.timeHorizonObst_ = timeHorizonObst;
 
   return agents_.size() - 1U;
 }
 
+std::size_t RVOSimulator::removeAgent(std::size_t agentNo) {
+  const std::size_t lastAgentNo = agents_.size() - 1U;
+
+  if (agentNo != lastAgentNo) {
+    agents_[agentNo] = agents_[lastAgentNo];
+    agents_[agentNo].id_ = agentNo;
+  }
+
+  agents_.pop_back();
+
+  return lastAgentNo;
+}
+
 std::size_t RVOSimulator::addObstacle(const std::vector<Vector2> &vertices) {
   if (vertices.size() > 1U) {
     const std::size_t obstacleNo = obstacles_.size();
@@ -200,82 +209,108 @@ void RVOSimulator::doStep() {
 #pragma omp parallel for
 #endif /* _OPENMP */
   for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-    agents_[i]->computeNeighbors(kdTree_);
-    agents_[i]->computeNewVelocity(timeStep_);
+    agents_[i].computeNeighbors(kdTree_);
+    agents_[i].computeNewVelocity(timeStep_);
   }
 
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif /* _OPENMP */
   for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-    agents_[i]->update(timeStep_);
+    agents_[i].update(timeStep_);
   }
 
   globalTime_ += timeStep_;
 }
 
+void RVOSimulator::buildAgentTree() { kdTree_->buildAgentTree(); }
+
+void RVOSimulator::computeAgentNewVelocity(std::size_t agentNo) {
+  agents_[agentNo].computeNeighbors(kdTree_);
+  agents_[agentNo].computeNewVelocity(timeStep_);
+}
+
+void RVOSimulator::computeAgentNewVelocity(std::size_t agentNo,
+                                           const std::size_t *candidateNos,
+                                           std::size_t numCandidates) {
+  agents_[agentNo].computeNeighbors(kdTree_, agents_, candidateNos,
+                                    numCandidates);
+  agents_[agentNo].computeNewVelocity(timeStep_);
+}
+
+void RVOSimulator::updateAgent(std::size_t agentNo) {
+  agents_[agentNo].update(timeStep_);
+}
+
 std::size_t RVOSimulator::getAgentAgentNeighbor(std::size_t agentNo,
                                                 std::size_t neighborNo) const {
-  return agents_[agentNo]->agentNeighbors_[neighborNo].second->id_;
+  return agents_[agentNo].agentNeighbors_[neighborNo].second->id_;
 }
 
 std::size_t RVOSimulator::getAgentMaxNeighbors(std::size_t agentNo) const {
-  return agents_[agentNo]->maxNeighbors_;
+  return agents_[agentNo].maxNeighbors_;
 }
 
 float RVOSimulator::getAgentMaxSpeed(std::size_t agentNo) const {
-  return agents_[agentNo]->maxSpeed_;
+  return agents_[agentNo].maxSpeed_;
 }
 
 float RVOSimulator::getAgentNeighborDist(std::size_t agentNo) const {
-  return agents_[agentNo]->neighborDist_;
+  return agents_[agentNo].neighborDist_;
 }
 
 std::size_t RVOSimulator::getAgentNumAgentNeighbors(std::size_t agentNo) const {
-  return agents_[agentNo]->agentNeighbors_.size();
+  return agents_[agentNo].agentNeighbors_.size();
 }
 
 std::size_t RVOSimulator::getAgentNumObstacleNeighbors(
     std::size_t agentNo) const {
-  return agents_[agentNo]->obstacleNeighbors_.size();
+  return agents_[agentNo].obstacleNeighbors_.size();
 }
 
 std::size_t RVOSimulator::getAgentNumORCALines(std::size_t agentNo) const {
-  return agents_[agentNo]->orcaLines_.size();
+  return agents_[agentNo].orcaLines_.size();
 }
 
 std::size_t RVOSimulator::getAgentObstacleNeighbor(
     std::size_t agentNo, std::size_t neighborNo) const {
-  return agents_[agentNo]->obstacleNeighbors_[neighborNo].second->id_;
+  return agents_[agentNo].obstacleNeighbors_[neighborNo].second->id_;
 }
 
 const Line &RVOSimulator::getAgentORCALine(std::size_t agentNo,
                                            std::size_t lineNo) const {
-  return agents_[agentNo]->orcaLines_[lineNo];
+  return agents_[agentNo].orcaLines_[lineNo];
 }
 
 const Vector2 &RVOSimulator::getAgentPosition(std::size_t agentNo) const {
-  return agents_[agentNo]->position_;
+  return agents_[agentNo].position_;
+}
+
+void RVOSimulator::getAgentPositions(Vector2 *positions,
+                                     std::size_t numAgents) const {
+  for (std::size_t i = 0U; i < numAgents; ++i) {
+    positions[i] = agents_[i].position_;
+  }
 }
 
 const Vector2 &RVOSimulator::getAgentPrefVelocity(std::size_t agentNo) const {
-  return agents_[agentNo]->prefVelocity_;
+  return agents_[agentNo].prefVelocity_;
 }
 
 float RVOSimulator::getAgentRadius(std::size_t agentNo) const {
-  return agents_[agentNo]->radius_;
+  return agents_[agentNo].radius_;
 }
 
 float RVOSimulator::getAgentTimeHorizon(std::size_t agentNo) const {
-  return agents_[agentNo]->timeHorizon_;
+  return agents_[agentNo].timeHorizon_;
 }
 
 float RVOSimulator::getAgentTimeHorizonObst(std::size_t agentNo) const {
-  return agents_[agentNo]->timeHorizonObst_;
+  return agents_[agentNo].timeHorizonObst_;
 }
 
 const Vector2 &RVOSimulator::getAgentVelocity(std::size_t agentNo) const {
-  return agents_[agentNo]->velocity_;
+  return agents_[agentNo].velocity_;
 }
 
 const Vector2 &RVOSimulator::getObstacleVertex(std::size_t vertexNo) const {
@@ -292,6 +327,12 @@ std::size_t RVOSimulator::getPrevObstacleVertexNo(std::size_t vertexNo) const {
 
 void RVOSimulator::processObstacles() { kdTree_->buildObstacleTree(); }
 
+void RVOSimulator::setAgentTreeRefit(std::size_t maxRefitSteps,
+                                     float maxOverlapRatio) {
+  kdTree_->maxAgentTreeRefitSteps_ = maxRefitSteps;
+  kdTree_->maxAgentTreeOverlapRatio_ = maxOverlapRatio;
+}
+
 bool RVOSimulator::queryVisibility(const Vector2 &point1,
                                    const Vector2 &point2) const {
   return kdTree_->queryVisibility(point1, point2, 0.0F);
@@ -329,43 +370,52 @@ void RVOSimulator::setAgentDefaults(float neighborDist,
 
 void RVOSimulator::setAgentMaxNeighbors(std::size_t agentNo,
                                         std::size_t maxNeighbors) {
-  agents_[agentNo]->maxNeighbors_ = maxNeighbors;
+  agents_[agentNo].maxNeighbors_ = maxNeighbors;
 }
 
 void RVOSimulator::setAgentMaxSpeed(std::size_t agentNo, float maxSpeed) {
-  agents_[agentNo]->maxSpeed_ = maxSpeed;
+  agents_[agentNo].maxSpeed_ = maxSpeed;
 }
 
 void RVOSimulator::setAgentNeighborDist(std::size_t agentNo,
                                         float neighborDist) {
-  agents_[agentNo]->neighborDist_ = neighborDist;
+  agents_[agentNo].neighborDist_ = neighborDist;
 }
 
 void RVOSimulator::setAgentPosition(std::size_t agentNo,
                                     const Vector2 &position) {
-  agents_[agentNo]->position_ = position;
+  agents_[agentNo].position_ = position;
 }
 
 void RVOSimulator::setAgentPrefVelocity(std::size_t agentNo,
                                         const Vector2 &prefVelocity) {
-  agents_[agentNo]->prefVelocity_ = prefVelocity;
+  agents_[agentNo].prefVelocity_ = prefVelocity;
+}
+
+void RVOSimulator::setAgentStates(const Vector2 *positions,
+                                  const Vector2 *prefVelocities,
+                                  std::size_t numAgents) {
+  for (std::size_t i = 0U; i < numAgents; ++i) {
+    agents_[i].position_ = positions[i];
+    agents_[i].prefVelocity_ = prefVelocities[i];
+  }
 }
 
 void RVOSimulator::setAgentRadius(std::size_t agentNo, float radius) {
-  agents_[agentNo]->radius_ = radius;
+  agents_[agentNo].radius_ = radius;
 }
 
 void RVOSimulator::setAgentTimeHorizon(std::size_t agentNo, float timeHorizon) {
-  agents_[agentNo]->timeHorizon_ = timeHorizon;
+  agents_[agentNo].timeHorizon_ = timeHorizon;
 }
 
 void RVOSimulator::setAgentTimeHorizonObst(std::size_t agentNo,
                                            float timeHorizonObst) {
-  agents_[agentNo]->timeHorizonObst_ = timeHorizonObst;
+  agents_[agentNo].timeHorizonObst_ = timeHorizonObst;
 }
 
 void RVOSimulator::setAgentVelocity(std::size_t agentNo,
                                     const Vector2 &velocity) {
-  agents_[agentNo]->velocity_ = velocity;
+  agents_[agentNo].velocity_ = velocity;
 }
 } /* namespace RVO */
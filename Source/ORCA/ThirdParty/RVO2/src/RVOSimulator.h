@@ -42,10 +42,10 @@
 #include <cstddef>
 #include <vector>
 
+#include "Agent.h"
 #include "Export.h"
 
 namespace RVO {
-class Agent;
 class KdTree;
 class Line;
 class Obstacle;
@@ -245,6 +245,16 @@ class RVO_EXPORT RVOSimulator {
                        float timeHorizonObst, float radius, float maxSpeed,
                        const Vector2 &velocity);
 
+  /**
+   * @brief     Removes an agent from the simulation. The last agent is moved
+   *            into the slot of the removed agent, so its number changes.
+   * @param[in] agentNo The number of the agent to be removed.
+   * @return    The previous number of the agent that was moved into agentNo,
+   *            or agentNo when the removed agent was the last one.
+   * @note      Agent neighbors are not valid until the next simulation step.
+   */
+  std::size_t removeAgent(std::size_t agentNo);
+
   /**
    * @brief     Adds a new obstacle to the simulation.
    * @param[in] vertices List of the vertices of the polygonal obstacle in
@@ -263,6 +273,47 @@ class RVO_EXPORT RVOSimulator {
    */
   void doStep();
 
+  /**
+   * @brief Builds the k-D tree of the agents. First phase of a simulation
+   *        step that is performed phase by phase instead of doStep().
+   */
+  void buildAgentTree();
+
+  /**
+   * @brief     Computes the neighbors and the new velocity of a specified
+   *            agent. Different agents may be processed concurrently once the
+   *            agent tree is built.
+   * @param[in] agentNo The number of the agent.
+   */
+  void computeAgentNewVelocity(std::size_t agentNo);
+
+  /**
+   * @brief     Computes the neighbors and the new velocity of a specified
+   *            agent. Agent neighbors are chosen among the given candidates
+   *            instead of the agent k-D tree, so the tree doesn't have to be
+   *            built. Different agents may be processed concurrently.
+   * @param[in] agentNo       The number of the agent.
+   * @param[in] candidateNos  The numbers of the candidate agent neighbors.
+   * @param[in] numCandidates The number of the candidate agent neighbors.
+   */
+  void computeAgentNewVelocity(std::size_t agentNo,
+                               const std::size_t *candidateNos,
+                               std::size_t numCandidates);
+
+  /**
+   * @brief     Updates the two-dimensional position and two-dimensional
+   *            velocity of a specified agent. Different agents may be updated
+   *            concurrently once all new velocities are computed.
+   * @param[in] agentNo The number of the agent.
+   */
+  void updateAgent(std::size_t agentNo);
+
+  /**
+   * @brief Advances the global time. Last phase of a simulation step that is
+   *        performed phase by phase instead of doStep().
+   */
+  void finishStep() { globalTime_ += timeStep_; }
+
   /**
    * @brief     Returns the specified agent neighbor of the specified agent.
    * @param[in] agentNo    The number of the agent whose agent neighbor is to be
@@ -357,6 +408,14 @@ class RVO_EXPORT RVOSimulator {
    */
   const Vector2 &getAgentPosition(std::size_t agentNo) const;
 
+  /**
+   * @brief      Copies the two-dimensional positions of the first agents.
+   * @param[out] positions Contiguous array of numAgents positions.
+   * @param[in]  numAgents The number of agents to copy. Must not exceed the
+   *                       number of agents in the simulation.
+   */
+  void getAgentPositions(Vector2 *positions, std::size_t numAgents) const;
+
   /**
    * @brief     Returns the two-dimensional preferred velocity of a specified
    *            agent.
@@ -405,6 +464,15 @@ class RVO_EXPORT RVOSimulator {
    */
   float getGlobalTime() const { return globalTime_; }
 
+  /**
+   * @brief  Returns the number of times the per step buffers of the agents of
+   *         all simulations had to grow.
+   * @return The present number of per step buffer allocations.
+   */
+  static std::size_t getNumStepAllocations() {
+    return Agent::numStepAllocations_.load(std::memory_order_relaxed);
+  }
+
   /**
    * @brief  Returns the count of agents in the simulation.
    * @return The count of agents in the simulation.
@@ -604,6 +672,18 @@ class RVO_EXPORT RVOSimulator {
    */
   void setAgentPrefVelocity(std::size_t agentNo, const Vector2 &prefVelocity);
 
+  /**
+   * @brief     Sets the two-dimensional positions and preferred velocities of
+   *            the first agents.
+   * @param[in] positions      Contiguous array of numAgents positions.
+   * @param[in] prefVelocities Contiguous array of numAgents preferred
+   *                           velocities.
+   * @param[in] numAgents      The number of agents to modify. Must not exceed
+   *                           the number of agents in the simulation.
+   */
+  void setAgentStates(const Vector2 *positions, const Vector2 *prefVelocities,
+                      std::size_t numAgents);
+
   /**
    * @brief     Sets the radius of a specified agent.
    * @param[in] agentNo The number of the agent whose radius is to be modified.
@@ -639,6 +719,18 @@ class RVO_EXPORT RVOSimulator {
    */
   void setAgentVelocity(std::size_t agentNo, const Vector2 &velocity);
 
+  /**
+   * @brief     Lets the agent k-D tree be refitted instead of being rebuilt
+   *            while agents move only slightly between simulation steps.
+   * @param[in] maxRefitSteps   The maximum number of consecutive steps in
+   *                            which the tree is refitted. Zero disables
+   *                            refitting.
+   * @param[in] maxOverlapRatio The maximum overlapping area of sibling tree
+   *                            nodes relative to the area of all inner nodes.
+   *                            The tree is rebuilt when a refit exceeds it.
+   */
+  void setAgentTreeRefit(std::size_t maxRefitSteps, float maxOverlapRatio);
+
   /**
    * @brief     Sets the time step of the simulation.
    * @param[in] timeStep The time step of the simulation. Must be positive.
@@ -652,7 +744,7 @@ class RVO_EXPORT RVOSimulator {
   /* Not implemented. */
   RVOSimulator &operator=(const RVOSimulator &other);
 
-  std::vector<Agent *> agents_;
+  std::vector<Agent> agents_;
   std::vector<Obstacle *> obstacles_;
   Agent *defaultAgent_;
   KdTree *kdTree_;